@@ -0,0 +1,83 @@
+#ifndef COMP3421_ARENA_HPP
+#define COMP3421_ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocation for the short-lived working memory of building meshes. Nothing is freed on its
+// own, the arena is rewound to an earlier mark instead and keeps its blocks for the next user, so
+// once it has grown to fit the biggest mesh, building more meshes doesn't touch the heap
+namespace arena {
+    struct block_t {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size = 0;
+    };
+
+    struct arena_t {
+        std::vector<block_t> blocks;
+        size_t block = 0; // block being allocated from
+        size_t used = 0; // bytes used in it
+    };
+
+    struct mark_t {
+        size_t block = 0;
+        size_t used = 0;
+    };
+
+    /**
+     * The calling thread's arena for temporaries. Rewind it to a mark taken before using it
+     * @return
+     */
+    arena_t &scratch();
+
+    /**
+     * @param arena
+     * @param bytes
+     * @param alignment a power of two no more than alignof(std::max_align_t)
+     * @return uninitialised memory that lives until the arena is rewound past it
+     */
+    void *allocate(arena_t &arena, size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    mark_t mark(const arena_t &arena);
+
+    /**
+     * Release everything allocated since the mark was taken
+     * @param arena
+     * @param mark
+     */
+    void rewind(arena_t &arena, mark_t mark);
+
+    // for standard containers of temporaries, their memory comes back when the arena is rewound
+    template<typename T>
+    struct allocator_t {
+        using value_type = T;
+
+        arena_t *arena;
+
+        explicit allocator_t(arena_t &arena) : arena(&arena) {}
+
+        template<typename U>
+        allocator_t(const allocator_t<U> &other) : arena(other.arena) {}
+
+        T *allocate(size_t count) { return static_cast<T *>(arena::allocate(*arena, count * sizeof(T), alignof(T))); }
+
+        void deallocate(T *, size_t) {}
+    };
+
+    template<typename T, typename U>
+    bool operator==(const allocator_t<T> &a, const allocator_t<U> &b) { return a.arena == b.arena; }
+
+    template<typename T, typename U>
+    bool operator!=(const allocator_t<T> &a, const allocator_t<U> &b) { return a.arena != b.arena; }
+
+    template<typename T>
+    using vector = std::vector<T, allocator_t<T>>;
+
+    template<typename T>
+    vector<T> make_vector(arena_t &arena, size_t count = 0, const T &value = T{}) {
+        return vector<T>(count, value, allocator_t<T>(arena));
+    }
+} // namespace arena
+
+#endif // COMP3421_ARENA_HPP
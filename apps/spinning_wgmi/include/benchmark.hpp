@@ -0,0 +1,43 @@
+#ifndef COMP3421_BENCHMARK_HPP
+#define COMP3421_BENCHMARK_HPP
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Offline measurements, run from the command line instead of opening the window
+namespace benchmark {
+    /**
+     * Time the shape generators at tessellations 64, 256 and 1024 and print their throughput
+     * @param out
+     */
+    void shapes(std::ostream &out);
+
+    /**
+     * Time shapes::calc_vertex_normals with each weighting, on one thread and on all of them, over the
+     * meshes of each OBJ through model::load_templates. Without paths a generated torus of about four
+     * million triangles stands in
+     * @param out
+     * @param paths
+     */
+    void normals(std::ostream &out, const std::vector<std::string> &paths);
+
+    /**
+     * Print the bytes a vertex takes as float32, in the packed layout and in the quantized one, and how
+     * far quantizing moves its attributes at worst, for the procedural shapes and each mesh of each OBJ
+     * @param out
+     * @param paths
+     */
+    void quantization(std::ostream &out, const std::vector<std::string> &paths);
+
+    /**
+     * Split the meshes of each OBJ into clusters and print how long that takes, then how many triangles
+     * clusters::cull keeps and how long it takes, averaged over views from all round the mesh. Without
+     * paths a generated torus of about a million triangles stands in
+     * @param out
+     * @param paths
+     */
+    void clusters(std::ostream &out, const std::vector<std::string> &paths);
+} // namespace benchmark
+
+#endif // COMP3421_BENCHMARK_HPP
@@ -0,0 +1,73 @@
+#ifndef COMP3421_BOUNDS_HPP
+#define COMP3421_BOUNDS_HPP
+
+#include <glm/glm.hpp>
+#include <limits>
+#include <vector>
+
+namespace bounds {
+    // axis aligned bounding box, empty (min > max) until something is added to it
+    struct aabb_t {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+    };
+
+    struct sphere_t {
+        glm::vec3 center = glm::vec3(0);
+        float radius = -1.0f; // negative when empty
+    };
+
+    // the six planes of a view-projection frustum, pointing inwards (xyz: normal, w: distance)
+    struct frustum_t {
+        glm::vec4 planes[6];
+    };
+
+    enum containment_t {
+        OUTSIDE,
+        INTERSECTS,
+        INSIDE,
+    };
+
+    bool empty(const aabb_t &box);
+
+    aabb_t from_points(const std::vector<glm::vec3> &points);
+
+    /**
+     * Smallest box containing both boxes
+     * @param a
+     * @param b
+     * @return
+     */
+    aabb_t merge(const aabb_t &a, const aabb_t &b);
+
+    /**
+     * Box around the transformed box (Arvo's method), looser than the transformed corners but cheap
+     * @param box
+     * @param transform
+     * @return
+     */
+    aabb_t transform(const aabb_t &box, const glm::mat4 &transform);
+
+    /**
+     * Sphere around the points, centred on their bounding box
+     * @param points
+     * @param box - bounding box of points
+     * @return
+     */
+    sphere_t bounding_sphere(const std::vector<glm::vec3> &points, const aabb_t &box);
+
+    sphere_t transform(const sphere_t &sphere, const glm::mat4 &transform);
+
+    /**
+     * Extract the frustum planes of a view-projection matrix (Gribb/Hartmann)
+     * @param view_proj
+     * @return
+     */
+    frustum_t make_frustum(const glm::mat4 &view_proj);
+
+    containment_t classify(const frustum_t &frustum, const aabb_t &box);
+
+    bool intersects(const frustum_t &frustum, const sphere_t &sphere);
+} // namespace bounds
+
+#endif // COMP3421_BOUNDS_HPP
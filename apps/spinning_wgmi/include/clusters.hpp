@@ -0,0 +1,81 @@
+#ifndef COMP3421_CLUSTERS_HPP
+#define COMP3421_CLUSTERS_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+#include "mesh.hpp"
+#include "bounds.hpp"
+
+// Big meshes split into clusters of about CLUSTER_TRIANGLES neighbouring triangles, each with a
+// bounding sphere and a cone around its triangles' normals, so the renderer can drop the clusters of
+// an instance that are outside the frustum or facing away from the camera before drawing the rest as
+// a handful of index ranges. Clusters are made once, when a model is loaded, by reordering the
+// template's triangles so each cluster's are contiguous (mesh_optimizer keeps them so); culling is
+// done per instance per frame, four clusters at a time in SSE where we have it
+namespace clusters {
+    const size_t CLUSTER_TRIANGLES = 128;
+
+    // meshes with fewer triangles are drawn whole, they cost less than the draws culling would add
+    const size_t MIN_CLUSTERED_TRIANGLES = 8 * CLUSTER_TRIANGLES;
+
+    // cull's work is split between threads in runs of at least this many clusters
+    const size_t MIN_CLUSTERS_PER_THREAD = 1 << 13;
+
+    // one mesh's clusters, in model space, as arrays so cull can read four of each at a time. The
+    // bounds are padded with empty clusters to a multiple of four
+    struct clusters_t {
+        size_t count = 0;
+        std::vector<float> center_x, center_y, center_z, radius; // bounding spheres
+        // cones holding every triangle's normal: a cluster faces away from a camera at c when
+        // dot(center - c, axis) >= cutoff * |center - c| + radius. Clusters whose normals spread too
+        // far, and every cluster of a mesh with holes (whose back faces can show), have a zero axis
+        // and a cutoff of 1, which is never true
+        std::vector<float> axis_x, axis_y, axis_z, cutoff;
+        std::vector<GLuint> first_index; // relative to the mesh, count of each
+        std::vector<GLsizei> index_count;
+    };
+
+    // the index ranges of the clusters to draw, relative to the mesh's first index, as two arrays so
+    // the counts can go straight to glMultiDrawElementsBaseVertex
+    struct ranges_t {
+        std::vector<GLuint> first_indices;
+        std::vector<GLsizei> index_counts;
+    };
+
+    /**
+     * Grow clusters over the template's triangles, each from the triangles next to it that are
+     * nearest its middle and closest to facing its way, then reorder the triangles cluster by cluster
+     * and record where each starts in mesh_template.groups. Templates that aren't an indexed triangle
+     * list of at least MIN_CLUSTERED_TRIANGLES are left alone and get no clusters
+     * @param mesh_template
+     * @return
+     */
+    clusters_t build(mesh::mesh_template_t &mesh_template);
+
+    /**
+     * Append the index ranges of the clusters of one instance that may be seen, merging neighbouring
+     * clusters into one range
+     * @param clusters
+     * @param world - the instance's model to world transform
+     * @param frustum - in world space
+     * @param camera - in world space
+     * @param cull_backfaces - false where the back of a surface can show anyway, e.g. in wireframe,
+     * through translucent materials or where a clip plane cuts the mesh open
+     * @param ranges
+     * @param max_threads - 0 for as many as the hardware has
+     * @return how many of the clusters were kept
+     */
+    size_t cull(const clusters_t &clusters, const glm::mat4 &world, const bounds::frustum_t &frustum,
+                const glm::vec3 &camera, bool cull_backfaces, ranges_t &ranges, unsigned int max_threads = 0);
+
+    /**
+     * Empty the ranges, keeping their storage for the next frame
+     * @param ranges
+     */
+    void clear(ranges_t &ranges);
+} // namespace clusters
+
+#endif // COMP3421_CLUSTERS_HPP
@@ -0,0 +1,50 @@
+#ifndef COMP3421_GEOMETRY_CACHE_HPP
+#define COMP3421_GEOMETRY_CACHE_HPP
+
+#include <vector>
+
+#include "mesh.hpp"
+
+// Static meshes of the procedural shapes, shared by everything that asks for the same shape.
+// Shapes are keyed by generator, parameters and tessellation. Those whose attributes don't change
+// with size are made once at unit radius and handed out with the scale that sizes them, so e.g.
+// every torus with the same thickness to radius ratio draws from one mesh. Parameters are
+// compared after rounding to 1/65536, so near-identical requests share too. Meshes are stored in
+// vertex_layout's QUANTIZED layout and also kept in mesh_store, so later launches map them instead of
+// generating them. Every shape comes with a chain
+// of coarser levels of detail, made at half the tessellation of the one before down to a handful of
+// segments a circle, each cached like any other mesh
+namespace geometry_cache {
+    struct cached_mesh_t {
+        mesh::mesh_t mesh;
+        float scale = 1.0f; // uniform scale to give the node drawing the mesh
+        std::vector<mesh::lod_t> lods; // finest first, each error measured before scaling
+    };
+
+    // see the shapes:: generators of the same names for the parameters
+    cached_mesh_t sphere(float radius, unsigned int tessellation = 64);
+
+    cached_mesh_t wgmi_face(float radius, unsigned int tessellation = 64);
+
+    cached_mesh_t sphere_skeleton(float radius, float angle_thickness, unsigned int slices,
+                                  unsigned int tessellation = 64);
+
+    cached_mesh_t torus(float radius, float thickness, int tessellation = 64);
+
+    // its colours are its positions, so it is cached at the size asked for
+    cached_mesh_t zero_character(float radius, float z, float thickness, unsigned int tessellation = 64,
+                                 bool flip_normals = false);
+
+    /**
+     * Drop one reference to a mesh, destroying it once nothing refers to it. Call once for every
+     * mesh the cache handed out, levels of detail included
+     * @param mesh
+     * @return false if the mesh isn't from the cache, and so was left alone
+     */
+    bool release(const mesh::mesh_t &mesh);
+
+    // number of distinct meshes held
+    size_t size();
+} // namespace geometry_cache
+
+#endif // COMP3421_GEOMETRY_CACHE_HPP
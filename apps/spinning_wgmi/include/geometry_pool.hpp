@@ -0,0 +1,61 @@
+#ifndef COMP3421_GEOMETRY_POOL_HPP
+#define COMP3421_GEOMETRY_POOL_HPP
+
+#include <glad/glad.h>
+#include <cstdint>
+
+#include "mesh.hpp"
+#include "vertex_layout.hpp"
+
+// Static meshes are sub-allocated out of a few large buffers, one pair per vertex layout and index
+// type, each with a single VAO. A mesh only remembers where its vertices and indices start, and is
+// drawn with a base vertex, so meshes of the same format never rebind vertex state between draws
+namespace geometry_pool {
+    // meshes with at most this many vertices get 16-bit indices, they're relative to the base vertex
+    const GLsizei MAX_SHORT_INDEXED_VERTICES = 1 << 16;
+
+    struct allocation_t {
+        GLuint vao = 0;
+        std::uint32_t format = 0; // attribute set, see vertex_layout
+        GLint base_vertex = 0;
+        GLsizei vertex_count = 0;
+        GLuint first_index = 0;
+        GLsizei index_count = 0;
+        GLenum index_type = GL_UNSIGNED_INT;
+    };
+
+    /**
+     * @param vertex_count
+     * @param primitive - strips reserve the all-ones index for restarting, so one fewer vertex fits 16 bits
+     * @return GL_UNSIGNED_SHORT if the vertices can be reached with it, else GL_UNSIGNED_INT
+     */
+    GLenum index_type_for(GLsizei vertex_count, GLenum primitive);
+
+    /**
+     * Pack the template's vertices and indices for upload. Indices are 16-bit whenever the vertex
+     * count allows it, restart indices included. Templates without indices get a sequential index list. Bounds are left to
+     * the caller
+     * @param mesh_template
+     * @param box - the mesh's bounds, which quantized positions are stored relative to
+     * @param quantize - store the vertices in vertex_layout's QUANTIZED layout
+     * @return arrays in arena::scratch(), valid until the caller rewinds it past them
+     */
+    mesh::packed_mesh_t pack(const mesh::mesh_template_t &mesh_template, const bounds::aabb_t &box,
+                             bool quantize = false);
+
+    /**
+     * Upload a packed mesh into the pool of its vertex format and index type, growing the pool's
+     * buffers if needed
+     * @param packed
+     * @return
+     */
+    allocation_t upload(const mesh::packed_mesh_t &packed);
+
+    /**
+     * Return an allocation's vertex and index ranges to its pool's free lists
+     * @param allocation
+     */
+    void free(const allocation_t &allocation);
+} // namespace geometry_pool
+
+#endif // COMP3421_GEOMETRY_POOL_HPP
@@ -0,0 +1,72 @@
+#ifndef COMP3421_GL_STATE_HPP
+#define COMP3421_GL_STATE_HPP
+
+#include <glad/glad.h>
+
+// Shadow copy of the OpenGL state the app touches while drawing. Every setter compares against
+// the last value it issued and skips the GL call if nothing would change, so all code that binds
+// programs, VAOs or textures, or toggles raster state, must go through here to keep the copy valid
+namespace gl_state {
+    struct stats_t {
+        unsigned long issued = 0; // calls forwarded to OpenGL
+        unsigned long skipped = 0; // calls dropped because the value was already current
+    };
+
+    void use_program(GLuint program);
+
+    void bind_vertex_array(GLuint vao);
+
+    /**
+     * Select the active texture unit
+     * @param unit - unit index, i.e. 0 for GL_TEXTURE0
+     */
+    void active_texture(GLuint unit);
+
+    /**
+     * Bind a texture to the currently active unit
+     * @param target - GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+     * @param texture
+     */
+    void bind_texture(GLenum target, GLuint texture);
+
+    /**
+     * Bind a texture to the given unit, only switching the active unit if the binding changes
+     * @param unit - unit index, i.e. 0 for GL_TEXTURE0
+     * @param target - GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+     * @param texture
+     */
+    void bind_texture_unit(GLuint unit, GLenum target, GLuint texture);
+
+    void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+    void enable(GLenum cap);
+
+    void disable(GLenum cap);
+
+    void set_enabled(GLenum cap, bool enabled);
+
+    // the index that restarts a primitive while GL_PRIMITIVE_RESTART is enabled
+    void primitive_restart_index(GLuint index);
+
+    void polygon_offset(float factor, float units);
+
+    void polygon_mode(GLenum mode);
+
+    void blend_func(GLenum src, GLenum dst);
+
+    void depth_mask(bool write);
+
+    void front_face(GLenum mode);
+
+    /**
+     * Forget everything cached, so the next call of every setter is issued. Use after touching
+     * state with raw GL calls
+     */
+    void invalidate();
+
+    const stats_t &stats();
+
+    void reset_stats();
+} // namespace gl_state
+
+#endif // COMP3421_GL_STATE_HPP
@@ -3,18 +3,62 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include "bounds.hpp"
+#include <cstdint>
 #include <string>
 #include <vector>
 
 namespace mesh {
+	// what a mesh generated in the vertex shader is made from, see procedural.hpp
+	struct shape_t {
+		std::uint32_t kind = 0; // procedural::kind_t, 0 for a mesh read from vertex buffers
+		std::uint32_t columns = 0; // quads across the shape's grid
+		std::uint32_t rows = 0;
+		float radius = 0.0f;
+		float thickness = 0.0f;
+		float start_angle = 0.0f; // the range the shape is swept through
+		float end_angle = 0.0f;
+	};
+
+	bool operator==(shape_t const& a, shape_t const& b);
+
+	// ends one triangle strip and starts the next, stored as the all-ones index of whatever index type
+	// the mesh gets (see restart_index)
+	const GLuint RESTART_INDEX = ~0u;
+
 	// mesh_t contains only the essential data required to draw the mesh as well as to destroy it
 	struct mesh_t {
-		GLuint vao = 0;
-		GLuint vbo = 0;
-		GLuint ebo = 0;
+		GLuint vao = 0; // shared by every mesh of the same vertex format in the pool or the stream
 		GLsizei indices_count = 0;
+		// where the mesh lives in the pool's or the stream's buffers, see geometry_pool and stream_buffer
+		int pool_format = -1; // -1 if the mesh is streamed or procedural
+		GLuint first_index = 0;
+		GLint base_vertex = 0;
+		GLenum index_type = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT where the vertex count allows it
+		GLsizei vertex_count = 0;
+		GLenum primitive = GL_TRIANGLES; // or GL_TRIANGLE_STRIP
+		bool primitive_restart = false; // strips are separated by restart_index(index_type)
+		GLsizei triangle_count = 0; // drawn by one instance, strips aren't indices_count / 3
+		bounds::aabb_t aabb; // in model space
+		bounds::sphere_t sphere;
+		shape_t shape; // drawn from gl_VertexID alone if it has a kind, indices_count vertices
 	};
 
+	// a coarser version of a mesh, drawn in its place when error is too small to see
+	struct lod_t {
+		mesh_t mesh;
+		float error = 0.0f; // furthest its surface strays from the true shape's, in model space
+	};
+
+	// per-instance vertex attributes, streamed from an instance buffer (locations 4 to 11 in shader.vert)
+	struct instance_t {
+		glm::mat4 model;
+		glm::mat3 color_rotation;
+		glm::vec4 rainbow; // x: rainbow colour weight, yzw: colour offset
+	};
+
+	const GLuint INSTANCE_ATTRIB_LOCATION = 4;
+
 	// mesh_template_t contains potentially mesh attributes - to be used on initialisation only
 	struct mesh_template_t {
 	public:
@@ -23,6 +67,25 @@ namespace mesh {
 		std::vector<glm::vec2> tex_coords;
 		std::vector<glm::vec3> normals;
 		std::vector<GLuint> indices;
+		GLenum primitive = GL_TRIANGLES; // or GL_TRIANGLE_STRIP, the strips separated by RESTART_INDEX
+		// first index of each run of triangles mesh_optimizer keeps together and in place, e.g. the
+		// clusters of clusters::build. Empty if the triangles can go anywhere
+		std::vector<GLuint> groups;
+	};
+
+	// a static mesh as the geometry pool stores it: optimized, its vertices interleaved in the
+	// vertex_layout of its attributes and its indices already of index_type. The arrays aren't owned
+	struct packed_mesh_t {
+		std::uint32_t attributes = 0; // vertex_layout::attribute_bits_t
+		GLsizei vertex_count = 0;
+		const void* vertices = nullptr;
+		GLenum index_type = GL_UNSIGNED_INT;
+		GLsizei index_count = 0;
+		const void* indices = nullptr;
+		GLenum primitive = GL_TRIANGLES;
+		GLsizei triangle_count = 0;
+		bounds::aabb_t aabb;
+		bounds::sphere_t sphere;
 	};
 
 	/**
@@ -32,28 +95,114 @@ namespace mesh {
 	void destroy(mesh_t const& mesh);
 
 	/**
-	 * Register a buffer with the current OpenGL for the given mesh template
+	 * Register a buffer with the current OpenGL for the given mesh template. Static meshes are
+	 * reordered by mesh_optimizer and sub-allocated from the geometry pool, others are written into
+	 * stream_buffer, where they only last a few frames: rewrite them with dynamic_draw every frame
+	 * they're drawn, or give them to the renderer with their template in model_t::templates
 	 * @param mesh_template - bloated struct of potential mesh attribute data (to be used on
 	 * initialisation only)
+	 * @param usage
+	 * @param quantize - store a static mesh's vertices quantized, see vertex_layout and quantization_error
 	 * @return
 	 */
-	mesh_t init(mesh_template_t const& mesh_template, GLenum usage = GL_STATIC_DRAW);
+	mesh_t init(mesh_template_t const& mesh_template, GLenum usage = GL_STATIC_DRAW, bool quantize = false);
 
 	/**
-	 * Draw's the mesh statically
+	 * As above, but a static mesh is optimized in the template it is given instead of in a copy
+	 * @param mesh_template - left optimized, or untouched for other usages
+	 * @return
+	 */
+	mesh_t init(mesh_template_t&& mesh_template, GLenum usage = GL_STATIC_DRAW, bool quantize = false);
+
+	/**
+	 * Upload a mesh that has already been packed, e.g. one mapped from mesh_store, into the geometry pool
+	 * @param packed
+	 * @return
+	 */
+	mesh_t init(packed_mesh_t const& packed);
+
+	/**
+	 * Do the work of initialising a static mesh short of uploading it: bounds, optimizing (in place)
+	 * and packing
+	 * @param mesh_template
+	 * @param quantize
+	 * @return arrays in arena::scratch(), valid until the caller rewinds it past them
+	 */
+	packed_mesh_t pack(mesh_template_t&& mesh_template, bool quantize = false);
+
+	/**
+	 * Size in bytes of one index of the given type
+	 * @param index_type - GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	 * @return
+	 */
+	GLsizeiptr index_size(GLenum index_type);
+
+	/**
+	 * @param index_type - GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	 * @return the all-ones index of the type, which RESTART_INDEX is stored as
+	 */
+	GLuint restart_index(GLenum index_type);
+
+	/**
+	 * Triangles the template draws, leaving out the degenerate ones of a strip's restarts
+	 * @param mesh_template
+	 * @return
+	 */
+	GLsizei triangle_count(mesh_template_t const& mesh_template);
+
+	/**
+	 * Set GL_PRIMITIVE_RESTART and its index for drawing the mesh, through gl_state
+	 * @param mesh
+	 */
+	void set_primitive_restart(mesh_t const& mesh);
+
+	/**
+	 * Draw's the mesh statically, as its primitive
+	 * @param mesh
+	 */
+	void draw(mesh_t const& mesh);
+
+	/**
+	 * Point the instance attributes of a VAO at instance_buffer, starting from instance first
+	 * @param vao
+	 * @param instance_buffer - buffer of instance_t
+	 * @param first
+	 */
+	void bind_instances(GLuint vao, GLuint instance_buffer, GLsizei first);
+
+	/**
+	 * Draw count instances of the mesh, reading per-instance attributes from instance_buffer
 	 * @param mesh
-	 * @param draw_mode
+	 * @param instance_buffer - buffer of instance_t
+	 * @param first - index of the first instance_t in instance_buffer
+	 * @param count
+	 */
+	void draw_instanced(mesh_t const& mesh, GLuint instance_buffer, GLsizei first, GLsizei count);
+
+	/**
+	 * Draw some of the mesh's indices, as one instance, with a single glMultiDrawElementsBaseVertex
+	 * @param mesh - not procedural
+	 * @param instance_buffer - buffer of instance_t
+	 * @param instance - index of the instance_t in instance_buffer
+	 * @param first_indices - where each range starts, relative to the mesh's first index
+	 * @param index_counts
+	 * @param range_count
 	 */
-	void draw(mesh_t const& mesh, GLenum draw_mode = GL_TRIANGLES);
+	void draw_ranges(mesh_t const& mesh, GLuint instance_buffer, GLsizei instance, const GLuint* first_indices,
+	                 const GLsizei* index_counts, GLsizei range_count);
 
 	/**
-	 * Update the mesh data using mesh_template then draw
+	 * Update the mesh data using mesh_template then draw count instances of it, as draw_instanced does.
+	 * Only for meshes not made with GL_STATIC_DRAW. The data is streamed into this frame's region of
+	 * stream_buffer, so nothing waits on the GPU
 	 * @param mesh
 	 * @param mesh_template
-	 * @param draw_mode
+	 * @param instance_buffer - buffer of instance_t
+	 * @param first - index of the first instance_t in instance_buffer
+	 * @param count
 	 */
-	void
-	dynamic_draw(mesh_t& mesh, const mesh_template_t& mesh_template, GLenum draw_mode = GL_TRIANGLES);
+	void dynamic_draw(mesh_t& mesh, const mesh_template_t& mesh_template, GLuint instance_buffer, GLsizei first,
+	                  GLsizei count = 1);
 } // namespace mesh
 
 #endif
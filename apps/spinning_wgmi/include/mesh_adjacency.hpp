@@ -0,0 +1,30 @@
+#ifndef COMP3421_MESH_ADJACENCY_HPP
+#define COMP3421_MESH_ADJACENCY_HPP
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+
+#include "arena.hpp"
+
+// Which triangles of an indexed triangle list use each vertex, for the passes that walk a mesh from
+// vertex to triangle (mesh_optimizer, simplifier, clusters)
+namespace mesh_adjacency {
+    // triangles around each vertex, in one flat list indexed by offsets
+    struct adjacency_t {
+        arena::vector<std::uint32_t> offsets; // vertex_count + 1 of them
+        arena::vector<std::uint32_t> triangles;
+    };
+
+    /**
+     * Gather the triangles around each vertex, in increasing order
+     * @param scratch - holds the adjacency, and the working memory left behind building it
+     * @param indices - a list of triangles
+     * @param index_count
+     * @param vertex_count - more than any index
+     * @return
+     */
+    adjacency_t build(arena::arena_t &scratch, const GLuint *indices, size_t index_count, size_t vertex_count);
+} // namespace mesh_adjacency
+
+#endif // COMP3421_MESH_ADJACENCY_HPP
@@ -0,0 +1,71 @@
+#ifndef COMP3421_MESH_BUILDER_HPP
+#define COMP3421_MESH_BUILDER_HPP
+
+#include <cstdint>
+
+#include "mesh.hpp"
+
+// Composes a mesh_template_t from parts without intermediate templates: the caller works out how
+// many vertices and indices the whole will have, the arrays are sized once, and each part is
+// written straight into them with its indices offset by the vertices already there. Quads are
+// indexed as a triangle list, or as one triangle strip per row ended by a restart index
+namespace mesh_builder {
+    struct counts_t {
+        size_t vertices;
+        size_t indices;
+    };
+
+    inline counts_t operator+(counts_t a, counts_t b) { return {a.vertices + b.vertices, a.indices + b.indices}; }
+
+    inline counts_t operator*(size_t k, counts_t a) { return {k * a.vertices, k * a.indices}; }
+
+    struct builder_t {
+        mesh::mesh_template_t mesh;
+        size_t vertex = 0; // where the next vertex goes
+        size_t index = 0; // where the next index goes
+    };
+
+    /**
+     * @param count
+     * @param primitive - GL_TRIANGLES or GL_TRIANGLE_STRIP
+     * @return the indices add_quads writes for a row of count quads
+     */
+    inline size_t quad_indices(size_t count, GLenum primitive) {
+        return primitive == GL_TRIANGLE_STRIP ? 2 * count + 3 : 6 * count;
+    }
+
+    /**
+     * @param counts the vertices and indices of the finished template
+     * @param attributes vertex_layout::attribute_bits_t of the attributes it has besides positions
+     * @param primitive - how add_quads indexes quads, GL_TRIANGLES or GL_TRIANGLE_STRIP
+     * @return
+     */
+    builder_t make_builder(counts_t counts, std::uint32_t attributes, GLenum primitive = GL_TRIANGLES);
+
+    /**
+     * Add count quads between the rows of vertices starting at first and second, each as two
+     * triangles, or as one strip followed by mesh::RESTART_INDEX. A strip splits its quads along the
+     * other diagonal, facing the same way. The indices are absolute
+     * @param builder
+     * @param first
+     * @param second
+     * @param count
+     */
+    void add_quads(builder_t &builder, size_t first, size_t second, size_t count);
+
+    /**
+     * Copy an indexed template in after what has been written so far. It must have the same
+     * attributes and primitive as the builder
+     * @param builder
+     * @param part
+     */
+    void append(builder_t &builder, const mesh::mesh_template_t &part);
+
+    /**
+     * @param builder
+     * @return the template, which must have been filled exactly
+     */
+    mesh::mesh_template_t finish(builder_t &builder);
+} // namespace mesh_builder
+
+#endif // COMP3421_MESH_BUILDER_HPP
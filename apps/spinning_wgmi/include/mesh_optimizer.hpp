@@ -0,0 +1,45 @@
+#ifndef COMP3421_MESH_OPTIMIZER_HPP
+#define COMP3421_MESH_OPTIMIZER_HPP
+
+#include <ostream>
+
+#include "mesh.hpp"
+
+// Reorders indexed triangle lists for the GPU: triangles for post-transform vertex cache reuse
+// (Tipsify, Sander et al. 2007) and then in clusters roughly front to back from any view to cut
+// overdraw, vertices in the order they are first fetched. Triangles split into groups are only
+// reordered within their group, and triangle strips keep their order and only have their vertices
+// renumbered. The mesh itself is unchanged
+namespace mesh_optimizer {
+    // size of the FIFO cache Tipsify optimizes for and analyze simulates
+    const unsigned CACHE_SIZE = 16;
+
+    struct stats_t {
+        float acmr = 0.0f; // average cache miss ratio, vertex shader runs per triangle (0.5 at best)
+        float atvr = 0.0f; // average transformed vertex ratio, vertex shader runs per vertex (1 at best)
+    };
+
+    /**
+     * Simulate a FIFO vertex cache over the template's triangles
+     * @param mesh_template
+     * @param cache_size
+     * @return
+     */
+    stats_t analyze(const mesh::mesh_template_t &mesh_template, unsigned cache_size = CACHE_SIZE);
+
+    /**
+     * Reorder the template's triangles and vertices in place, or only the vertices of triangle strips.
+     * Templates without indices, or whose indices aren't a list of triangles or strips, are left alone.
+     * Vertices no triangle uses are dropped
+     * @param mesh_template
+     */
+    void optimize(mesh::mesh_template_t &mesh_template);
+
+    /**
+     * Print the cache statistics of each built-in shape before and after optimizing it
+     * @param out
+     */
+    void report(std::ostream &out);
+} // namespace mesh_optimizer
+
+#endif // COMP3421_MESH_OPTIMIZER_HPP
@@ -0,0 +1,89 @@
+#ifndef COMP3421_MESH_STORE_HPP
+#define COMP3421_MESH_STORE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "mesh.hpp"
+
+// Static meshes kept on disk between launches, so a warm start skips generating or parsing them.
+// Each key has a file of its own in DIRECTORY:
+//   header     magic, VERSION, key, file size, mesh count, where the extra bytes are
+//   records    per mesh: vertex_layout attributes, index type, counts, primitive, blob offsets, bounds, tag
+//   blobs      each mesh's vertices then indices, exactly as the geometry pool stores them, every
+//              blob starting on a BLOB_ALIGNMENT boundary
+// Files are mapped into memory and their blobs handed straight to the pool's buffer uploads, there's
+// no parsing or per-vertex work. A file whose header doesn't check out is rebuilt. Keys should cover
+// everything the meshes are made from (a source file's hash, a generator's parameters), VERSION
+// covers the format and the code that builds meshes: bump it when either changes
+namespace mesh_store {
+    const std::uint32_t VERSION = 7;
+    const char *const DIRECTORY = "mesh_cache";
+    const std::uint64_t BLOB_ALIGNMENT = 64;
+
+    // what a build function gives the store
+    struct source_t {
+        std::vector<mesh::mesh_template_t> templates;
+        std::vector<std::int32_t> tags; // one per template or none, the caller's own numbers
+        std::string extra; // anything else to keep with the meshes
+        bool quantize = false; // store the meshes in vertex_layout's QUANTIZED layout
+    };
+
+    // what the store gives back, the same for a fresh build and a stored file
+    struct stored_t {
+        std::vector<mesh::mesh_t> meshes;
+        std::vector<std::int32_t> tags; // one per mesh, 0 if none were given
+        std::string extra;
+    };
+
+    struct stats_t {
+        int mapped = 0; // files loaded from the store
+        int built = 0; // files built and written
+        double mapped_ms = 0.0;
+        double built_ms = 0.0;
+    };
+
+    /**
+     * 64-bit FNV-1a, the same on every run so it can name files
+     * @param data
+     * @param size
+     * @param hash - hash of whatever came before, to hash several pieces as one
+     * @return
+     */
+    std::uint64_t hash(const void *data, size_t size, std::uint64_t hash = 14695981039346656037ull);
+
+    /**
+     * @param path
+     * @param hash - as above
+     * @return the hash of the file's contents, or of nothing if it can't be read
+     */
+    std::uint64_t hash_file(const std::string &path, std::uint64_t hash = 14695981039346656037ull);
+
+    /**
+     * The static meshes stored under key, uploaded to the geometry pool. If there's no usable file for
+     * the key, build is called and what it makes is uploaded and written for next time
+     * @param key
+     * @param build
+     * @return
+     */
+    stored_t load(std::uint64_t key, const std::function<source_t()> &build);
+
+    /**
+     * As above, for a key holding one mesh
+     * @param key
+     * @param build
+     * @param quantize
+     * @return
+     */
+    mesh::mesh_t load(std::uint64_t key, const std::function<mesh::mesh_template_t()> &build, bool quantize = false);
+
+    // delete every stored file, so the next launch starts cold
+    void clear();
+
+    // counts and time spent in load since the start
+    const stats_t &stats();
+} // namespace mesh_store
+
+#endif // COMP3421_MESH_STORE_HPP
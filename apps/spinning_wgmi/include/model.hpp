@@ -6,6 +6,8 @@
 #include <glm/ext.hpp>
 #include <vector>
 #include "mesh.hpp"
+#include "bounds.hpp"
+#include "clusters.hpp"
 
 namespace model {
     struct material_t {
@@ -23,15 +25,45 @@ namespace model {
         float phong_exp = 5.0f;
         float cube_map_factor = 1.0f;
         float reflection_map_factor = 1.0f;
+        int ubo_slot = -1; // slot in the renderer's material buffer, see renderer::upload_materials
     };
 
     struct model_t {
         std::vector<mesh::mesh_t> meshes;
         std::vector<material_t> materials;
+        // per mesh, none or its coarser levels of detail, finest first. Either empty or one per mesh
+        std::vector<std::vector<mesh::lod_t>> lods;
+        // per mesh, the clusters of its finest level, none for small meshes. Either empty or one per mesh
+        std::vector<clusters::clusters_t> clusters;
+        // per mesh, the template a mesh made without GL_STATIC_DRAW is rewritten from every frame it's drawn
+        // (see mesh::dynamic_draw), null for static meshes. Not owned. Either empty or one per mesh
+        std::vector<const mesh::mesh_template_t *> templates;
+        bounds::aabb_t aabb; // union of the meshes' boxes, see update_bounds
     };
 
+    /**
+     * Load an OBJ, one mesh per shape, each with levels of detail decimated by simplifier and, if it's big
+     * enough, split into clusters the renderer culls. Everything is built the first time the file is
+     * loaded and mapped from mesh_store after that
+     * @param path
+     * @return
+     */
     model_t load(const std::string &path);
 
+    /**
+     * Parse an OBJ into one template per shape, as load does before uploading them, without touching
+     * GL or mesh_store. Shapes the file gives no normals get angle weighted vertex normals
+     * @param path
+     * @return
+     */
+    std::vector<mesh::mesh_template_t> load_templates(const std::string &path);
+
+    /**
+     * Recompute the model's box from its meshes, needed after adding meshes by hand
+     * @param model
+     */
+    void update_bounds(model_t &model);
+
     void destroy(const model_t &model);
 } // namespace model
 
@@ -0,0 +1,173 @@
+#ifndef COMP3421_PARALLEL_HPP
+#define COMP3421_PARALLEL_HPP
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Loops split four ways across SSE lanes, with a scalar stand-in where there's no SSE, and across
+// threads, for the passes over whole meshes (shapes, clusters)
+namespace parallel {
+#if defined(__SSE2__) || defined(_M_X64)
+    struct float4_t {
+        __m128 v;
+    };
+
+    inline float4_t splat(float f) { return {_mm_set1_ps(f)}; }
+
+    inline float4_t load4(const float *p) { return {_mm_loadu_ps(p)}; }
+
+    // first, first + 1, first + 2, first + 3
+    inline float4_t lane_indices(size_t first) {
+        return {_mm_add_ps(_mm_set1_ps((float) first), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f))};
+    }
+
+    inline float4_t operator+(float4_t a, float4_t b) { return {_mm_add_ps(a.v, b.v)}; }
+
+    inline float4_t operator-(float4_t a, float4_t b) { return {_mm_sub_ps(a.v, b.v)}; }
+
+    inline float4_t operator*(float4_t a, float4_t b) { return {_mm_mul_ps(a.v, b.v)}; }
+
+    inline float4_t operator/(float4_t a, float4_t b) { return {_mm_div_ps(a.v, b.v)}; }
+
+    inline float4_t sqrt4(float4_t a) { return {_mm_sqrt_ps(a.v)}; }
+
+    inline float4_t max4(float4_t a, float4_t b) { return {_mm_max_ps(a.v, b.v)}; }
+
+    // bit k set where lane k of a is less than that of b
+    inline int less4(float4_t a, float4_t b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)); }
+
+    // write the first count of four vertices, transposed from x0x1x2x3 y0.. z0.. to x0y0z0 x1y1z1 ..
+    inline void store(glm::vec3 *out, size_t count, float4_t x, float4_t y, float4_t z) {
+        auto xy = _mm_unpacklo_ps(x.v, y.v); // x0 y0 x1 y1
+        auto xy_hi = _mm_unpackhi_ps(x.v, y.v); // x2 y2 x3 y3
+        auto zx = _mm_unpacklo_ps(z.v, x.v); // z0 x0 z1 x1
+        auto yz = _mm_unpacklo_ps(y.v, z.v); // y0 z0 y1 z1
+        auto zx_hi = _mm_unpackhi_ps(z.v, x.v); // z2 x2 z3 x3
+        auto yz_hi = _mm_unpackhi_ps(y.v, z.v); // y2 z2 y3 z3
+        __m128 packed[3] = {
+                _mm_shuffle_ps(xy, zx, _MM_SHUFFLE(3, 0, 1, 0)), // x0 y0 z0 x1
+                _mm_shuffle_ps(yz, xy_hi, _MM_SHUFFLE(1, 0, 3, 2)), // y1 z1 x2 y2
+                _mm_shuffle_ps(zx_hi, yz_hi, _MM_SHUFFLE(3, 2, 3, 0)), // z2 x3 y3 z3
+        };
+        auto *floats = reinterpret_cast<float *>(out);
+        if (count == 4) {
+            _mm_storeu_ps(floats, packed[0]);
+            _mm_storeu_ps(floats + 4, packed[1]);
+            _mm_storeu_ps(floats + 8, packed[2]);
+        } else {
+            std::memcpy(floats, packed, count * sizeof(glm::vec3));
+        }
+    }
+
+    inline void store(glm::vec2 *out, size_t count, float4_t x, float4_t y) {
+        __m128 packed[2] = {_mm_unpacklo_ps(x.v, y.v), _mm_unpackhi_ps(x.v, y.v)};
+        auto *floats = reinterpret_cast<float *>(out);
+        if (count == 4) {
+            _mm_storeu_ps(floats, packed[0]);
+            _mm_storeu_ps(floats + 4, packed[1]);
+        } else {
+            std::memcpy(floats, packed, count * sizeof(glm::vec2));
+        }
+    }
+
+    // read the first count of four vertices, the inverse of store
+    inline void load(const glm::vec3 *in, size_t count, float4_t &x, float4_t &y, float4_t &z) {
+        __m128 packed[3] = {};
+        std::memcpy(packed, in, count * sizeof(glm::vec3));
+        auto a = packed[0], b = packed[1], c = packed[2];
+        x.v = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+        y.v = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+                             _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        z.v = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+                             _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+    }
+#else
+    struct float4_t {
+        float v[4];
+    };
+
+    template<typename Op>
+    inline float4_t lanewise(float4_t a, float4_t b, Op op) {
+        auto out = float4_t{};
+        for (int k = 0; k < 4; ++k) out.v[k] = op(a.v[k], b.v[k]);
+        return out;
+    }
+
+    inline float4_t splat(float f) { return {{f, f, f, f}}; }
+
+    inline float4_t load4(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+
+    inline float4_t lane_indices(size_t first) {
+        return {{(float) first, (float) (first + 1), (float) (first + 2), (float) (first + 3)}};
+    }
+
+    inline float4_t operator+(float4_t a, float4_t b) { return lanewise(a, b, [](float l, float r) { return l + r; }); }
+
+    inline float4_t operator-(float4_t a, float4_t b) { return lanewise(a, b, [](float l, float r) { return l - r; }); }
+
+    inline float4_t operator*(float4_t a, float4_t b) { return lanewise(a, b, [](float l, float r) { return l * r; }); }
+
+    inline float4_t operator/(float4_t a, float4_t b) { return lanewise(a, b, [](float l, float r) { return l / r; }); }
+
+    inline float4_t sqrt4(float4_t a) { return lanewise(a, a, [](float l, float) { return std::sqrt(l); }); }
+
+    inline float4_t max4(float4_t a, float4_t b) { return lanewise(a, b, [](float l, float r) { return std::max(l, r); }); }
+
+    inline int less4(float4_t a, float4_t b) {
+        auto mask = 0;
+        for (int k = 0; k < 4; ++k) mask |= (a.v[k] < b.v[k]) << k;
+        return mask;
+    }
+
+    inline void store(glm::vec3 *out, size_t count, float4_t x, float4_t y, float4_t z) {
+        for (auto k = size_t{0}; k < count; ++k) out[k] = {x.v[k], y.v[k], z.v[k]};
+    }
+
+    inline void store(glm::vec2 *out, size_t count, float4_t x, float4_t y) {
+        for (auto k = size_t{0}; k < count; ++k) out[k] = {x.v[k], y.v[k]};
+    }
+
+    inline void load(const glm::vec3 *in, size_t count, float4_t &x, float4_t &y, float4_t &z) {
+        x = y = z = splat(0.0f);
+        for (auto k = size_t{0}; k < count; ++k) {
+            x.v[k] = in[k].x;
+            y.v[k] = in[k].y;
+            z.v[k] = in[k].z;
+        }
+    }
+#endif
+
+    // how many threads to split count items between, no more than max_threads (0 for no limit)
+    inline size_t parts_for(size_t count, size_t min_per_part, unsigned int max_threads) {
+        auto threads = std::max(std::thread::hardware_concurrency(), 1u);
+        if (max_threads) threads = std::min(threads, max_threads);
+        return std::max(size_t{1}, std::min((size_t) threads, count / min_per_part));
+    }
+
+    // work(part, begin, end) for each of parts contiguous runs of count items, the first on the
+    // calling thread and the rest on threads of their own
+    template<typename Work>
+    void for_each_part(size_t count, size_t parts, Work &&work) {
+        auto workers = std::vector<std::thread>{};
+        for (auto part = size_t{1}; part < parts; ++part) {
+            workers.emplace_back([&work, count, parts, part] {
+                work(part, count * part / parts, count * (part + 1) / parts);
+            });
+        }
+        work(size_t{0}, size_t{0}, count / parts);
+        for (auto &worker: workers) {
+            worker.join();
+        }
+    }
+} // namespace parallel
+
+#endif // COMP3421_PARALLEL_HPP
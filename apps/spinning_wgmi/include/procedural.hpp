@@ -0,0 +1,39 @@
+#ifndef COMP3421_PROCEDURAL_HPP
+#define COMP3421_PROCEDURAL_HPP
+
+#include <glm/ext.hpp>
+
+#include "mesh.hpp"
+
+// Spheres, tori and rings drawn without vertex data. The PROCEDURAL variant of shader.vert rebuilds
+// every vertex from gl_VertexID and the mesh's shape_t, the same vertex the shapes:: generator of the
+// same name would have made, so the mesh is a non-indexed draw of six vertices a quad from an empty
+// vertex array and takes no memory beyond its mesh_t. Its tessellation can be changed between frames
+// for nothing. Use these instead of mesh::init or geometry_cache for the models of nodes that
+// should be drawn this way. The shape is swept from start_angle to end_angle: about y for a sphere,
+// round the ring for a torus and about z for a ring
+namespace procedural {
+    enum kind_t : std::uint32_t {
+        SPHERE = 1,
+        TORUS = 2,
+        RING = 3,
+    };
+
+    mesh::mesh_t sphere(float radius, unsigned int tessellation = 64, float start_angle = 0.0f,
+                        float end_angle = glm::two_pi<float>());
+
+    mesh::mesh_t torus(float radius, float thickness, unsigned int tessellation = 64, float start_angle = 0.0f,
+                       float end_angle = glm::two_pi<float>());
+
+    mesh::mesh_t ring(float radius, float thickness, unsigned int tessellation = 64, float start_angle = 0.0f,
+                      float end_angle = glm::two_pi<float>());
+
+    /**
+     * Remake a procedural mesh at another tessellation, as its generator would have. Nothing is uploaded
+     * @param mesh
+     * @param tessellation
+     */
+    void set_tessellation(mesh::mesh_t &mesh, unsigned int tessellation);
+} // namespace procedural
+
+#endif // COMP3421_PROCEDURAL_HPP
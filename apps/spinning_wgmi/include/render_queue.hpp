@@ -0,0 +1,97 @@
+#ifndef COMP3421_RENDER_QUEUE_HPP
+#define COMP3421_RENDER_QUEUE_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.hpp"
+#include "model.hpp"
+
+namespace render_queue {
+    // programs a sort key tells apart, more and items of different programs would sort together
+    const unsigned PROGRAM_BITS = 10;
+
+    enum item_flags_t : std::uint32_t {
+        CLIPPING = 1u << 0,
+        TRANSLUCENT = 1u << 1,
+        WATER = 1u << 2,
+        WATER_SURFACE = 1u << 3,
+        LINE_MESH = 1u << 4,
+    };
+
+    // everything needed to draw one mesh, flattened out of the scene graph
+    struct item_t {
+        mesh::instance_t instance;
+        const mesh::mesh_t *mesh = nullptr;
+        const model::material_t *material = nullptr;
+        glm::vec2 polygon_offset = glm::vec2(0);
+        float depth = 0.0f; // view space distance, only used for sorting
+        std::uint32_t program = 0; // index of the program the item is drawn with
+        std::uint32_t flags = 0;
+        // the index ranges of the clusters left after culling, in the renderer's clusters::ranges_t.
+        // No ranges for meshes drawn whole
+        std::uint32_t first_range = 0;
+        std::uint32_t range_count = 0;
+        const mesh::mesh_template_t *stream = nullptr; // rewritten into stream_buffer as the item is drawn
+    };
+
+    struct entry_t {
+        std::uint64_t key;
+        std::uint32_t item;
+    };
+
+    // items are pushed in traversal order, entries are the draw order once sorted
+    struct queue_t {
+        std::vector<item_t> items;
+        std::vector<entry_t> entries;
+    };
+
+    /**
+     * Build a sort key. Opaque items sort before translucent ones; opaque items are grouped by
+     * program, material, texture and mesh and roughly front to back within a group, translucent
+     * items are sorted back to front
+     * @param item
+     * @param depth - the item's depth normalised to [0, 1]
+     * @return
+     */
+    std::uint64_t make_key(const item_t &item, float depth);
+
+    /**
+     * Empty the queue, keeping its storage for the next frame
+     * @param queue
+     */
+    void clear(queue_t &queue);
+
+    void push(queue_t &queue, const item_t &item);
+
+    /**
+     * Key every item, with depths normalised by the farthest item, and sort the entries into draw order
+     * @param queue
+     */
+    void sort(queue_t &queue);
+
+    /**
+     * Whether two items can be drawn by one instanced draw, i.e. they only differ in their instance
+     * attributes
+     * @param a
+     * @param b
+     * @return
+     */
+    bool same_batch(const item_t &a, const item_t &b);
+
+    /**
+     * Whether two items can be drawn without changing any GL state in between, i.e. they share a
+     * vertex array, primitive, program, material and flags but may draw different meshes. Procedural meshes set
+     * their shape as uniforms, so only the same shape shares state, and items drawn as the ranges of
+     * their visible clusters have a draw of their own, so share with nothing. Streamed meshes only
+     * share with their own instances
+     * @param a
+     * @param b
+     * @return
+     */
+    bool same_state(const item_t &a, const item_t &b);
+} // namespace render_queue
+
+#endif // COMP3421_RENDER_QUEUE_HPP
@@ -4,16 +4,125 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
 
 #include "scene.hpp"
 #include "euler_camera.hpp"
+#include "gl_state.hpp"
+#include "render_queue.hpp"
+#include "clusters.hpp"
 
 namespace renderer {
+    // a level of detail is drawn while its error covers less than this many pixels on screen, and only
+    // swapped for a coarser one once that one's error is LOD_HYSTERESIS below it, so levels don't flicker
+    const float MAX_LOD_ERROR_PIXELS = 0.5f;
+    const float LOD_HYSTERESIS = 0.25f;
+
+    // every uniform the renderer sets, used to index a program's location table
+    enum uniform_t {
+        U_VIEW_PROJ,
+
+        U_DIFFUSE_MAP,
+        U_SPECULAR_MAP,
+        U_CUBE_MAP,
+        U_NORMAL_MAP,
+        U_HEIGHT_MAP,
+        U_AMBIENT_MAP,
+        U_ROUGHNESS_MAP,
+        U_REFLECTION_MAP,
+
+        U_SHAPE,
+        U_SHAPE_GRID,
+
+        UNIFORM_COUNT
+    };
+
+    // uniform block binding points shared by every program
+    enum block_binding_t {
+        FRAME_BLOCK_BINDING = 0,
+        MATERIAL_BLOCK_BINDING = 1,
+    };
+
+    // what a variant of the main program is compiled with, each bit #defines the name of its enumerator
+    enum feature_t : std::uint32_t {
+        HAS_DIFFUSE_MAP = 1u << 0,
+        HAS_SPECULAR_MAP = 1u << 1,
+        HAS_CUBE_MAP = 1u << 2,
+        HAS_NORMAL_MAP = 1u << 3,
+        HAS_HEIGHT_MAP = 1u << 4,
+        HAS_AMBIENT_MAP = 1u << 5,
+        HAS_ROUGHNESS_MAP = 1u << 6,
+        HAS_REFLECTION_MAP = 1u << 7,
+        IS_WATER = 1u << 8,
+        IS_WATER_SURFACE = 1u << 9,
+        RAINBOW = 1u << 10,
+        PROCEDURAL = 1u << 11,
+        QUANTIZED = 1u << 12,
+
+        FEATURE_COUNT = 13
+    };
+
+    // a linked program together with the locations of its active uniforms (-1 if inactive)
+    struct program_t {
+        GLuint handle = 0;
+        std::array<GLint, UNIFORM_COUNT> uniforms{};
+    };
+
+    // glMultiDrawElementsIndirect (GL 4.3), which the bundled 3.3 glad doesn't load
+    using multi_draw_elements_indirect_t = void (APIENTRYP)(GLenum mode, GLenum type, const void *indirect,
+                                                           GLsizei draw_count, GLsizei stride);
+
+    // layout fixed by GL, see DrawElementsIndirectCommand
+    struct draw_command_t {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint base_vertex;
+        GLuint base_instance;
+    };
+
+    // a run of sorted queue entries drawing the same mesh, i.e. one instanced draw
+    struct batch_t {
+        GLsizei first; // first entry, and so first instance
+        GLsizei count;
+    };
+
+    struct stats_t {
+        double cpu_ms = 0.0; // CPU time spent submitting the last frame
+        gl_state::stats_t state_calls; // state changes issued/skipped during the last frame
+        unsigned long draw_items = 0; // meshes submitted during the last frame
+        unsigned long batches = 0; // instanced draws those meshes were batched into
+        unsigned long draw_calls = 0; // GL draw calls issued for those batches
+        unsigned long triangles = 0; // drawn during the last frame, every instance counted
+        unsigned long nodes_visible = 0; // nodes at least partly inside the view frustum
+        unsigned long nodes_culled = 0; // subtrees rejected without visiting their children
+        unsigned long clusters_visible = 0; // clusters of clustered meshes drawn, see clusters::cull
+        // outside the frustum or facing away. Only filled, opaque, unclipped items are tested for facing away,
+        // so in the default wireframe scene these are frustum rejections alone (see --model in main.cpp)
+        unsigned long clusters_culled = 0;
+    };
+
     struct renderer_t {
         glm::mat4 projection;
+        float viewport_height = 720.0f; // in pixels, for how big things look on screen
 
-        GLuint program;
-        GLuint skybox_program;
+        // level of detail each node was last drawn at, by node handle
+        std::vector<std::uint8_t> lod_levels;
+
+        // shader.vert/shader.frag specialised per feature set, compiled the first time a set is drawn
+        std::vector<program_t> variants;
+        std::unordered_map<std::uint32_t, std::uint32_t> variant_of; // features -> index into variants
+        program_t skybox_program;
+
+        // per-frame uniform block (camera, time, lights), rewritten once per frame
+        GLuint frame_ubo = 0;
+
+        // every registered material's block, packed at material_stride bytes apart
+        GLuint material_ubo = 0;
+        GLsizeiptr material_stride = 0;
 
         // directional light attributes
         glm::vec3 sun_light_dir = glm::normalize(glm::vec3(0) - glm::vec3(-25, 20, -25));
@@ -28,13 +137,68 @@ namespace renderer {
         glm::vec3 spot_light_specular = glm::vec3(0.5f);
 
         glm::vec4 clip_plane = glm::vec4(0, 1, 0, -1.0);
+
+        GLenum polygon_mode = GL_LINE; // the default for nodes that don't ask for a line mesh
+
+        // rebuilt every frame, kept here so its storage is reused
+        render_queue::queue_t queue;
+
+        // per-instance attributes of every draw item in draw order, streamed once per frame
+        std::vector<mesh::instance_t> instances;
+        GLuint instance_vbo = 0;
+
+        // batches sharing all state are submitted with one multi-draw where the context supports it
+        multi_draw_elements_indirect_t multi_draw_indirect = nullptr;
+        GLuint indirect_buffer = 0;
+        std::vector<batch_t> batches;
+        std::vector<draw_command_t> commands; // one per batch
+
+        // index ranges of the visible clusters of every clustered draw item, see render_queue::item_t
+        clusters::ranges_t cluster_ranges;
+
+        stats_t stats;
     };
 
     renderer_t init(const glm::mat4 &projection);
 
-    void render(const renderer_t &renderer,
+    /**
+     * Compile a program, with each define in the list injected after the sources' #version line
+     * @param vs_path
+     * @param fs_path
+     * @param defines
+     * @return
+     */
+    GLuint load_program(const std::string &vs_path, const std::string &fs_path,
+                        const std::vector<std::string> &defines = {});
+
+    /**
+     * Index of the main program variant with the given features, compiling it on first use
+     * @param renderer
+     * @param features - bitwise or of feature_t
+     * @return
+     */
+    std::uint32_t get_variant(renderer_t &renderer, std::uint32_t features);
+
+    /**
+     * Pack every material in the scene into the renderer's material uniform buffer and record each
+     * material's slot. Materials with identical parameters share a slot so their meshes can be
+     * instanced together. Must be called once the scene is built, and again if material parameters
+     * change (swapping one texture for another does not need a re-upload)
+     * @param renderer
+     * @param scene
+     */
+    void upload_materials(renderer_t &renderer, scene::scene_t &scene);
+
+    /**
+     * Draw the scene with the transforms and bounds cached in it, so scene::update must have run
+     * since the scene last changed
+     * @param renderer
+     * @param camera
+     * @param scene
+     */
+    void render(renderer_t &renderer,
                 const euler_camera::camera_t &camera,
-                const scene::node_t &scene);
+                const scene::scene_t &scene);
 } // namespace renderer
 
 #endif // COMP3421_RENDERER_HPP
@@ -2,34 +2,147 @@
 #define COMP3421_SCENE_HPP
 
 #include "model.hpp"
+#include "bounds.hpp"
 #include "euler_camera.hpp"
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
 #include <vector>
 
 namespace scene {
-    struct node_t {
-        enum KIND {
-            EMPTY, STATIC_MESH, REFLECTIVE, WATER_SURFACE, WATER,
-        } kind = EMPTY;
-        model::model_t model;
-        glm::vec3 translation = glm::vec3(0.0);
-        glm::vec3 rotation = glm::vec3(0.0); // vec3 of euler angles
-        glm::vec3 scale = glm::vec3(1.0);
-        std::vector<node_t> children;
-        glm::vec2 polygon_offset = glm::vec2(0.0);
-        bool visible = true;
-        bool clipping = false;
+    // stable name of a node, unlike its index which moves when update puts nodes back in pre-order
+    using node_handle_t = std::uint32_t;
+    using model_handle_t = std::uint32_t;
+
+    const node_handle_t NO_NODE = ~0u;
+    const model_handle_t NO_MODEL = ~0u;
+
+    enum kind_t : std::uint8_t {
+        EMPTY, STATIC_MESH, REFLECTIVE, WATER_SURFACE, WATER,
+    };
+
+    enum node_flags_t : std::uint8_t {
+        VISIBLE = 1u << 0,
+        CLIPPING = 1u << 1,
+        RAINBOW_COLORS = 1u << 2,
+        SHOW_LINE_MESH = 1u << 3,
+    };
+
+    // Every node lives in parallel arrays indexed by position. After update nodes are in pre-order: a
+    // node's descendants directly follow it and end at subtree_end, so a linear pass visits parents
+    // before children and a subtree can be skipped by jumping to its end. New nodes are appended, which
+    // keeps pre-order unless their parent's subtree wasn't last, and then update restores it in one
+    // pass. Read freely, but change nodes through the functions below so the caches stay valid
+    struct scene_t {
+        std::vector<std::uint32_t> parent; // index of the parent, or NO_NODE
+        std::vector<std::uint32_t> subtree_end; // one past the node's last descendant
+        std::vector<node_handle_t> handle;
+        std::vector<model_handle_t> model;
+        std::vector<kind_t> kind;
+        std::vector<std::uint8_t> flags;
+
+        std::vector<glm::vec3> translation;
+        std::vector<glm::quat> rotation;
+        std::vector<glm::vec3> scale;
+        std::vector<glm::vec2> polygon_offset;
 
         // for rainbow color
-        bool rainbow_colors = false;
-        glm::vec3 color_rotation = glm::vec3(0.0); // vec3 of euler angles
-        float color_offset = 0.0f;
+        std::vector<glm::quat> color_rotation;
+        std::vector<float> color_offset;
+
+        // cached by update
+        std::vector<glm::mat4> local; // relative to the parent
+        std::vector<glm::mat4> world;
+        std::vector<glm::mat3> color_matrix;
+        std::vector<glm::vec2> world_polygon_offset; // summed down from the root
+        std::vector<bounds::aabb_t> bounds; // world space box around the node's model and subtree
+        std::vector<std::uint8_t> dirty;
 
-        bool show_line_mesh = false;
+        std::vector<std::uint32_t> index_of; // handle -> index
+        bool in_pre_order = true; // false once a node is appended away from its parent's subtree
+        std::vector<model::model_t> models; // shared by every node that refers to them
     };
 
-    node_t make_wgmi_head(float radius, float thickness);
+    /**
+     * Take ownership of a model so nodes can refer to it
+     * @param scene
+     * @param model
+     * @return
+     */
+    model_handle_t add_model(scene_t &scene, model::model_t model);
+
+    /**
+     * Add a node as the last child of parent, or as a new root
+     * @param scene
+     * @param parent - handle of the parent, NO_NODE for a root
+     * @param model - NO_MODEL for a node that only groups its children
+     * @return
+     */
+    node_handle_t add_node(scene_t &scene, node_handle_t parent, model_handle_t model = NO_MODEL);
+
+    /**
+     * Copy a node and its subtree under a new parent. Models are shared, not copied
+     * @param scene
+     * @param node
+     * @param parent
+     * @return handle of the copy
+     */
+    node_handle_t copy_subtree(scene_t &scene, node_handle_t node, node_handle_t parent);
+
+    std::uint32_t index(const scene_t &scene, node_handle_t node);
+
+    model::model_t &get_model(scene_t &scene, node_handle_t node);
+
+    /**
+     * Rotation from euler angles, applied x first, then y, then z
+     * @param angles
+     * @return
+     */
+    glm::quat from_euler(const glm::vec3 &angles);
+
+    void set_translation(scene_t &scene, node_handle_t node, const glm::vec3 &translation);
+
+    void set_rotation(scene_t &scene, node_handle_t node, const glm::quat &rotation);
+
+    void set_scale(scene_t &scene, node_handle_t node, const glm::vec3 &scale);
+
+    void set_polygon_offset(scene_t &scene, node_handle_t node, const glm::vec2 &offset);
+
+    void set_color_rotation(scene_t &scene, node_handle_t node, const glm::quat &rotation);
+
+    void set_color_offset(scene_t &scene, node_handle_t node, float offset);
+
+    void set_kind(scene_t &scene, node_handle_t node, kind_t kind);
+
+    void set_flag(scene_t &scene, node_handle_t node, node_flags_t flag, bool value);
+
+    /**
+     * Flag the node for update, e.g. after changing its model's meshes
+     * @param scene
+     * @param node
+     */
+    void mark_dirty(scene_t &scene, node_handle_t node);
+
+    /**
+     * Put nodes back in pre-order if any were appended out of it, then recompute the cached matrices of
+     * dirty nodes and their descendants, and the bounds of every node whose subtree moved. Clean
+     * subtrees are only walked, nothing is recomputed for them
+     * @param scene
+     */
+    void update(scene_t &scene);
+
+    /**
+     * Build the spinning head's rings under parent
+     * @param scene
+     * @param parent
+     * @param radius
+     * @param thickness
+     * @param procedural - draw the rings with procedural:: instead of from vertex buffers
+     * @return handle of the head
+     */
+    node_handle_t make_wgmi_head(scene_t &scene, node_handle_t parent, float radius, float thickness,
+                                 bool procedural = false);
 
 } // namespace scene
 
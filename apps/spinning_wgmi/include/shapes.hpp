@@ -5,14 +5,20 @@
 #include <mesh.hpp>
 
 namespace shapes {
+    // how the grid shapes index their quads
+    enum index_mode_t {
+        TRIANGLE_LIST, // two triangles a quad, six indices
+        TRIANGLE_STRIPS, // a triangle strip a row, two indices a quad and three a row, see mesh_builder::add_quads
+    };
 
-    mesh::mesh_template_t make_sphere(float radius, unsigned int tessellation = 64);
+    mesh::mesh_template_t make_sphere(float radius, unsigned int tessellation = 64, index_mode_t index_mode = TRIANGLE_LIST);
 
     mesh::mesh_template_t make_rect_circle(float radius, float thickness, unsigned int tessellation);
 
     mesh::mesh_template_t make_zero_character(float radius, float z, float thickness, unsigned int tessellation = 64, bool flip_normals = false);
 
-    mesh::mesh_template_t make_ring(float radius, float thickness, unsigned int tessellation = 64, bool flip_normals = false);
+    mesh::mesh_template_t make_ring(float radius, float thickness, unsigned int tessellation = 64, bool flip_normals = false,
+                                    index_mode_t index_mode = TRIANGLE_LIST);
 
     mesh::mesh_template_t make_rect_circle(float radius, float thickness, unsigned int tessellation = 64);
 
@@ -24,23 +30,44 @@ namespace shapes {
 
     mesh::mesh_template_t make_wgmi_face(float radius, unsigned int tessellation = 64);
 
-    mesh::mesh_template_t make_torus(float radius, float thickness, int tessellation = 64);
+    mesh::mesh_template_t make_torus(float radius, float thickness, int tessellation = 64,
+                                     index_mode_t index_mode = TRIANGLE_LIST);
+
+    // as above, with stacks segments around the ring instead of tessellation for every thickness in the radius
+    mesh::mesh_template_t make_torus(float radius, float thickness, int tessellation, int stacks,
+                                     index_mode_t index_mode = TRIANGLE_LIST);
 
     mesh::mesh_template_t make_cube(float width);
 
-    mesh::mesh_template_t make_plane(int width, int height);
+    mesh::mesh_template_t make_plane(int width, int height, index_mode_t index_mode = TRIANGLE_LIST);
 
     mesh::mesh_template_t make_circle(float radius, int tessellation = 64);
 
-    mesh::mesh_template_t make_cylinder(float radius, float length, int tessellation = 64);
-
-    // assumes the mesh_template has indices
-    void calc_vertex_normals(mesh::mesh_template_t &mesh_template);
-
-    // assumes the mesh_template does not have indices
-    void calc_face_normals(mesh::mesh_template_t &mesh_template);
-
-    // duplicates any attributes based on the indices provided
+    mesh::mesh_template_t make_cylinder(float radius, float length, int tessellation = 64,
+                                        index_mode_t index_mode = TRIANGLE_LIST);
+
+    // how much each triangle's normal counts towards its corners' normals
+    enum normal_weighting_t {
+        EQUAL_WEIGHTS, // the same for every triangle
+        AREA_WEIGHTS, // by the triangle's area, so slivers count for little
+        ANGLE_WEIGHTS, // by the triangle's angle at the corner, so how a surface is cut up doesn't matter
+    };
+
+    /**
+     * Give every vertex the weighted average of its triangles' normals. Big meshes are split between
+     * threads, each summing a run of triangles into a buffer of its own, then the sums are added
+     * and normalized a run of vertices per thread. Assumes the mesh_template is an indexed triangle list
+     * @param mesh_template
+     * @param weighting
+     * @param max_threads - 0 for as many as the hardware has
+     */
+    void calc_vertex_normals(mesh::mesh_template_t &mesh_template, normal_weighting_t weighting = EQUAL_WEIGHTS,
+                             unsigned int max_threads = 0);
+
+    // assumes the mesh_template does not have indices, split between threads like calc_vertex_normals
+    void calc_face_normals(mesh::mesh_template_t &mesh_template, unsigned int max_threads = 0);
+
+    // duplicates any attributes based on the indices provided, which must be a triangle list
     mesh::mesh_template_t expand_indices(const mesh::mesh_template_t &mesh_template);
 
 } // namespace shapes
@@ -0,0 +1,57 @@
+#ifndef COMP3421_SIMPLIFIER_HPP
+#define COMP3421_SIMPLIFIER_HPP
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "mesh.hpp"
+
+// Decimates indexed triangle lists by collapsing edges into one of their ends, cheapest first, with
+// the cost of a collapse measured by quadric error metrics (Garland & Heckbert 1997). Colours, tex
+// coords and normals have quadrics of their own (Hoppe 1999), so collapses that smear them cost more.
+// Vertices on borders and attribute seams only slide along them, and where those meet, or the mesh
+// isn't manifold, they don't move at all. The surviving vertices keep their attributes
+namespace simplifier {
+    // each level make_levels makes has at most this fraction of the triangles of the one before
+    const float LEVEL_REDUCTION = 0.5f;
+    const size_t MIN_LEVEL_TRIANGLES = 64;
+    const size_t MAX_LEVELS = 6;
+    // levels further than this fraction of the mesh's size from it have lost its shape, and aren't kept
+    const float MAX_LEVEL_ERROR = 0.05f;
+
+    struct options_t {
+        size_t target_triangles = 0; // stop once there are no more triangles than this
+        float max_error = std::numeric_limits<float>::max(); // or before any collapse would cost more, in model units
+        // how far, as a fraction of the mesh's size, a change of one in an attribute counts for
+        float attribute_weight = 0.25f;
+    };
+
+    struct level_t {
+        mesh::mesh_template_t mesh_template;
+        float error = 0.0f; // in model units, see simplify
+    };
+
+    /**
+     * Collapse the template's edges until options are met or no collapse is left that keeps the mesh's
+     * topology and doesn't flip a triangle. Unused vertices are dropped. Templates without indices, or
+     * whose indices aren't a triangle list, are left alone
+     * @param mesh_template
+     * @param options
+     * @return the error of the costliest collapse: about how far the surface has moved, in model units
+     */
+    float simplify(mesh::mesh_template_t &mesh_template, const options_t &options = {});
+
+    /**
+     * Coarser and coarser copies of the template, each simplified from the one before to LEVEL_REDUCTION of
+     * its triangles, until one would have fewer than MIN_LEVEL_TRIANGLES, barely simplifies or is past
+     * MAX_LEVEL_ERROR, or there are MAX_LEVELS. Errors add up from level to level. options.target_triangles
+     * is ignored
+     * @param mesh_template
+     * @param options
+     * @return finest first, as model_t::lods wants them
+     */
+    std::vector<level_t> make_levels(const mesh::mesh_template_t &mesh_template, const options_t &options = {});
+} // namespace simplifier
+
+#endif // COMP3421_SIMPLIFIER_HPP
@@ -0,0 +1,32 @@
+#ifndef COMP3421_STREAM_BUFFER_HPP
+#define COMP3421_STREAM_BUFFER_HPP
+
+#include "mesh.hpp"
+#include "geometry_pool.hpp"
+
+// Geometry rewritten every frame is streamed through one buffer split into REGIONS regions, a frame
+// writing into one while the GPU may still be drawing from the others. A fence follows each frame's
+// draws and is only waited on when its region comes round again, so writing never waits for the GPU
+// unless it is REGIONS frames behind, and the buffer is never reallocated to dodge a sync. With GL 4.4
+// the buffer is mapped once, persistently, before that each write maps its range unsynchronized. Like
+// the geometry pool there is a VAO per vertex format, meshes are drawn with a base vertex
+namespace stream_buffer {
+    const int REGIONS = 3;
+
+    /**
+     * Write the template's vertices and indices into the current frame's region, growing the buffer if
+     * they don't fit. Indices are 16-bit whenever the vertex count allows it. Templates without indices
+     * get a sequential index list
+     * @param mesh_template
+     * @return where they were written, only valid until the region comes round again
+     */
+    geometry_pool::allocation_t write(const mesh::mesh_template_t &mesh_template);
+
+    /**
+     * Fence off the finished frame's region and move on to the next, waiting for the GPU if it's still
+     * drawing from it. Call once a frame after its last draw from the stream, renderer::render does
+     */
+    void next_frame();
+} // namespace stream_buffer
+
+#endif // COMP3421_STREAM_BUFFER_HPP
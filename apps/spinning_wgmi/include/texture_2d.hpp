@@ -17,6 +17,13 @@ namespace texture_2d {
 
     GLuint init(std::string file_name, params_t const &params = params_t{});
 
+    /**
+     * Whether the image the texture was made from has alpha below 1 anywhere, so drawing it needs blending
+     * @param tex - made by init
+     * @return
+     */
+    bool is_translucent(GLuint tex);
+
     void destroy(GLuint tex);
 }
 
@@ -0,0 +1,211 @@
+#ifndef COMP3421_VERTEX_LAYOUT_HPP
+#define COMP3421_VERTEX_LAYOUT_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include "mesh.hpp"
+#include "bounds.hpp"
+
+// Vertices are stored interleaved, everything but the position packed:
+//   position   3 x float                                  12 bytes
+//   color      3 x normalized signed byte, 1 byte of pad   4 bytes (our colours are unit directions)
+//   tex coord  2 x half float                              4 bytes
+//   normal     normalized GL_INT_2_10_10_10_REV            4 bytes
+// Attributes a mesh doesn't have take no space, so a layout is fixed by the set it carries.
+// Quantized static meshes store the position and normal together instead:
+//   position   3 x unsigned short, fractions of the      8 bytes
+//              cube quantization_of the mesh's box,
+//              then its octahedral normal (2 x signed
+//              byte) or 0, all read as integers
+//   tex coord  2 x normalized unsigned short if they      4 bytes
+//              all lie in [0, 1]
+// The renderer folds each mesh's quantization_t into its instances' model matrices, and shader.vert
+// decodes the rest when compiled with QUANTIZED
+namespace vertex_layout {
+    // optional attributes, positions are always present
+    enum attribute_bits_t : std::uint32_t {
+        COLORS = 1u << 0,
+        TEX_COORDS = 1u << 1,
+        NORMALS = 1u << 2,
+        QUANTIZED = 1u << 3,
+        UNORM_TEX_COORDS = 1u << 4,
+        ATTRIBUTE_SETS = 1u << 5,
+    };
+
+    // where quantized positions are fractions of, a cube so the model matrix it's folded into only
+    // scales normals uniformly
+    struct quantization_t {
+        glm::vec3 origin = glm::vec3(0.0f);
+        float scale = 1.0f;
+    };
+
+    quantization_t quantization_of(const bounds::aabb_t &box);
+
+    /**
+     * @param position
+     * @param quantization
+     * @return the position's x, y and z in the low 48 bits
+     */
+    inline std::uint64_t quantize_position(const glm::vec3 &position, const quantization_t &quantization) {
+        auto fraction = glm::clamp((position - quantization.origin) / quantization.scale, 0.0f, 1.0f);
+        auto q = glm::round(fraction * 65535.0f);
+        return (std::uint64_t) q.x | (std::uint64_t) q.y << 16 | (std::uint64_t) q.z << 32;
+    }
+
+    inline glm::vec3 dequantize_position(std::uint64_t q, const quantization_t &quantization) {
+        auto fraction = glm::vec3(q & 0xffffu, q >> 16 & 0xffffu, q >> 32 & 0xffffu) / 65535.0f;
+        return quantization.origin + fraction * quantization.scale;
+    }
+
+    /**
+     * Fold a unit vector onto an octahedron and unwrap it into a square (Meyer et al. 2010)
+     * @param normal
+     * @return x then y as signed bytes
+     */
+    inline std::uint16_t encode_octahedral(const glm::vec3 &normal) {
+        auto length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if (length == 0.0f) return 0;
+        auto n = normal / length;
+        auto e = glm::vec2(n.x, n.y);
+        if (n.z < 0.0f) {
+            e = (1.0f - glm::abs(glm::vec2(n.y, n.x))) *
+                glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        auto x = (std::int8_t) std::lround(glm::clamp(e.x, -1.0f, 1.0f) * 127.0f);
+        auto y = (std::int8_t) std::lround(glm::clamp(e.y, -1.0f, 1.0f) * 127.0f);
+        return (std::uint16_t) ((std::uint8_t) x | (std::uint8_t) y << 8);
+    }
+
+    // as shader.vert decodes it
+    inline glm::vec3 decode_octahedral(std::uint16_t encoded) {
+        auto e = glm::max(glm::vec2((std::int8_t) (encoded & 0xffu), (std::int8_t) (encoded >> 8)) / 127.0f, glm::vec2(-1.0f));
+        auto n = glm::vec3(e, 1.0f - std::abs(e.x) - std::abs(e.y));
+        auto t = std::max(-n.z, 0.0f);
+        n.x += n.x >= 0.0f ? -t : t;
+        n.y += n.y >= 0.0f ? -t : t;
+        return glm::normalize(n);
+    }
+
+    // attribute locations in shader.vert
+    enum location_t : GLuint {
+        POSITION_LOCATION = 0,
+        COLOR_LOCATION = 1,
+        TEX_COORD_LOCATION = 2,
+        NORMAL_LOCATION = 3,
+    };
+
+    template<std::uint32_t Attributes>
+    struct layout_t {
+        static constexpr bool IS_QUANTIZED = (Attributes & QUANTIZED) != 0;
+        static constexpr GLsizei COLOR_OFFSET = IS_QUANTIZED ? 4 * sizeof(GLushort) : 3 * sizeof(float);
+        static constexpr GLsizei TEX_COORD_OFFSET = COLOR_OFFSET + ((Attributes & COLORS) ? 4 : 0);
+        static constexpr GLsizei NORMAL_OFFSET = TEX_COORD_OFFSET + ((Attributes & TEX_COORDS) ? 4 : 0);
+        static constexpr GLsizei STRIDE = NORMAL_OFFSET + ((Attributes & NORMALS) && !IS_QUANTIZED ? 4 : 0);
+
+        /**
+         * Pack every vertex of the template into out, STRIDE bytes apart
+         * @param mesh_template - must have every attribute in Attributes
+         * @param box - what quantized positions are stored relative to, the mesh's bounds
+         * @param out
+         */
+        static void write(const mesh::mesh_template_t &mesh_template, const bounds::aabb_t &box, unsigned char *out) {
+            auto quantization = quantization_of(box);
+            for (auto i = size_t{0}; i < mesh_template.positions.size(); ++i, out += STRIDE) {
+                if constexpr (IS_QUANTIZED) {
+                    auto position = quantize_position(mesh_template.positions[i], quantization);
+                    if constexpr ((Attributes & NORMALS) != 0) {
+                        position |= (std::uint64_t) encode_octahedral(mesh_template.normals[i]) << 48;
+                    }
+                    std::memcpy(out, &position, sizeof(position));
+                } else {
+                    std::memcpy(out, &mesh_template.positions[i].x, 3 * sizeof(float));
+                }
+                if constexpr ((Attributes & COLORS) != 0) {
+                    auto color = glm::packSnorm4x8(glm::vec4(glm::clamp(mesh_template.colors[i], -1.0f, 1.0f), 0.0f));
+                    std::memcpy(out + COLOR_OFFSET, &color, sizeof(color));
+                }
+                if constexpr ((Attributes & TEX_COORDS) != 0) {
+                    auto tex_coord = (Attributes & UNORM_TEX_COORDS) ? glm::packUnorm2x16(mesh_template.tex_coords[i])
+                                                                     : glm::packHalf2x16(mesh_template.tex_coords[i]);
+                    std::memcpy(out + TEX_COORD_OFFSET, &tex_coord, sizeof(tex_coord));
+                }
+                if constexpr ((Attributes & NORMALS) != 0 && !IS_QUANTIZED) {
+                    auto normal = glm::packSnorm3x10_1x2(glm::vec4(mesh_template.normals[i], 0.0f));
+                    std::memcpy(out + NORMAL_OFFSET, &normal, sizeof(normal));
+                }
+            }
+        }
+
+        /**
+         * Point the bound VAO's vertex attributes at vertices starting offset bytes into the bound
+         * GL_ARRAY_BUFFER
+         * @param offset
+         */
+        static void set_attributes(GLintptr offset) {
+            glEnableVertexAttribArray(POSITION_LOCATION);
+            if constexpr (IS_QUANTIZED) {
+                glVertexAttribIPointer(POSITION_LOCATION, 4, GL_UNSIGNED_SHORT, STRIDE, (void *) offset);
+            } else {
+                glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, STRIDE, (void *) offset);
+            }
+            if constexpr ((Attributes & COLORS) != 0) {
+                glEnableVertexAttribArray(COLOR_LOCATION);
+                glVertexAttribPointer(COLOR_LOCATION, 3, GL_BYTE, GL_TRUE, STRIDE, (void *) (offset + COLOR_OFFSET));
+            }
+            if constexpr ((Attributes & TEX_COORDS) != 0) {
+                glEnableVertexAttribArray(TEX_COORD_LOCATION);
+                if constexpr ((Attributes & UNORM_TEX_COORDS) != 0) {
+                    glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_UNSIGNED_SHORT, GL_TRUE, STRIDE,
+                                          (void *) (offset + TEX_COORD_OFFSET));
+                } else {
+                    glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_HALF_FLOAT, GL_FALSE, STRIDE,
+                                          (void *) (offset + TEX_COORD_OFFSET));
+                }
+            }
+            if constexpr ((Attributes & NORMALS) != 0 && !IS_QUANTIZED) {
+                glEnableVertexAttribArray(NORMAL_LOCATION);
+                glVertexAttribPointer(NORMAL_LOCATION, 4, GL_INT_2_10_10_10_REV, GL_TRUE, STRIDE,
+                                      (void *) (offset + NORMAL_OFFSET));
+            }
+        }
+    };
+
+    // a layout_t picked at runtime, from what a template happens to contain
+    struct descriptor_t {
+        std::uint32_t attributes;
+        GLsizei stride;
+        void (*write)(const mesh::mesh_template_t &mesh_template, const bounds::aabb_t &box, unsigned char *out);
+        void (*set_attributes)(GLintptr offset);
+    };
+
+    // how far quantizing moves a mesh's attributes at worst
+    struct quantization_error_t {
+        float position = 0.0f; // in model units
+        float normal_degrees = 0.0f;
+        float tex_coord = 0.0f;
+    };
+
+    /**
+     * @param mesh_template
+     * @param quantize - whether the mesh will be stored quantized
+     * @return the layout the template's attributes are stored in
+     */
+    std::uint32_t attributes_of(const mesh::mesh_template_t &mesh_template, bool quantize = false);
+
+    const descriptor_t &describe(std::uint32_t attributes);
+
+    /**
+     * Quantize every vertex of the template as its static mesh would be and decode it again
+     * @param mesh_template
+     * @return
+     */
+    quantization_error_t quantization_error(const mesh::mesh_template_t &mesh_template);
+} // namespace vertex_layout
+
+#endif // COMP3421_VERTEX_LAYOUT_HPP
@@ -5,31 +5,35 @@ in vec3 vNormal;
 in vec3 vColor;
 in vec3 vPosition;
 in vec3 vView;
+flat in mat3 vModelBasis;
 in vec3 vTexDir;
 noperspective in vec2 vScreenCoord;
 
 layout (location = 0) out vec4 fFragColor;
 
+// features are #defined by renderer::load_program ahead of this source, a map is only sampled if
+// the material has one
+#ifdef HAS_DIFFUSE_MAP
 uniform sampler2D uDiffuseMap;
-uniform float uDiffuseMapFactor;
-
+#endif
+#ifdef HAS_SPECULAR_MAP
 uniform sampler2D uSpecularMap;
-uniform float uSpecularMapFactor;
-
+#endif
+#ifdef HAS_CUBE_MAP
 uniform samplerCube uCubeMap;
-uniform float uCubeMapFactor;
-
+#endif
+#ifdef HAS_NORMAL_MAP
 uniform sampler2D uNormalMap;
-uniform float uNormalMapFactor;
-
+#endif
+#ifdef HAS_AMBIENT_MAP
 uniform sampler2D uAmbientMap;
-uniform float uAmbientMapFactor;
-
+#endif
+#ifdef HAS_ROUGHNESS_MAP
 uniform sampler2D uRoughnessMap;
-uniform float uRoughnessMapFactor;
-
+#endif
+#ifdef HAS_REFLECTION_MAP
 uniform sampler2D uReflectionMap;
-uniform float uReflectionMapFactor;
+#endif
 
 struct Material {
     vec3 ambient;
@@ -52,13 +56,26 @@ struct SpotLight {
     vec3 specular;
 };
 
-uniform Material uMat;
-uniform DirLight uSun;
-uniform SpotLight uSpot;
+// per-frame data, shared with shader.vert
+layout (std140) uniform FrameBlock {
+    mat4 uViewProj;
+    vec3 uCameraPos;
+    float uNow;
+    DirLight uSun;
+    SpotLight uSpot;
+};
 
-uniform mat4 uModel;
-uniform vec3 uCameraPos;
-uniform bool uIsWaterSurface;
+// per-material data, a range of the renderer's material buffer
+layout (std140) uniform MaterialBlock {
+    Material uMat;
+    float uDiffuseMapFactor;
+    float uSpecularMapFactor;
+    float uCubeMapFactor;
+    float uNormalMapFactor;
+    float uAmbientMapFactor;
+    float uRoughnessMapFactor;
+    float uReflectionMapFactor;
+};
 
 vec3 fNormal;
 vec3 fView;
@@ -93,33 +110,52 @@ vec3 calc_spot_light(SpotLight light, vec3 mat_ambient, vec3 mat_diffuse, vec3 m
 void main() {
     fView = normalize(vView);
 
+    fShininess = uMat.phongExp;
+#ifdef HAS_ROUGHNESS_MAP
     fShininess = mix(uMat.phongExp, 1/(texture(uRoughnessMap, vTexCoord).r + 0.001), uRoughnessMapFactor);
+#endif
 
-    fNormal = mix(normalize(vNormal), normalize(mat3(uModel) * (texture(uNormalMap, vTexCoord).xyz * 2.0 - 1.0)), uNormalMapFactor);
+    fNormal = normalize(vNormal);
+#ifdef HAS_NORMAL_MAP
+    fNormal = mix(normalize(vNormal), normalize(vModelBasis * (texture(uNormalMap, vTexCoord).xyz * 2.0 - 1.0)), uNormalMapFactor);
+#endif
 
-    vec3 mat_ambient = mix(uMat.ambient, texture(uAmbientMap, vTexCoord).rgb, uAmbientMapFactor);
+    vec3 mat_ambient = uMat.ambient;
+#ifdef HAS_AMBIENT_MAP
+    mat_ambient = mix(mat_ambient, texture(uAmbientMap, vTexCoord).rgb, uAmbientMapFactor);
+#endif
     mat_ambient = sRGB_to_linear(mat_ambient);
 
     vec2 diffuseTexCoord = vTexCoord;
-    if (uIsWaterSurface) {
-        diffuseTexCoord = vScreenCoord;
-        //        diffuseTexCoord += fNormal.xz * 0.05;
-        diffuseTexCoord = clamp(diffuseTexCoord, 0, 1);
-    }
+#ifdef IS_WATER_SURFACE
+    diffuseTexCoord = vScreenCoord;
+    //        diffuseTexCoord += fNormal.xz * 0.05;
+    diffuseTexCoord = clamp(diffuseTexCoord, 0, 1);
+#endif
 
     vec4 diffuse = uMat.diffuse;
     diffuse.xyz += normalize(vColor);
-    vec4 mat_diffuse = mix(diffuse, texture(uDiffuseMap, diffuseTexCoord), uDiffuseMapFactor);
-    vec3 color = vec3(mix(diffuse, texture(uDiffuseMap, diffuseTexCoord), uDiffuseMapFactor));
+    vec4 mat_diffuse = diffuse;
+#ifdef HAS_DIFFUSE_MAP
+    mat_diffuse = mix(diffuse, texture(uDiffuseMap, diffuseTexCoord), uDiffuseMapFactor);
+#endif
+    vec3 color = vec3(mat_diffuse);
+#ifdef HAS_CUBE_MAP
     // calculate texture direction for cubemap
     vec3 vTexDir = reflect(-fView, fNormal);
     mat_diffuse.rgb = mix(mat_diffuse, texture(uCubeMap, vTexDir), uCubeMapFactor).rgb;
+#endif
+#ifdef HAS_REFLECTION_MAP
     vec2 reflectionTexCoord = diffuseTexCoord;
     reflectionTexCoord.y = 1 - diffuseTexCoord.y;
     mat_diffuse.rgb = mix(mat_diffuse, texture(uReflectionMap, reflectionTexCoord), uReflectionMapFactor).rgb;
+#endif
     mat_diffuse.rgb = sRGB_to_linear(mat_diffuse.rgb);
 
-    vec3 mat_specular = mix(uMat.specular, texture(uSpecularMap, vTexCoord).rgb, uSpecularMapFactor);
+    vec3 mat_specular = uMat.specular;
+#ifdef HAS_SPECULAR_MAP
+    mat_specular = mix(mat_specular, texture(uSpecularMap, vTexCoord).rgb, uSpecularMapFactor);
+#endif
     mat_specular = sRGB_to_linear(mat_specular);
 
     DirLight sun = uSun;
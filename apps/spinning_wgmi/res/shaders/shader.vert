@@ -1,60 +1,184 @@
 #version 330 core
 
+// features are #defined by renderer::load_program ahead of this source
+#ifdef QUANTIZED
+// xyz: fractions of the mesh's quantization cube out of 65535, w: octahedral normal, see vertex_layout.hpp
+layout (location = 0) in uvec4 aPos;
+#else
 layout (location = 0) in vec4 aPos;
+#endif
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec2 aTexCoord;
 layout (location = 3) in vec3 aNormal;
 
+// per-instance attributes, see mesh::instance_t
+layout (location = 4) in mat4 aModel;
+layout (location = 8) in mat3 aColorRotation;
+layout (location = 11) in vec4 aRainbow; // x: rainbow weight, yzw: colour offset
+
 out vec2 vTexCoord;
 out vec3 vColor;
 out vec3 vNormal;
 out vec3 vPosition;
 out vec3 vView;
+flat out mat3 vModelBasis;
 noperspective out vec2 vScreenCoord;
 
-uniform mat4 uViewProj;
-uniform mat4 uModel;
-uniform vec3 uCameraPos;
-//uniform vec4 uClipPlane;
-uniform bool uIsWaterSurface;
-uniform bool uIsWater;
-uniform float uNow;
+struct DirLight {
+    vec3 direction;
+    vec3 diffuse;
+    vec3 ambient;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 diffuse;
+    vec3 ambient;
+    vec3 specular;
+};
+
+// per-frame data, shared with shader.frag
+layout (std140) uniform FrameBlock {
+    mat4 uViewProj;
+    vec3 uCameraPos;
+    float uNow;
+    DirLight uSun;
+    SpotLight uSpot;
+};
 
-uniform float uRainbow;
-uniform float uColorOffset;
-uniform mat4 uColorRotation;
+//uniform vec4 uClipPlane;
 
+#ifdef HAS_HEIGHT_MAP
 uniform sampler2D uHeightMap;
+#endif
 
 out float gl_ClipDistance[1];
 
+#ifdef PROCEDURAL
+// the shape drawn instead of reading attributes, see procedural.hpp. x: radius, y: thickness, z and w:
+// the range of angles it is swept through
+uniform vec4 uShape;
+// x: procedural::kind_t, y: columns and z: rows of its grid of quads
+uniform ivec3 uShapeGrid;
+
+const int SPHERE = 1;
+const int TORUS = 2;
+const int RING = 3;
+const float PI = 3.14159265358979;
+
+// steps (column, row) to the corners of a quad's triangles, in mesh_builder::add_quads's order
+const ivec2 CORNERS[6] = ivec2[6](ivec2(0, 1), ivec2(0, 0), ivec2(1, 0), ivec2(1, 0), ivec2(1, 1), ivec2(0, 1));
+
+// the vertex gl_VertexID stands for, as the shapes:: generator of the same name makes it
+void make_vertex(out vec4 position, out vec3 color, out vec2 tex_coord, out vec3 normal) {
+    int quad = gl_VertexID / 6;
+    ivec2 corner = CORNERS[gl_VertexID % 6];
+    int column = quad % uShapeGrid.y + corner.x;
+    int row = quad / uShapeGrid.y + corner.y;
+    float u = float(column) / float(uShapeGrid.y);
+    float v = float(row) / float(uShapeGrid.z);
+    float radius = uShape.x;
+    float thickness = uShape.y;
+
+    if (uShapeGrid.x == SPHERE) {
+        // longitude across, latitude from the south pole up
+        float angle = mix(uShape.z, uShape.w, u);
+        float alpha = 1.5 * PI + PI * v;
+        float slice_radius = radius * cos(alpha);
+        position = vec4(slice_radius * sin(angle), radius * sin(alpha), slice_radius * cos(angle), 1.0);
+        tex_coord = vec2(u, v);
+        normal = normalize(position.xyz);
+        color = normalize(position.xyz + radius);
+    } else if (uShapeGrid.x == TORUS) {
+        // round the tube across, then the tube swept round the ring
+        float stacks_per_turn = ceil(radius / thickness);
+        float theta = 2.0 * PI * u;
+        float beta = mix(uShape.z, uShape.w, v);
+        vec3 center = radius * vec3(cos(beta), 0.0, sin(beta));
+        float across = radius + thickness * cos(theta);
+        position = vec4(across * cos(beta), thickness * sin(theta), across * sin(beta), 1.0);
+        tex_coord = vec2(4.0 * stacks_per_turn * v - 0.5, 12.0 * u / stacks_per_turn - 0.5);
+        normal = position.xyz - center;
+        color = normalize(position.xyz);
+    } else {
+        // a band round z, its quads wind from the far edge to the near one
+        float angle = mix(uShape.z, uShape.w, u);
+        float z = (float(row) - 0.5) * thickness;
+        position = vec4(radius * cos(angle), radius * sin(angle), z, 1.0);
+        tex_coord = vec2(0.0);
+        normal = vec3(cos(angle), sin(angle), 0.0);
+        color = vec3(0.0);
+    }
+}
+#endif
+
+#ifdef QUANTIZED
+// as vertex_layout::decode_octahedral does it, x in the low byte
+vec3 decode_octahedral(uint encoded) {
+    vec2 e = max(vec2((ivec2(encoded & 0xffu, encoded >> 8u) ^ 128) - 128) / 127.0, -1.0);
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+#endif
+
+#ifdef IS_WATER
 float calc_water_height(vec3 pos) {
     return pos.y + 0.1 * (0.8 * sin(pos.x + uNow) + 0.4 * cos(pos.z + uNow));
 }
+#endif
 
 void main() {
-    vTexCoord = aTexCoord;
-    vColor = mix(aColor,normalize(uColorOffset + vec3(uColorRotation * aPos)), uRainbow);
-    vNormal = normalize(mat3(uModel) * aNormal);
-    vec4 pos = uModel * aPos;
+#ifdef PROCEDURAL
+    vec4 position;
+    vec3 color;
+    vec2 tex_coord;
+    vec3 normal;
+    make_vertex(position, color, tex_coord, normal);
+#elif defined(QUANTIZED)
+    // the renderer scales and moves the cube into place with aModel
+    vec4 position = vec4(vec3(aPos.xyz) / 65535.0, 1.0);
+    vec3 color = aColor;
+    vec2 tex_coord = aTexCoord;
+    vec3 normal = decode_octahedral(aPos.w);
+#else
+    vec4 position = aPos;
+    vec3 color = aColor;
+    vec2 tex_coord = aTexCoord;
+    vec3 normal = aNormal;
+#endif
+
+    vTexCoord = tex_coord;
+#ifdef RAINBOW
+    vColor = mix(color,normalize(aRainbow.yzw + aColorRotation * position.xyz), aRainbow.x);
+#else
+    vColor = color;
+#endif
+    vModelBasis = mat3(aModel);
+    vNormal = normalize(vModelBasis * normal);
+    vec4 pos = aModel * position;
     // if water then use sin/cos to alter the height
-    if (uIsWater) {
-        pos.y = calc_water_height(pos.xyz);
-        if (uIsWaterSurface) {
-            // calculate normal for the distorted mesh
-            float offset = 0.1;
-            vec3 top = vec3(pos.x, pos.y, pos.z - offset);
-            top.y = calc_water_height(top);
-            vec3 left = vec3(pos.x - offset, pos.y, pos.z + offset);
-            left.y = calc_water_height(left);
-            vec3 right = vec3(pos.x + offset, pos.y, pos.z + offset);
-            right.y = calc_water_height(right);
-            vec3 a = left - top;
-            vec3 b = right - top;
-            vNormal = normalize(cross(a, b));
-        }
-    }
+#ifdef IS_WATER
+    pos.y = calc_water_height(pos.xyz);
+#ifdef IS_WATER_SURFACE
+    // calculate normal for the distorted mesh
+    float offset = 0.1;
+    vec3 top = vec3(pos.x, pos.y, pos.z - offset);
+    top.y = calc_water_height(top);
+    vec3 left = vec3(pos.x - offset, pos.y, pos.z + offset);
+    left.y = calc_water_height(left);
+    vec3 right = vec3(pos.x + offset, pos.y, pos.z + offset);
+    right.y = calc_water_height(right);
+    vec3 a = left - top;
+    vec3 b = right - top;
+    vNormal = normalize(cross(a, b));
+#endif
+#endif
+#ifdef HAS_HEIGHT_MAP
     pos.y += texture(uHeightMap, vTexCoord).r;
+#endif
     vPosition = pos.xyz;
     vView = normalize(uCameraPos - vPosition);
     gl_Position = uViewProj * pos;
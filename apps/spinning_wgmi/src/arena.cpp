@@ -0,0 +1,58 @@
+#include "arena.hpp"
+
+#include <algorithm>
+
+namespace {
+    const size_t MIN_BLOCK_SIZE = 1 << 16;
+
+    size_t align_up(size_t offset, size_t alignment) {
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+} // namespace
+
+namespace arena {
+    arena_t &scratch() {
+        thread_local arena_t arena;
+        return arena;
+    }
+
+    void *allocate(arena_t &arena, size_t bytes, size_t alignment) {
+        // blocks come from new[], so they start aligned for anything and only offsets need rounding
+        while (arena.block < arena.blocks.size()) {
+            auto &block = arena.blocks[arena.block];
+            auto offset = align_up(arena.used, alignment);
+            if (offset + bytes <= block.size) {
+                arena.used = offset + bytes;
+                return block.data.get() + offset;
+            }
+            // the rest of this block is skipped until a rewind, later blocks may be big enough
+            ++arena.block;
+            arena.used = 0;
+        }
+
+        auto size = std::max({MIN_BLOCK_SIZE, bytes, arena.blocks.empty() ? 0 : 2 * arena.blocks.back().size});
+        arena.blocks.push_back({std::unique_ptr<unsigned char[]>(new unsigned char[size]), size});
+        arena.block = arena.blocks.size() - 1;
+        arena.used = bytes;
+        return arena.blocks.back().data.get();
+    }
+
+    mark_t mark(const arena_t &arena) {
+        return {arena.block, arena.used};
+    }
+
+    void rewind(arena_t &arena, mark_t mark) {
+        arena.block = mark.block;
+        arena.used = mark.used;
+        // once it's all released, several blocks become one as big as them all, so what needed them
+        // fits in one piece next time without skipping block tails
+        if (arena.block == 0 && arena.used == 0 && arena.blocks.size() > 1) {
+            auto size = size_t{0};
+            for (const auto &block: arena.blocks) {
+                size += block.size;
+            }
+            arena.blocks.clear();
+            arena.blocks.push_back({std::unique_ptr<unsigned char[]>(new unsigned char[size]), size});
+        }
+    }
+} // namespace arena
@@ -0,0 +1,205 @@
+#include "benchmark.hpp"
+#include "shapes.hpp"
+#include "model.hpp"
+#include "vertex_layout.hpp"
+#include "clusters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <string>
+#include <thread>
+
+namespace {
+    // spend at least this long on each measurement so short runs aren't all timer noise
+    const double MIN_SECONDS = 0.25;
+
+    void time_shape(std::ostream &out, const std::string &name, unsigned int tessellation,
+                    const std::function<mesh::mesh_template_t()> &make) {
+        auto vertices = size_t{0};
+        auto runs = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed{};
+        do {
+            vertices += make().positions.size();
+            ++runs;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed.count() < MIN_SECONDS);
+
+        out << std::left << std::setw(18) << name << std::right
+            << std::setw(6) << tessellation
+            << std::setw(10) << vertices / runs
+            << std::setw(12) << elapsed.count() * 1000.0 / runs
+            << std::setw(12) << (double) vertices / elapsed.count() / 1e6 << '\n';
+    }
+
+    void time_normals(std::ostream &out, const std::string &name, std::vector<mesh::mesh_template_t> &templates) {
+        auto triangles = size_t{0};
+        for (const auto &mesh_template: templates) {
+            triangles += mesh_template.indices.size() / 3;
+        }
+        auto threads = std::max(std::thread::hardware_concurrency(), 1u);
+        auto weightings = {std::make_pair(shapes::EQUAL_WEIGHTS, "equal"), std::make_pair(shapes::AREA_WEIGHTS, "area"),
+                           std::make_pair(shapes::ANGLE_WEIGHTS, "angle")};
+        auto thread_counts = std::vector<unsigned int>{1u};
+        if (threads > 1) thread_counts.push_back(threads);
+        for (const auto &weighting: weightings) {
+            for (auto max_threads: thread_counts) {
+                auto runs = 0;
+                auto start = std::chrono::steady_clock::now();
+                std::chrono::duration<double> elapsed{};
+                do {
+                    for (auto &mesh_template: templates) {
+                        shapes::calc_vertex_normals(mesh_template, weighting.first, max_threads);
+                    }
+                    ++runs;
+                    elapsed = std::chrono::steady_clock::now() - start;
+                } while (elapsed.count() < MIN_SECONDS);
+
+                out << std::left << std::setw(24) << name << std::setw(8) << weighting.second << std::right
+                    << std::setw(8) << max_threads
+                    << std::setw(10) << triangles
+                    << std::setw(12) << elapsed.count() * 1000.0 / runs
+                    << std::setw(12) << (double) triangles * runs / elapsed.count() / 1e6 << '\n';
+            }
+        }
+    }
+
+    void report_quantization(std::ostream &out, const std::string &name, const mesh::mesh_template_t &mesh_template) {
+        auto floats = 3 + (mesh_template.colors.empty() ? 0 : 3) + (mesh_template.tex_coords.empty() ? 0 : 2) +
+                      (mesh_template.normals.empty() ? 0 : 3);
+        auto packed = vertex_layout::describe(vertex_layout::attributes_of(mesh_template)).stride;
+        auto quantized = vertex_layout::describe(vertex_layout::attributes_of(mesh_template, true)).stride;
+        auto box = bounds::from_points(mesh_template.positions);
+        auto error = vertex_layout::quantization_error(mesh_template);
+
+        out << std::left << std::setw(24) << name << std::right
+            << std::setw(9) << mesh_template.positions.size()
+            << std::setw(7) << floats * sizeof(float)
+            << std::setw(7) << packed
+            << std::setw(7) << quantized
+            << std::setw(10) << vertex_layout::quantization_of(box).scale
+            << std::setw(12) << std::scientific << error.position << std::fixed
+            << std::setw(12) << error.normal_degrees
+            << std::setw(12) << std::scientific << error.tex_coord << std::fixed << '\n';
+    }
+
+    void report_clusters(std::ostream &out, const std::string &name, mesh::mesh_template_t mesh_template) {
+        auto triangles = mesh_template.indices.size() / 3;
+        auto start = std::chrono::steady_clock::now();
+        auto built = clusters::build(mesh_template);
+        std::chrono::duration<double, std::milli> build_ms = std::chrono::steady_clock::now() - start;
+        if (built.count == 0) {
+            out << std::left << std::setw(24) << name << std::right << std::setw(10) << triangles
+                << "  too small to cluster\n";
+            return;
+        }
+
+        // cameras on a sphere three radii out, each looking at the middle with the window's projection
+        const int VIEWS = 64;
+        auto box = bounds::from_points(mesh_template.positions);
+        auto sphere = bounds::bounding_sphere(mesh_template.positions, box);
+        auto projection = glm::perspective(glm::radians(60.0f), 1280.0f / 720.0f, 0.1f, 1000.0f);
+        auto ranges = clusters::ranges_t{};
+        auto kept_clusters = size_t{0};
+        auto kept_indices = size_t{0};
+        auto runs = 0;
+        start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed{};
+        do {
+            for (int v = 0; v < VIEWS; ++v) {
+                // spread evenly with the golden angle
+                auto y = 1.0f - 2.0f * ((float) v + 0.5f) / (float) VIEWS;
+                auto around = (float) v * 2.39996323f;
+                auto ring = std::sqrt(1.0f - y * y);
+                auto camera = sphere.center + 3.0f * sphere.radius * glm::vec3(ring * std::cos(around), y,
+                                                                               ring * std::sin(around));
+                auto up = std::abs(y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+                auto frustum = bounds::make_frustum(projection * glm::lookAt(camera, sphere.center, up));
+                clusters::clear(ranges);
+                kept_clusters += clusters::cull(built, glm::mat4(1.0f), frustum, camera, true, ranges);
+                for (auto count: ranges.index_counts) {
+                    kept_indices += (size_t) count;
+                }
+            }
+            ++runs;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed.count() < MIN_SECONDS);
+
+        auto views = (double) VIEWS * runs;
+        out << std::left << std::setw(24) << name << std::right
+            << std::setw(10) << triangles
+            << std::setw(10) << built.count
+            << std::setw(10) << build_ms.count()
+            << std::setw(10) << 100.0 * kept_clusters / views / built.count
+            << std::setw(10) << 100.0 * kept_indices / 3.0 / views / triangles
+            << std::setw(10) << elapsed.count() * 1e6 / views << '\n';
+    }
+} // namespace
+
+namespace benchmark {
+    void shapes(std::ostream &out) {
+        auto thickness = glm::radians(5.0f);
+        out << std::fixed << std::setprecision(3)
+            << "shape             tess     verts     ms/mesh   Mverts/s\n";
+        for (unsigned int tessellation: {64u, 256u, 1024u}) {
+            time_shape(out, "zero_character", tessellation,
+                       [&] { return shapes::make_zero_character(1.0f, 0.0f, thickness, tessellation); });
+            time_shape(out, "rect_circle", tessellation,
+                       [&] { return shapes::make_rect_circle(1.0f, thickness, tessellation); });
+            time_shape(out, "sphere", tessellation, [&] { return shapes::make_sphere(1.0f, tessellation); });
+            time_shape(out, "wgmi_face", tessellation, [&] { return shapes::make_wgmi_face(1.0f, tessellation); });
+            time_shape(out, "sphere_skeleton", tessellation,
+                       [&] { return shapes::make_sphere_skeleton(1.0f, thickness, 8, tessellation); });
+            // thick enough that the ring count stays reasonable at high tessellation
+            time_shape(out, "torus", tessellation,
+                       [&] { return shapes::make_torus(1.0f, 0.5f, (int) tessellation); });
+        }
+    }
+
+    void normals(std::ostream &out, const std::vector<std::string> &paths) {
+        out << std::fixed << std::setprecision(3)
+            << "mesh                    weights  threads      tris     ms/mesh    Mtris/s\n";
+        if (paths.empty()) {
+            auto templates = std::vector<mesh::mesh_template_t>{shapes::make_torus(1.0f, 0.5f, 1024)};
+            time_normals(out, "torus 1024", templates);
+        }
+        for (const auto &path: paths) {
+            auto templates = model::load_templates(path);
+            time_normals(out, path.substr(path.find_last_of('/') + 1), templates);
+        }
+    }
+
+    void quantization(std::ostream &out, const std::vector<std::string> &paths) {
+        auto thickness = glm::radians(5.0f);
+        out << std::fixed << std::setprecision(3)
+            << "mesh                       verts  float packed  quant      size    position  normal deg   tex coord\n";
+        report_quantization(out, "zero_character", shapes::make_zero_character(1.0f, 0.0f, thickness, 64));
+        report_quantization(out, "sphere", shapes::make_sphere(1.0f, 64));
+        report_quantization(out, "wgmi_face", shapes::make_wgmi_face(1.0f, 64));
+        report_quantization(out, "sphere_skeleton", shapes::make_sphere_skeleton(1.0f, thickness, 8, 64));
+        report_quantization(out, "torus", shapes::make_torus(1.0f, 0.5f, 64));
+        for (const auto &path: paths) {
+            auto templates = model::load_templates(path);
+            auto name = path.substr(path.find_last_of('/') + 1);
+            for (auto i = size_t{0}; i < templates.size(); ++i) {
+                report_quantization(out, name + " #" + std::to_string(i), templates[i]);
+            }
+        }
+    }
+
+    void clusters(std::ostream &out, const std::vector<std::string> &paths) {
+        out << std::fixed << std::setprecision(3)
+            << "mesh                         tris  clusters  build ms  kept %    tris %   cull us\n";
+        if (paths.empty()) report_clusters(out, "torus 512", shapes::make_torus(1.0f, 0.5f, 512));
+        for (const auto &path: paths) {
+            auto templates = model::load_templates(path);
+            auto name = path.substr(path.find_last_of('/') + 1);
+            for (auto i = size_t{0}; i < templates.size(); ++i) {
+                report_clusters(out, name + " #" + std::to_string(i), std::move(templates[i]));
+            }
+        }
+    }
+} // namespace benchmark
@@ -0,0 +1,107 @@
+#include "bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace bounds {
+    bool empty(const aabb_t &box) {
+        return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z;
+    }
+
+    aabb_t from_points(const std::vector<glm::vec3> &points) {
+        auto box = aabb_t{};
+        for (const auto &p: points) {
+            box.min = glm::min(box.min, p);
+            box.max = glm::max(box.max, p);
+        }
+        return box;
+    }
+
+    aabb_t merge(const aabb_t &a, const aabb_t &b) {
+        return {glm::min(a.min, b.min), glm::max(a.max, b.max)};
+    }
+
+    aabb_t transform(const aabb_t &box, const glm::mat4 &transform) {
+        if (empty(box)) return box;
+
+        auto out = aabb_t{glm::vec3(transform[3]), glm::vec3(transform[3])};
+        for (int col = 0; col < 3; ++col) {
+            for (int row = 0; row < 3; ++row) {
+                float a = transform[col][row] * box.min[col];
+                float b = transform[col][row] * box.max[col];
+                out.min[row] += std::min(a, b);
+                out.max[row] += std::max(a, b);
+            }
+        }
+        return out;
+    }
+
+    sphere_t bounding_sphere(const std::vector<glm::vec3> &points, const aabb_t &box) {
+        auto sphere = sphere_t{};
+        if (empty(box)) return sphere;
+
+        sphere.center = (box.min + box.max) * 0.5f;
+        float radius2 = 0.0f;
+        for (const auto &p: points) {
+            radius2 = std::max(radius2, glm::dot(p - sphere.center, p - sphere.center));
+        }
+        sphere.radius = std::sqrt(radius2);
+        return sphere;
+    }
+
+    sphere_t transform(const sphere_t &sphere, const glm::mat4 &transform) {
+        if (sphere.radius < 0.0f) return sphere;
+
+        // a non-uniform scale stretches the sphere by at most its largest axis
+        float scale2 = std::max({glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+                                 glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])),
+                                 glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2]))});
+        return {glm::vec3(transform * glm::vec4(sphere.center, 1.0f)), sphere.radius * std::sqrt(scale2)};
+    }
+
+    frustum_t make_frustum(const glm::mat4 &view_proj) {
+        auto row = [&](int r) {
+            return glm::vec4(view_proj[0][r], view_proj[1][r], view_proj[2][r], view_proj[3][r]);
+        };
+
+        auto frustum = frustum_t{};
+        frustum.planes[0] = row(3) + row(0); // left
+        frustum.planes[1] = row(3) - row(0); // right
+        frustum.planes[2] = row(3) + row(1); // bottom
+        frustum.planes[3] = row(3) - row(1); // top
+        frustum.planes[4] = row(3) + row(2); // near
+        frustum.planes[5] = row(3) - row(2); // far
+        for (auto &plane: frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    containment_t classify(const frustum_t &frustum, const aabb_t &box) {
+        if (empty(box)) return OUTSIDE;
+
+        auto result = INSIDE;
+        for (const auto &plane: frustum.planes) {
+            auto normal = glm::vec3(plane);
+            // the corners furthest along and against the plane normal
+            auto positive = glm::vec3(normal.x >= 0 ? box.max.x : box.min.x,
+                                      normal.y >= 0 ? box.max.y : box.min.y,
+                                      normal.z >= 0 ? box.max.z : box.min.z);
+            auto negative = glm::vec3(normal.x >= 0 ? box.min.x : box.max.x,
+                                      normal.y >= 0 ? box.min.y : box.max.y,
+                                      normal.z >= 0 ? box.min.z : box.max.z);
+            if (glm::dot(normal, positive) + plane.w < 0) return OUTSIDE;
+            if (glm::dot(normal, negative) + plane.w < 0) result = INTERSECTS;
+        }
+        return result;
+    }
+
+    bool intersects(const frustum_t &frustum, const sphere_t &sphere) {
+        if (sphere.radius < 0.0f) return false;
+
+        for (const auto &plane: frustum.planes) {
+            if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius) return false;
+        }
+        return true;
+    }
+} // namespace bounds
@@ -0,0 +1,338 @@
+#include "clusters.hpp"
+#include "arena.hpp"
+#include "mesh_adjacency.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+    // how much facing away from a cluster's normal counts against a triangle joining it, against how
+    // far it is from the cluster's middle. Higher makes flatter clusters with tighter cones
+    const float CONE_WEIGHT = 1.0f;
+
+    // clusters whose normals are at least this far from their axis (cos 84 degrees) face some way
+    // from almost everywhere, so they get no cone
+    const float MIN_CONE_DOT = 0.1f;
+
+    const std::uint32_t NO_CLUSTER = ~std::uint32_t{0};
+
+    using parallel::splat;
+    using parallel::load4;
+
+    struct cell_hash_t {
+        size_t operator()(const glm::ivec3 &cell) const {
+            return (size_t) cell.x * 73856093u ^ (size_t) cell.y * 19349663u ^ (size_t) cell.z * 83492791u;
+        }
+    };
+
+    // whether every edge is shared by as many triangles one way round as the other, so only front
+    // faces can be seen from outside. Vertices are the same if they're in the same cell of a fine grid
+    // over the mesh's box, which welds seams whose positions differ by rounding. The odd pair of them
+    // either side of a cell wall only makes the mesh look open, which is safe
+    bool is_closed(const mesh::mesh_template_t &mesh_template) {
+        const auto &indices = mesh_template.indices;
+        const auto &positions = mesh_template.positions;
+        auto box = bounds::from_points(positions);
+        auto extent = box.max - box.min;
+        auto cell_size = std::max({extent.x, extent.y, extent.z, std::numeric_limits<float>::min()}) / (1 << 20);
+        auto id_of = std::unordered_map<glm::ivec3, std::uint32_t, cell_hash_t>{};
+        id_of.reserve(positions.size());
+        auto ids = std::vector<std::uint32_t>(positions.size());
+        for (auto v = size_t{0}; v < ids.size(); ++v) {
+            auto cell = glm::ivec3(glm::floor((positions[v] - box.min) / cell_size + 0.5f));
+            ids[v] = id_of.emplace(cell, (std::uint32_t) id_of.size()).first->second;
+        }
+
+        auto edges = std::unordered_map<std::uint64_t, int>{};
+        edges.reserve(indices.size());
+        for (auto i = size_t{0}; i < indices.size(); ++i) {
+            auto a = ids[indices[i]];
+            auto b = ids[indices[i - i % 3 + (i + 1) % 3]];
+            if (a == b) continue;
+            // +1 for a to b under the smaller id first, -1 for the other way round
+            auto key = (std::uint64_t) std::min(a, b) << 32 | std::max(a, b);
+            edges[key] += a < b ? 1 : -1;
+        }
+        return std::all_of(edges.begin(), edges.end(), [](const std::pair<const std::uint64_t, int> &edge) {
+            return edge.second == 0;
+        });
+    }
+
+    struct cluster_t {
+        size_t first; // into the triangle order
+        size_t end;
+        glm::vec3 center;
+        float radius;
+        glm::vec3 axis;
+        float cutoff;
+        float facing; // how far its middle is out from the mesh's along its axis
+    };
+
+    // the bounds of a cluster's triangles, order[first] to order[end]
+    void bound(cluster_t &cluster, const mesh::mesh_template_t &mesh_template,
+               const arena::vector<std::uint32_t> &order, const arena::vector<glm::vec3> &normals, bool closed) {
+        const auto &indices = mesh_template.indices;
+        const auto &positions = mesh_template.positions;
+        auto box = bounds::aabb_t{};
+        auto normal_sum = glm::vec3(0.0f);
+        for (auto i = cluster.first; i < cluster.end; ++i) {
+            for (int k = 0; k < 3; ++k) {
+                const auto &p = positions[indices[3 * order[i] + k]];
+                box.min = glm::min(box.min, p);
+                box.max = glm::max(box.max, p);
+            }
+            normal_sum += normals[order[i]];
+        }
+        cluster.center = (box.min + box.max) * 0.5f;
+        cluster.radius = 0.0f;
+        for (auto i = cluster.first; i < cluster.end; ++i) {
+            for (int k = 0; k < 3; ++k) {
+                auto distance = glm::length(positions[indices[3 * order[i] + k]] - cluster.center);
+                cluster.radius = std::max(cluster.radius, distance);
+            }
+        }
+
+        // the normals are area weighted, so the axis is the way most of the surface faces
+        cluster.axis = glm::vec3(0.0f);
+        cluster.cutoff = 1.0f;
+        auto length = glm::length(normal_sum);
+        if (!closed || length <= 0.0f) return;
+        auto axis = normal_sum / length;
+        auto min_dot = 1.0f;
+        for (auto i = cluster.first; i < cluster.end; ++i) {
+            auto n_length = glm::length(normals[order[i]]);
+            if (n_length > 0.0f) min_dot = std::min(min_dot, glm::dot(normals[order[i]] / n_length, axis));
+        }
+        if (min_dot <= MIN_CONE_DOT) return;
+        // the normals are within acos(min_dot) of the axis, so the camera sees none of their fronts
+        // while it's more than 90 degrees past that from the axis as seen from every point of the sphere
+        cluster.axis = axis;
+        cluster.cutoff = std::sqrt(1.0f - min_dot * min_dot);
+    }
+} // namespace
+
+namespace clusters {
+    clusters_t build(mesh::mesh_template_t &mesh_template) {
+        auto clusters = clusters_t{};
+        auto &indices = mesh_template.indices;
+        auto triangle_count = indices.size() / 3;
+        if (mesh_template.primitive != GL_TRIANGLES || indices.size() % 3 != 0 ||
+            triangle_count < MIN_CLUSTERED_TRIANGLES) {
+            return clusters;
+        }
+        const auto &positions = mesh_template.positions;
+        auto closed = is_closed(mesh_template);
+
+        auto &scratch = arena::scratch();
+        auto mark = arena::mark(scratch);
+        auto centroids = arena::make_vector<glm::vec3>(scratch, triangle_count);
+        auto normals = arena::make_vector<glm::vec3>(scratch, triangle_count); // twice the area long
+        auto unit_normals = arena::make_vector<glm::vec3>(scratch, triangle_count); // zero if degenerate
+        for (auto t = size_t{0}; t < triangle_count; ++t) {
+            const auto &a = positions[indices[3 * t]];
+            const auto &b = positions[indices[3 * t + 1]];
+            const auto &c = positions[indices[3 * t + 2]];
+            centroids[t] = (a + b + c) / 3.0f;
+            normals[t] = glm::cross(b - a, c - a);
+            auto length = glm::length(normals[t]);
+            unit_normals[t] = length > 0.0f ? normals[t] / length : glm::vec3(0.0f);
+        }
+
+        auto adjacency = mesh_adjacency::build(scratch, indices.data(), indices.size(), positions.size());
+
+        // grow one cluster at a time from a triangle next to the last, taking whichever triangle
+        // touching it is best placed until it's full or runs out of neighbours
+        auto cluster_of = arena::make_vector<std::uint32_t>(scratch, triangle_count, NO_CLUSTER);
+        auto candidate_of = arena::make_vector<std::uint32_t>(scratch, triangle_count, NO_CLUSTER);
+        auto order = arena::make_vector<std::uint32_t>(scratch);
+        order.reserve(triangle_count);
+        auto candidates = arena::make_vector<std::uint32_t>(scratch);
+        auto found = arena::make_vector<cluster_t>(scratch);
+        found.reserve(triangle_count / CLUSTER_TRIANGLES * 2);
+        auto cursor = size_t{0};
+        while (order.size() < triangle_count) {
+            auto id = (std::uint32_t) found.size();
+            auto seed = NO_CLUSTER;
+            for (auto t: candidates) {
+                if (cluster_of[t] == NO_CLUSTER) {
+                    seed = t;
+                    break;
+                }
+            }
+            while (seed == NO_CLUSTER) {
+                if (cluster_of[cursor] == NO_CLUSTER) seed = (std::uint32_t) cursor;
+                ++cursor;
+            }
+            candidates.clear();
+
+            auto cluster = cluster_t{};
+            cluster.first = order.size();
+            auto centroid_sum = glm::vec3(0.0f);
+            auto normal_sum = glm::vec3(0.0f);
+            for (auto next = seed; next != NO_CLUSTER;) {
+                cluster_of[next] = id;
+                order.push_back(next);
+                centroid_sum += centroids[next];
+                normal_sum += normals[next];
+                for (int k = 0; k < 3; ++k) {
+                    auto v = indices[3 * next + k];
+                    for (auto a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; ++a) {
+                        auto t = adjacency.triangles[a];
+                        if (cluster_of[t] != NO_CLUSTER || candidate_of[t] == id) continue;
+                        candidate_of[t] = id;
+                        candidates.push_back(t);
+                    }
+                }
+                if (order.size() - cluster.first == CLUSTER_TRIANGLES) break;
+
+                auto centre = centroid_sum / (float) (order.size() - cluster.first);
+                auto length = glm::length(normal_sum);
+                auto axis = length > 0.0f ? normal_sum / length : glm::vec3(0.0f);
+                next = NO_CLUSTER;
+                auto best = std::numeric_limits<float>::max();
+                auto kept = size_t{0};
+                for (auto t: candidates) {
+                    if (cluster_of[t] != NO_CLUSTER) continue;
+                    candidates[kept++] = t;
+                    auto score = glm::length(centroids[t] - centre) *
+                                 (1.0f + CONE_WEIGHT * (1.0f - glm::dot(unit_normals[t], axis)));
+                    if (score < best) {
+                        best = score;
+                        next = t;
+                    }
+                }
+                candidates.resize(kept);
+            }
+            cluster.end = order.size();
+            bound(cluster, mesh_template, order, normals, closed);
+            found.push_back(cluster);
+        }
+
+        // clusters facing most outwards from the mesh's middle first, they're the likeliest to hide
+        // the rest from whichever side the mesh is seen (as mesh_optimizer orders its own)
+        auto middle = glm::vec3(0.0f);
+        auto total_area = 0.0f;
+        for (auto t = size_t{0}; t < triangle_count; ++t) {
+            auto area = glm::length(normals[t]);
+            middle += area * centroids[t];
+            total_area += area;
+        }
+        if (total_area > 0.0f) middle /= total_area;
+        for (auto &cluster: found) {
+            auto normal_sum = glm::vec3(0.0f);
+            for (auto i = cluster.first; i < cluster.end; ++i) {
+                normal_sum += normals[order[i]];
+            }
+            auto length = glm::length(normal_sum);
+            cluster.facing = length > 0.0f ? glm::dot(cluster.center - middle, normal_sum / length) : 0.0f;
+        }
+        std::stable_sort(found.begin(), found.end(),
+                         [](const cluster_t &a, const cluster_t &b) { return a.facing > b.facing; });
+
+        auto original = arena::make_vector<GLuint>(scratch);
+        original.assign(indices.begin(), indices.end());
+        mesh_template.groups.clear();
+        auto padded = (found.size() + 3) / 4 * 4;
+        for (auto *array: {&clusters.center_x, &clusters.center_y, &clusters.center_z, &clusters.radius,
+                           &clusters.axis_x, &clusters.axis_y, &clusters.axis_z, &clusters.cutoff}) {
+            array->assign(padded, 0.0f);
+        }
+        clusters.count = found.size();
+        auto next_index = size_t{0};
+        for (auto c = size_t{0}; c < found.size(); ++c) {
+            const auto &cluster = found[c];
+            mesh_template.groups.push_back((GLuint) next_index);
+            clusters.first_index.push_back((GLuint) next_index);
+            clusters.index_count.push_back((GLsizei) (3 * (cluster.end - cluster.first)));
+            for (auto i = cluster.first; i < cluster.end; ++i) {
+                for (int k = 0; k < 3; ++k) {
+                    indices[next_index++] = original[3 * order[i] + k];
+                }
+            }
+            clusters.center_x[c] = cluster.center.x;
+            clusters.center_y[c] = cluster.center.y;
+            clusters.center_z[c] = cluster.center.z;
+            clusters.radius[c] = cluster.radius;
+            clusters.axis_x[c] = cluster.axis.x;
+            clusters.axis_y[c] = cluster.axis.y;
+            clusters.axis_z[c] = cluster.axis.z;
+            clusters.cutoff[c] = cluster.cutoff;
+        }
+        arena::rewind(scratch, mark);
+        return clusters;
+    }
+
+    size_t cull(const clusters_t &clusters, const glm::mat4 &world, const bounds::frustum_t &frustum,
+                const glm::vec3 &camera, bool cull_backfaces, ranges_t &ranges, unsigned int max_threads) {
+        if (clusters.count == 0) return 0;
+
+        // test in model space, where the clusters are: planes go through the transpose of world, and are
+        // normalized again so distances are model space ones. Clusters outside a plane there are outside
+        // it in world space too, however world scales
+        float planes[6][4];
+        for (int p = 0; p < 6; ++p) {
+            auto plane = glm::transpose(world) * frustum.planes[p];
+            plane /= glm::length(glm::vec3(plane));
+            for (int k = 0; k < 4; ++k) planes[p][k] = plane[k];
+        }
+        auto eye = glm::vec3(glm::inverse(world) * glm::vec4(camera.x, camera.y, camera.z, 1.0f));
+
+        auto &scratch = arena::scratch();
+        auto mark = arena::mark(scratch);
+        auto padded = clusters.center_x.size();
+        auto visible = arena::make_vector<std::uint8_t>(scratch, padded, 0);
+        auto parts = parallel::parts_for(padded / 4, MIN_CLUSTERS_PER_THREAD / 4, max_threads);
+        parallel::for_each_part(padded / 4, parts, [&](size_t, size_t begin, size_t end) {
+            for (auto i = 4 * begin; i < 4 * end; i += 4) {
+                auto x = load4(&clusters.center_x[i]);
+                auto y = load4(&clusters.center_y[i]);
+                auto z = load4(&clusters.center_z[i]);
+                auto radius = load4(&clusters.radius[i]);
+                auto below = splat(0.0f) - radius;
+                auto culled = 0;
+                for (const auto &plane: planes) {
+                    auto distance = splat(plane[0]) * x + splat(plane[1]) * y + splat(plane[2]) * z + splat(plane[3]);
+                    culled |= less4(distance, below);
+                }
+                if (cull_backfaces) {
+                    auto to_x = x - splat(eye.x);
+                    auto to_y = y - splat(eye.y);
+                    auto to_z = z - splat(eye.z);
+                    auto distance = sqrt4(to_x * to_x + to_y * to_y + to_z * to_z);
+                    auto along = to_x * load4(&clusters.axis_x[i]) + to_y * load4(&clusters.axis_y[i]) +
+                                 to_z * load4(&clusters.axis_z[i]);
+                    culled |= ~less4(along, load4(&clusters.cutoff[i]) * distance + radius) & 0xf;
+                }
+                for (int k = 0; k < 4; ++k) {
+                    visible[i + k] = (std::uint8_t) !(culled >> k & 1);
+                }
+            }
+        });
+
+        // neighbouring clusters' indices follow on from each other, so they can be drawn as one range
+        auto first_range = ranges.first_indices.size();
+        auto kept = size_t{0};
+        for (auto c = size_t{0}; c < clusters.count; ++c) {
+            if (!visible[c]) continue;
+            ++kept;
+            if (ranges.first_indices.size() > first_range &&
+                ranges.first_indices.back() + (GLuint) ranges.index_counts.back() == clusters.first_index[c]) {
+                ranges.index_counts.back() += clusters.index_count[c];
+            } else {
+                ranges.first_indices.push_back(clusters.first_index[c]);
+                ranges.index_counts.push_back(clusters.index_count[c]);
+            }
+        }
+        arena::rewind(scratch, mark);
+        return kept;
+    }
+
+    void clear(ranges_t &ranges) {
+        ranges.first_indices.clear();
+        ranges.index_counts.clear();
+    }
+} // namespace clusters
@@ -3,6 +3,7 @@
 #include <chicken3421/chicken3421.hpp>
 
 #include <cubemap.hpp>
+#include <gl_state.hpp>
 
 namespace {
 	const char* side_suffices[] = {"_right", "_left", "_top", "_bottom", "_front", "_back"};
@@ -12,7 +13,7 @@ namespace cubemap {
 	GLuint make_cubemap(const std::string& base_path, const std::string& extension) {
 		GLuint cubemap;
 		glGenTextures(1, &cubemap);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+		gl_state::bind_texture(GL_TEXTURE_CUBE_MAP, cubemap);
 
 		for (auto i = size_t{0}; i < 6; ++i) {
 			chicken3421::image_t image =
@@ -38,7 +39,7 @@ namespace cubemap {
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		gl_state::bind_texture(GL_TEXTURE_CUBE_MAP, 0);
 		return cubemap;
 	}
 } // namespace cubemap
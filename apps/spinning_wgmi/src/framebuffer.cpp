@@ -1,5 +1,6 @@
 #include "framebuffer.hpp"
 #include "texture_2d.hpp"
+#include "gl_state.hpp"
 #include <glad/glad.h>
 
 namespace framebuffer {
@@ -8,13 +9,13 @@ namespace framebuffer {
         GLuint fbo, texture, rbo;
         // make texture
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        gl_state::bind_texture(GL_TEXTURE_2D, texture);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        gl_state::bind_texture(GL_TEXTURE_2D, 0);
 
         // make depth buffer
         glGenRenderbuffers(1, &rbo);
@@ -36,6 +37,8 @@ namespace framebuffer {
         glDeleteFramebuffers(1, &framebuffer.fbo);
         glDeleteRenderbuffers(1, &framebuffer.rbo);
         glDeleteTextures(1, &framebuffer.texture);
+        // deleting a bound texture silently rebinds 0
+        gl_state::invalidate();
     }
 
 } // namespace framebuffer
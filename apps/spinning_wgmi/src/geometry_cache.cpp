@@ -0,0 +1,182 @@
+#include "geometry_cache.hpp"
+#include "shapes.hpp"
+#include "mesh_store.hpp"
+
+#include <glm/ext.hpp>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <unordered_map>
+
+namespace {
+    enum generator_t : std::uint8_t {
+        SPHERE, WGMI_FACE, SPHERE_SKELETON, TORUS, ZERO_CHARACTER,
+    };
+
+    // coarsest tessellation a level of detail is made at
+    const unsigned int MIN_TESSELLATION = 4;
+
+    struct shape_key_t {
+        generator_t generator;
+        unsigned int tessellation;
+        float params[4];
+    };
+
+    struct shape_key_hash_t {
+        size_t operator()(const shape_key_t &key) const {
+            auto hash = std::hash<unsigned int>{}(key.generator * 65599u + key.tessellation);
+            for (auto param: key.params) {
+                hash = hash * 31 + std::hash<float>{}(param);
+            }
+            return hash;
+        }
+    };
+
+    struct shape_key_equal_t {
+        bool operator()(const shape_key_t &a, const shape_key_t &b) const {
+            return a.generator == b.generator && a.tessellation == b.tessellation &&
+                   std::equal(std::begin(a.params), std::end(a.params), std::begin(b.params));
+        }
+    };
+
+    struct entry_t {
+        mesh::mesh_t mesh;
+        int references = 0;
+    };
+
+    std::unordered_map<shape_key_t, entry_t, shape_key_hash_t, shape_key_equal_t> entries;
+
+    float quantize(float value) {
+        return std::round(value * 65536.0f) / 65536.0f;
+    }
+
+    // names the key's file in mesh_store, hashed field by field so padding doesn't count
+    std::uint64_t stored_key(const shape_key_t &key) {
+        auto hash = mesh_store::hash(&key.generator, sizeof(key.generator));
+        hash = mesh_store::hash(&key.tessellation, sizeof(key.tessellation), hash);
+        return mesh_store::hash(key.params, sizeof(key.params), hash);
+    }
+
+    // the mesh of a key, made from the (rounded) parameters in it
+    mesh::mesh_template_t make(const shape_key_t &key) {
+        const auto *params = key.params;
+        switch (key.generator) {
+            case SPHERE:
+                return shapes::make_sphere(1.0f, key.tessellation);
+            case WGMI_FACE:
+                return shapes::make_wgmi_face(1.0f, key.tessellation);
+            case SPHERE_SKELETON:
+                return shapes::make_sphere_skeleton(1.0f, params[0], (unsigned int) params[1], key.tessellation);
+            case TORUS:
+                return shapes::make_torus(1.0f, params[0], (int) key.tessellation, (int) params[1]);
+            case ZERO_CHARACTER:
+            default:
+                return shapes::make_zero_character(params[0], params[1], params[2], key.tessellation,
+                                                   params[3] != 0.0f);
+        }
+    }
+
+    // how far a circle of unit radius cut into segments strays from the circle, at the middle of a segment
+    float sagitta(float segments) {
+        return 1.0f - std::cos(glm::pi<float>() / segments);
+    }
+
+    // how far the key's mesh strays from the shape it approximates, in its own model space
+    float error(const shape_key_t &key) {
+        const auto *params = key.params;
+        switch (key.generator) {
+            case TORUS:
+                // the tube, then the ring it is swept around
+                return std::max(params[0] * sagitta((float) key.tessellation), (1.0f + params[0]) * sagitta(params[1]));
+            case ZERO_CHARACTER:
+                return (params[0] + params[2]) * sagitta((float) key.tessellation);
+            default:
+                return sagitta((float) key.tessellation);
+        }
+    }
+
+    // the key of the next level of detail down, at half the tessellation, or false if the shape can't
+    // be made any coarser
+    bool coarser(shape_key_t &key) {
+        auto tessellation = key.tessellation / 2;
+        // the face's features are laid out in eighths of its tessellation
+        if (key.generator == WGMI_FACE && (tessellation < 8 || tessellation % 8 != 0)) return false;
+        if (tessellation < MIN_TESSELLATION) return false;
+
+        key.tessellation = tessellation;
+        if (key.generator == TORUS) {
+            // the finest torus has far more stacks than its tube needs, coarser ones just enough for the
+            // ring to stray no further than the tube
+            auto ratio = key.params[0];
+            key.params[1] = std::max(3.0f, std::ceil((float) tessellation * std::sqrt((1.0f + ratio) / ratio)));
+        }
+        return true;
+    }
+
+    // the key's mesh, made the first time it is asked for or mapped from mesh_store if an earlier launch
+    // made it
+    const mesh::mesh_t &acquire(const shape_key_t &key) {
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            it = entries.emplace(key, entry_t{mesh_store::load(stored_key(key), [&] { return make(key); }, true)}).first;
+        }
+        ++it->second.references;
+        return it->second.mesh;
+    }
+
+    // the key's mesh and every coarser level of it
+    geometry_cache::cached_mesh_t acquire_chain(shape_key_t key, float scale) {
+        auto cached = geometry_cache::cached_mesh_t{};
+        cached.mesh = acquire(key);
+        cached.scale = scale;
+        while (coarser(key)) {
+            cached.lods.push_back({acquire(key), error(key)});
+        }
+        return cached;
+    }
+} // namespace
+
+namespace geometry_cache {
+    cached_mesh_t sphere(float radius, unsigned int tessellation) {
+        return acquire_chain({SPHERE, tessellation, {}}, radius);
+    }
+
+    cached_mesh_t wgmi_face(float radius, unsigned int tessellation) {
+        return acquire_chain({WGMI_FACE, tessellation, {}}, radius);
+    }
+
+    cached_mesh_t sphere_skeleton(float radius, float angle_thickness, unsigned int slices, unsigned int tessellation) {
+        return acquire_chain({SPHERE_SKELETON, tessellation, {quantize(angle_thickness), (float) slices}}, radius);
+    }
+
+    cached_mesh_t torus(float radius, float thickness, int tessellation) {
+        auto ratio = quantize(thickness / radius);
+        auto stacks = std::ceil(1.0f / ratio) * (float) tessellation;
+        return acquire_chain({TORUS, (unsigned int) tessellation, {ratio, stacks}}, radius);
+    }
+
+    cached_mesh_t zero_character(float radius, float z, float thickness, unsigned int tessellation, bool flip_normals) {
+        return acquire_chain({ZERO_CHARACTER, tessellation,
+                              {quantize(radius), quantize(z), quantize(thickness), flip_normals ? 1.0f : 0.0f}}, 1.0f);
+    }
+
+    bool release(const mesh::mesh_t &mesh) {
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            auto &cached = it->second.mesh;
+            if (cached.vao != mesh.vao || cached.first_index != mesh.first_index ||
+                cached.base_vertex != mesh.base_vertex) {
+                continue;
+            }
+            if (--it->second.references == 0) {
+                mesh::destroy(cached);
+                entries.erase(it);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    size_t size() {
+        return entries.size();
+    }
+} // namespace geometry_cache
@@ -0,0 +1,191 @@
+#include "geometry_pool.hpp"
+#include "gl_state.hpp"
+#include "arena.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+    const GLsizei MIN_VERTEX_CAPACITY = 1 << 16;
+    const GLsizei MIN_INDEX_CAPACITY = 1 << 17;
+
+    struct range_t {
+        GLsizei offset;
+        GLsizei size;
+    };
+
+    // vertices of one layout interleaved in a single buffer (see vertex_layout), indices of one type
+    struct pool_t {
+        GLuint vao = 0;
+        GLuint vbo = 0;
+        GLuint ebo = 0;
+        GLsizei vertex_capacity = 0;
+        GLsizei index_capacity = 0;
+        std::vector<range_t> free_vertices; // sorted by offset, never adjacent
+        std::vector<range_t> free_indices;
+    };
+
+    pool_t short_pools[vertex_layout::ATTRIBUTE_SETS];
+    pool_t int_pools[vertex_layout::ATTRIBUTE_SETS];
+
+    pool_t &pool_for(std::uint32_t format, GLenum index_type) {
+        return index_type == GL_UNSIGNED_SHORT ? short_pools[format] : int_pools[format];
+    }
+
+    // copy a buffer into a bigger one, deleting the old one
+    GLuint grow_buffer(GLuint old_buffer, GLsizeiptr old_size, GLsizeiptr new_size) {
+        GLuint buffer = 0;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, new_size, nullptr, GL_STATIC_DRAW);
+        if (old_buffer) {
+            glBindBuffer(GL_COPY_READ_BUFFER, old_buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+            glDeleteBuffers(1, &old_buffer);
+        }
+        return buffer;
+    }
+
+    void release(std::vector<range_t> &free_list, range_t range) {
+        auto it = std::lower_bound(free_list.begin(), free_list.end(), range,
+                                   [](const range_t &a, const range_t &b) { return a.offset < b.offset; });
+        it = free_list.insert(it, range);
+        // merge with the following and preceding ranges if they touch
+        auto next = it + 1;
+        if (next != free_list.end() && it->offset + it->size == next->offset) {
+            it->size += next->size;
+            free_list.erase(next);
+        }
+        if (it != free_list.begin()) {
+            auto prev = it - 1;
+            if (prev->offset + prev->size == it->offset) {
+                prev->size += it->size;
+                free_list.erase(it);
+            }
+        }
+    }
+
+    // first fit, returns -1 if nothing is big enough
+    GLsizei take(std::vector<range_t> &free_list, GLsizei size) {
+        for (auto it = free_list.begin(); it != free_list.end(); ++it) {
+            if (it->size < size) continue;
+            auto offset = it->offset;
+            it->offset += size;
+            it->size -= size;
+            if (it->size == 0) free_list.erase(it);
+            return offset;
+        }
+        return -1;
+    }
+
+    void grow_vertices(pool_t &pool, const vertex_layout::descriptor_t &layout, GLsizei needed) {
+        auto capacity = std::max({MIN_VERTEX_CAPACITY, pool.vertex_capacity * 2, pool.vertex_capacity + needed});
+        pool.vbo = grow_buffer(pool.vbo, pool.vertex_capacity * (GLsizeiptr) layout.stride,
+                               capacity * (GLsizeiptr) layout.stride);
+        gl_state::bind_vertex_array(pool.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vbo);
+        layout.set_attributes(0);
+        release(pool.free_vertices, {pool.vertex_capacity, capacity - pool.vertex_capacity});
+        pool.vertex_capacity = capacity;
+    }
+
+    void grow_indices(pool_t &pool, GLsizeiptr index_size, GLsizei needed) {
+        auto capacity = std::max({MIN_INDEX_CAPACITY, pool.index_capacity * 2, pool.index_capacity + needed});
+        pool.ebo = grow_buffer(pool.ebo, pool.index_capacity * index_size, capacity * index_size);
+        // the element buffer binding is VAO state
+        gl_state::bind_vertex_array(pool.vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.ebo);
+        release(pool.free_indices, {pool.index_capacity, capacity - pool.index_capacity});
+        pool.index_capacity = capacity;
+    }
+
+    void upload_range(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data) {
+        if (!size) return;
+        // the copy target leaves array and element bindings (and so any bound VAO) alone
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+    }
+} // namespace
+
+namespace geometry_pool {
+    GLenum index_type_for(GLsizei vertex_count, GLenum primitive) {
+        auto max_vertices = primitive == GL_TRIANGLE_STRIP ? MAX_SHORT_INDEXED_VERTICES - 1 : MAX_SHORT_INDEXED_VERTICES;
+        return vertex_count <= max_vertices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    }
+
+    mesh::packed_mesh_t pack(const mesh::mesh_template_t &mesh_template, const bounds::aabb_t &box, bool quantize) {
+        auto packed = mesh::packed_mesh_t{};
+        packed.attributes = vertex_layout::attributes_of(mesh_template, quantize);
+        const auto &layout = vertex_layout::describe(packed.attributes);
+        packed.vertex_count = (GLsizei) mesh_template.positions.size();
+        auto &scratch = arena::scratch();
+
+        const auto *indices = mesh_template.indices.data();
+        packed.index_count = (GLsizei) mesh_template.indices.size();
+        if (mesh_template.indices.empty()) {
+            auto *sequential = static_cast<GLuint *>(
+                    arena::allocate(scratch, mesh_template.positions.size() * sizeof(GLuint), alignof(GLuint)));
+            for (auto i = size_t{0}; i < mesh_template.positions.size(); ++i) {
+                sequential[i] = (GLuint) i;
+            }
+            indices = sequential;
+            packed.index_count = packed.vertex_count;
+        }
+        packed.primitive = mesh_template.primitive;
+        packed.triangle_count = mesh::triangle_count(mesh_template);
+        packed.index_type = index_type_for(packed.vertex_count, packed.primitive);
+        packed.indices = indices;
+        if (packed.index_type == GL_UNSIGNED_SHORT) {
+            auto *short_indices = static_cast<GLushort *>(
+                    arena::allocate(scratch, packed.index_count * sizeof(GLushort), alignof(GLushort)));
+            // truncating keeps RESTART_INDEX all ones
+            std::copy(indices, indices + packed.index_count, short_indices);
+            packed.indices = short_indices;
+        }
+
+        auto *vertices = static_cast<unsigned char *>(
+                arena::allocate(scratch, (size_t) packed.vertex_count * layout.stride));
+        layout.write(mesh_template, box, vertices);
+        packed.vertices = vertices;
+        return packed;
+    }
+
+    allocation_t upload(const mesh::packed_mesh_t &packed) {
+        auto allocation = allocation_t{};
+        allocation.format = packed.attributes;
+        allocation.vertex_count = packed.vertex_count;
+        allocation.index_count = packed.index_count;
+        allocation.index_type = packed.index_type;
+        const auto &layout = vertex_layout::describe(allocation.format);
+        auto index_size = mesh::index_size(allocation.index_type);
+
+        auto &pool = pool_for(allocation.format, allocation.index_type);
+        if (!pool.vao) glGenVertexArrays(1, &pool.vao);
+
+        auto base_vertex = take(pool.free_vertices, allocation.vertex_count);
+        if (base_vertex < 0) {
+            grow_vertices(pool, layout, allocation.vertex_count);
+            base_vertex = take(pool.free_vertices, allocation.vertex_count);
+        }
+        auto first_index = take(pool.free_indices, allocation.index_count);
+        if (first_index < 0) {
+            grow_indices(pool, index_size, allocation.index_count);
+            first_index = take(pool.free_indices, allocation.index_count);
+        }
+        allocation.vao = pool.vao;
+        allocation.base_vertex = base_vertex;
+        allocation.first_index = (GLuint) first_index;
+
+        upload_range(pool.vbo, base_vertex * (GLintptr) layout.stride,
+                     allocation.vertex_count * (GLsizeiptr) layout.stride, packed.vertices);
+        upload_range(pool.ebo, first_index * index_size, allocation.index_count * index_size, packed.indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return allocation;
+    }
+
+    void free(const allocation_t &allocation) {
+        auto &pool = pool_for(allocation.format, allocation.index_type);
+        if (allocation.vertex_count) release(pool.free_vertices, {allocation.base_vertex, allocation.vertex_count});
+        if (allocation.index_count) release(pool.free_indices, {(GLsizei) allocation.first_index, allocation.index_count});
+    }
+} // namespace geometry_pool
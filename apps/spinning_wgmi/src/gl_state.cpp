@@ -0,0 +1,188 @@
+#include "gl_state.hpp"
+
+#include <vector>
+#include <utility>
+
+namespace {
+    const GLuint UNKNOWN = ~0u;
+    const GLuint MAX_TEXTURE_UNITS = 16;
+    const GLuint MAX_UNIFORM_BINDINGS = 16;
+
+    struct texture_unit_t {
+        GLuint texture_2d = UNKNOWN;
+        GLuint cube_map = UNKNOWN;
+    };
+
+    struct buffer_range_t {
+        GLuint buffer = UNKNOWN;
+        GLintptr offset = 0;
+        GLsizeiptr size = 0;
+    };
+
+    struct state_t {
+        GLuint program = UNKNOWN;
+        GLuint vao = UNKNOWN;
+        GLuint active_unit = UNKNOWN;
+        texture_unit_t units[MAX_TEXTURE_UNITS];
+        buffer_range_t uniform_ranges[MAX_UNIFORM_BINDINGS];
+        std::vector<std::pair<GLenum, bool>> caps; // only the handful of caps we toggle
+        bool polygon_offset_known = false;
+        float polygon_offset_factor = 0.0f;
+        float polygon_offset_units = 0.0f;
+        GLenum polygon_mode = GL_NONE;
+        GLenum blend_src = GL_NONE;
+        GLenum blend_dst = GL_NONE;
+        int depth_mask = -1;
+        GLenum front_face = GL_NONE;
+        // 0 is only GL's initial value, invalidate resets to this when the index may be anything
+        GLuint restart_index = 0;
+        bool restart_index_known = false;
+    };
+
+    state_t state;
+    gl_state::stats_t counters;
+
+    // returns true if the call has to be issued
+    template<typename T>
+    bool update(T &cached, const T &value) {
+        if (cached == value) {
+            ++counters.skipped;
+            return false;
+        }
+        cached = value;
+        ++counters.issued;
+        return true;
+    }
+
+    GLuint &texture_slot(GLuint unit, GLenum target) {
+        auto &slots = state.units[unit];
+        return target == GL_TEXTURE_CUBE_MAP ? slots.cube_map : slots.texture_2d;
+    }
+} // namespace
+
+namespace gl_state {
+    void use_program(GLuint program) {
+        if (update(state.program, program)) glUseProgram(program);
+    }
+
+    void bind_vertex_array(GLuint vao) {
+        if (update(state.vao, vao)) glBindVertexArray(vao);
+    }
+
+    void active_texture(GLuint unit) {
+        if (update(state.active_unit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    void bind_texture(GLenum target, GLuint texture) {
+        if (state.active_unit >= MAX_TEXTURE_UNITS) {
+            // unknown unit, nothing to compare against
+            ++counters.issued;
+            glBindTexture(target, texture);
+            return;
+        }
+        if (update(texture_slot(state.active_unit, target), texture)) glBindTexture(target, texture);
+    }
+
+    void bind_texture_unit(GLuint unit, GLenum target, GLuint texture) {
+        if (unit < MAX_TEXTURE_UNITS && texture_slot(unit, target) == texture) {
+            ++counters.skipped;
+            return;
+        }
+        active_texture(unit);
+        bind_texture(target, texture);
+    }
+
+    void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+        if (target != GL_UNIFORM_BUFFER || index >= MAX_UNIFORM_BINDINGS) {
+            ++counters.issued;
+            glBindBufferRange(target, index, buffer, offset, size);
+            return;
+        }
+        auto &range = state.uniform_ranges[index];
+        if (range.buffer == buffer && range.offset == offset && range.size == size) {
+            ++counters.skipped;
+            return;
+        }
+        range = {buffer, offset, size};
+        ++counters.issued;
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+
+    void set_enabled(GLenum cap, bool enabled) {
+        for (auto &c: state.caps) {
+            if (c.first == cap) {
+                if (update(c.second, enabled)) enabled ? glEnable(cap) : glDisable(cap);
+                return;
+            }
+        }
+        state.caps.emplace_back(cap, enabled);
+        ++counters.issued;
+        enabled ? glEnable(cap) : glDisable(cap);
+    }
+
+    void enable(GLenum cap) {
+        set_enabled(cap, true);
+    }
+
+    void disable(GLenum cap) {
+        set_enabled(cap, false);
+    }
+
+    void primitive_restart_index(GLuint index) {
+        if (state.restart_index_known && state.restart_index == index) {
+            ++counters.skipped;
+            return;
+        }
+        state.restart_index_known = true;
+        state.restart_index = index;
+        ++counters.issued;
+        glPrimitiveRestartIndex(index);
+    }
+
+    void polygon_offset(float factor, float units) {
+        if (state.polygon_offset_known && state.polygon_offset_factor == factor && state.polygon_offset_units == units) {
+            ++counters.skipped;
+            return;
+        }
+        state.polygon_offset_known = true;
+        state.polygon_offset_factor = factor;
+        state.polygon_offset_units = units;
+        ++counters.issued;
+        glPolygonOffset(factor, units);
+    }
+
+    void polygon_mode(GLenum mode) {
+        if (update(state.polygon_mode, mode)) glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+
+    void blend_func(GLenum src, GLenum dst) {
+        if (state.blend_src == src && state.blend_dst == dst) {
+            ++counters.skipped;
+            return;
+        }
+        state.blend_src = src;
+        state.blend_dst = dst;
+        ++counters.issued;
+        glBlendFunc(src, dst);
+    }
+
+    void depth_mask(bool write) {
+        if (update(state.depth_mask, (int) write)) glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void front_face(GLenum mode) {
+        if (update(state.front_face, mode)) glFrontFace(mode);
+    }
+
+    void invalidate() {
+        state = state_t{};
+    }
+
+    const stats_t &stats() {
+        return counters;
+    }
+
+    void reset_stats() {
+        counters = stats_t{};
+    }
+} // namespace gl_state
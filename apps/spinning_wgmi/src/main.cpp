@@ -8,6 +8,7 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <chrono>
 
 #include <chicken3421/chicken3421.hpp>
 
@@ -17,6 +18,10 @@
 #include "memes.hpp"
 #include "renderer.hpp"
 #include "framebuffer.hpp"
+#include "mesh_optimizer.hpp"
+#include "benchmark.hpp"
+#include "geometry_cache.hpp"
+#include "mesh_store.hpp"
 
 const int SCR_WIDTH = 1280;
 const int SCR_HEIGHT = 720;
@@ -33,17 +38,54 @@ namespace {
     }
 } // namespace
 
-scene::node_t make_shape(mesh::mesh_template_t temp) {
-    auto shape = scene::node_t{};
-    shape.model.meshes.push_back(mesh::init(temp));
+scene::node_handle_t make_shape(scene::scene_t &scene, scene::node_handle_t parent,
+                                const geometry_cache::cached_mesh_t &shape_mesh) {
+    auto shape = model::model_t{};
+    shape.meshes.push_back(shape_mesh.mesh);
+    shape.lods.push_back(shape_mesh.lods);
     auto shape_mat = model::material_t{};
     shape_mat.diffuse = glm::vec4(0,0,0,1);
     shape_mat.specular = glm::vec3(0);
-    shape.model.materials.push_back(shape_mat);
-    return shape;
+    shape.materials.push_back(shape_mat);
+    auto node = scene::add_node(scene, parent, scene::add_model(scene, shape));
+    scene::set_scale(scene, node, glm::vec3(shape_mesh.scale));
+    return node;
 }
 
-int main() {
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string(argv[1]) == "--mesh-report") {
+        mesh_optimizer::report(std::cout);
+        return EXIT_SUCCESS;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-shapes") {
+        benchmark::shapes(std::cout);
+        return EXIT_SUCCESS;
+    }
+    // the OBJs named after it, or a generated stand-in if there are none
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-normals") {
+        benchmark::normals(std::cout, std::vector<std::string>(argv + 2, argv + argc));
+        return EXIT_SUCCESS;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--quantization-report") {
+        benchmark::quantization(std::cout, std::vector<std::string>(argv + 2, argv + argc));
+        return EXIT_SUCCESS;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-clusters") {
+        benchmark::clusters(std::cout, std::vector<std::string>(argv + 2, argv + argc));
+        return EXIT_SUCCESS;
+    }
+    // start cold, building every mesh as if for the first time
+    if (argc > 1 && std::string(argv[1]) == "--clear-mesh-cache") {
+        mesh_store::clear();
+    }
+    // the outer ring breathes, rewritten into the stream buffer every frame instead of cached
+    bool dynamic_ring = argc > 1 && std::string(argv[1]) == "--dynamic-ring";
+    // the head's frame is tori made in the vertex shader, see procedural.hpp
+    bool procedural_head = argc > 1 && std::string(argv[1]) == "--procedural-head";
+    // an OBJ spinning inside the head, everything drawn filled so its clusters facing away are culled too
+    auto model_path = std::string{};
+    if (argc > 2 && std::string(argv[1]) == "--model") model_path = argv[2];
+
 #ifndef __APPLE__
     chicken3421::enable_debug_output();
 #endif
@@ -57,57 +99,121 @@ int main() {
     auto renderer = renderer::init(
             glm::perspective(glm::radians(60.0), (double) SCR_WIDTH / (double) SCR_HEIGHT, 0.1, 1000.0));
 //    glm::ortho(-aspect,aspect,-1.0f,1.0f, 0.1f, 1000.0f));
+    renderer.viewport_height = (float) SCR_HEIGHT;
 
+    auto scene_start = std::chrono::steady_clock::now();
     float radius = 1.0f;
     float angle_thickness = glm::radians(5.0f);
     float thickness = radius * angle_thickness;
 
-    auto head_frame = make_shape(shapes::make_sphere_skeleton(radius, angle_thickness, 8));
-    head_frame.clipping = true;
-    auto face = make_shape(shapes::make_wgmi_face(radius - thickness + 0.01));
-    face.clipping = true;
-    face.rainbow_colors = true;
-    face.color_offset = radius;
-
-    auto face_tex = make_shape(shapes::make_wgmi_face(radius - thickness - 0.01));
-    face_tex.clipping = true;
-//    auto face = make_shape(shapes::make_sphere(radius + thickness));
-    face_tex.model.materials[0].diffuse_map = texture_2d::init("res/textures/wgmi/wgmi_face_sleep.png");
+    auto scene = scene::scene_t{};
+    auto root = scene::add_node(scene, scene::NO_NODE);
+    auto head = scene::add_node(scene, root);
+//    scene::set_rotation(scene, head, glm::angleAxis(-glm::pi<float>() / 2, glm::vec3(0, 1, 0)));
+
+    // rainbow colours are worked out in model space, where cached meshes are shrunk by their scale
+    if (procedural_head) {
+        scene::make_wgmi_head(scene, head, radius, thickness, true);
+    } else {
+        auto head_frame = make_shape(scene, head, geometry_cache::sphere_skeleton(radius, angle_thickness, 8));
+        scene::set_flag(scene, head_frame, scene::CLIPPING, true);
+    }
+    auto face_mesh = geometry_cache::wgmi_face(radius - thickness + 0.01);
+    auto face = make_shape(scene, head, face_mesh);
+    scene::set_flag(scene, face, scene::CLIPPING, true);
+    scene::set_flag(scene, face, scene::RAINBOW_COLORS, true);
+    scene::set_color_offset(scene, face, radius / face_mesh.scale);
+
+    auto face_tex = make_shape(scene, head, geometry_cache::wgmi_face(radius - thickness - 0.01));
+    scene::set_flag(scene, face_tex, scene::CLIPPING, true);
+//    auto face = make_shape(scene, head, shapes::make_sphere(radius + thickness));
+    scene::get_model(scene, face_tex).materials[0].diffuse_map = texture_2d::init("res/textures/wgmi/wgmi_face_sleep.png");
     auto awake_tex = texture_2d::init("res/textures/wgmi/wgmi_face_awake.png");
 
-    auto head = scene::node_t{};
-    head.children.push_back(head_frame);
-    head.children.push_back(face);
-    head.children.push_back(face_tex);
-//    head.rotation.y = -M_PI/2;
+    auto ring_template = mesh::mesh_template_t{};
+    auto outer_ring_mesh = geometry_cache::cached_mesh_t{};
+    if (dynamic_ring) {
+        // it never grows past radius, so the bounds it was made with hold
+        ring_template = shapes::make_zero_character(radius, 0, thickness);
+        outer_ring_mesh.mesh = mesh::init(ring_template, GL_DYNAMIC_DRAW);
+    } else {
+        outer_ring_mesh = geometry_cache::zero_character(radius, 0, thickness);
+    }
+    auto outer_ring = make_shape(scene, root, outer_ring_mesh);
+    if (dynamic_ring) scene::get_model(scene, outer_ring).templates.push_back(&ring_template);
+    scene::set_flag(scene, outer_ring, scene::RAINBOW_COLORS, true);
+    scene::set_color_offset(scene, outer_ring, radius / outer_ring_mesh.scale);
+//    scene::set_color_rotation(scene, outer_ring, glm::angleAxis(glm::pi<float>() / 2, glm::vec3(0, 1, 0)));
+
+    if (!model_path.empty()) {
+        auto obj = model::load(model_path);
+        auto extent = obj.aabb.max - obj.aabb.min;
+        auto scale = (radius - thickness) / std::max({extent.x, extent.y, extent.z});
+        auto center = (obj.aabb.min + obj.aabb.max) * 0.5f;
+        auto obj_node = scene::add_node(scene, head, scene::add_model(scene, obj));
+        scene::set_translation(scene, obj_node, -center * scale);
+        scene::set_scale(scene, obj_node, glm::vec3(scale));
+        // OBJs bring no vertex colours
+        scene::set_flag(scene, obj_node, scene::RAINBOW_COLORS, true);
+        renderer.polygon_mode = GL_FILL;
+    }
 
-    auto outer_ring = make_shape(shapes::make_zero_character(radius, 0, thickness));
-    outer_ring.rainbow_colors = true;
-    outer_ring.color_offset = radius;
-//    outer_ring.color_rotation.y = M_PI/2;
+    renderer::upload_materials(renderer, scene);
 
-    auto scene = scene::node_t{};
-    scene.children.push_back(head);
-    scene.children.push_back(outer_ring);
+    // cold starts build and store their meshes, warm ones map them from the store
+    std::chrono::duration<double, std::milli> scene_ms = std::chrono::steady_clock::now() - scene_start;
+    const auto &stored = mesh_store::stats();
+    std::cout << "scene ready in " << std::fixed << std::setprecision(3) << scene_ms.count() << " ms ("
+              << (stored.built ? "cold" : "warm") << "): "
+              << stored.mapped << " mesh files mapped in " << stored.mapped_ms << " ms, "
+              << stored.built << " built and stored in " << stored.built_ms << " ms" << std::endl;
 
     float start_time = glfwGetTime();
     bool end = false;
+    double title_time = start_time;
+    double cpu_ms = 0.0;
+    int frames = 0;
+    float rot = 0.0f;
     while (!glfwWindowShouldClose(window)) {
         auto dt = (float) time_delta();
 //        euler_camera::update_camera(camera, window, dt);
 
-        float rot = scene.children[0].rotation.y;
         float delta_rot;
-        if(rot > 3.0f * M_PI) scene.children[0].children[2].model.materials[0].diffuse_map = awake_tex;
+        if(rot > 3.0f * M_PI) scene::get_model(scene, face_tex).materials[0].diffuse_map = awake_tex;
         if(rot > 3.5f * M_PI) {
             delta_rot = (dt * -glm::sin(rot));
         } else delta_rot = dt;
-        scene.children[0].rotation.y += delta_rot;
-        scene.children[1].color_rotation.y -= delta_rot;
-        scene.children[2].color_rotation.y -= delta_rot;
+        rot += delta_rot;
+        scene::set_rotation(scene, head, glm::angleAxis(rot, glm::vec3(0, 1, 0)));
+        scene::set_color_rotation(scene, outer_ring, glm::angleAxis(-rot, glm::vec3(0, 1, 0)));
+        if (dynamic_ring) {
+            auto breath = 0.95f + 0.05f * glm::cos(4.0f * rot);
+            ring_template = shapes::make_zero_character(radius * breath, 0, thickness);
+        }
+        scene::update(scene);
 
         renderer::render(renderer, camera, scene);
 
+        // show the average CPU time spent submitting a frame, refreshed every second
+        cpu_ms += renderer.stats.cpu_ms;
+        ++frames;
+        if (glfwGetTime() - title_time >= 1.0) {
+            auto title = std::stringstream{};
+            title << WIN_TITLE << " | cpu " << std::fixed << std::setprecision(3) << cpu_ms / frames << " ms"
+                  << " | draws " << renderer.stats.draw_calls << ", batches " << renderer.stats.batches
+                  << " for " << renderer.stats.draw_items << " meshes, " << renderer.stats.triangles << " triangles"
+                  << " | nodes " << renderer.stats.nodes_visible << " visible, "
+                  << renderer.stats.nodes_culled << " culled"
+                  << " | clusters " << renderer.stats.clusters_visible << " visible, "
+                  << renderer.stats.clusters_culled << " culled"
+                  << " | state calls " << renderer.stats.state_calls.issued << " issued, "
+                  << renderer.stats.state_calls.skipped << " skipped";
+            glfwSetWindowTitle(window, title.str().c_str());
+            title_time = glfwGetTime();
+            cpu_ms = 0.0;
+            frames = 0;
+        }
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
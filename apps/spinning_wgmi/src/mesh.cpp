@@ -1,130 +1,213 @@
 #include "../include/mesh.hpp"
+#include "../include/gl_state.hpp"
+#include "../include/geometry_pool.hpp"
+#include "../include/vertex_layout.hpp"
+#include "../include/mesh_optimizer.hpp"
+#include "../include/arena.hpp"
+#include "../include/stream_buffer.hpp"
 
 #include <iostream>
+#include <chicken3421/chicken3421.hpp>
+#include <algorithm>
+#include <cstddef>
 
 namespace mesh {
 
-	// helper function - assumes ebo and vbo are already bound
-	void init_data(const mesh_template_t& mesh_template, GLenum usage) {
-		if (!mesh_template.indices.empty()) {
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, // target
-			             (GLsizeiptr)(mesh_template.indices.size() * sizeof(GLuint)), // num bytes in
-			                                                                          // the data
-			             &mesh_template.indices[0], // pointer to the actual data
-			             usage);
-		}
+	// helper function - write the template into this frame's stream region and point the mesh at it
+	void stream(mesh_t& mesh, const mesh_template_t& mesh_template) {
+		auto allocation = stream_buffer::write(mesh_template);
+		mesh.vao = allocation.vao;
+		mesh.indices_count = allocation.index_count;
+		mesh.first_index = allocation.first_index;
+		mesh.base_vertex = allocation.base_vertex;
+		mesh.index_type = allocation.index_type;
+		mesh.vertex_count = allocation.vertex_count;
+		mesh.primitive = mesh_template.primitive;
+		mesh.primitive_restart = mesh_template.primitive == GL_TRIANGLE_STRIP;
+		mesh.triangle_count = triangle_count(mesh_template);
+		mesh.aabb = bounds::from_points(mesh_template.positions);
+		mesh.sphere = bounds::bounding_sphere(mesh_template.positions, mesh.aabb);
+	}
 
-		size_t positions_size = mesh_template.positions.size() * sizeof(glm::vec3);
-		size_t colors_size = mesh_template.colors.size() * sizeof(glm::vec3);
-		size_t tex_coords_size = mesh_template.tex_coords.size() * sizeof(glm::vec2);
-		size_t normals_size = mesh_template.normals.size() * sizeof(glm::vec3);
-		size_t data_size = positions_size + colors_size + tex_coords_size + normals_size;
-
-		// create buffer and fill with our line data
-		glBufferData(GL_ARRAY_BUFFER, data_size, nullptr, usage);
-
-		size_t offset = 0;
-		glBufferSubData(GL_ARRAY_BUFFER, offset, positions_size, &mesh_template.positions[0].x);
-		offset += positions_size;
-		if (colors_size) {
-			glBufferSubData(GL_ARRAY_BUFFER, offset, colors_size, &mesh_template.colors[0].x);
-			offset += colors_size;
-		}
-		if (tex_coords_size) {
-			glBufferSubData(GL_ARRAY_BUFFER, offset, tex_coords_size, &mesh_template.tex_coords[0].x);
-			offset += tex_coords_size;
-		}
-		if (normals_size) {
-			glBufferSubData(GL_ARRAY_BUFFER, offset, normals_size, &mesh_template.normals[0].x);
-			offset += normals_size;
+	mesh_t init(mesh_template_t&& mesh_template, GLenum usage, bool quantize) {
+		if (usage != GL_STATIC_DRAW) {
+			return init(static_cast<const mesh_template_t&>(mesh_template), usage);
 		}
+
+		auto& scratch = arena::scratch();
+		auto mark = arena::mark(scratch);
+		auto mesh = init(pack(std::move(mesh_template), quantize));
+		arena::rewind(scratch, mark);
+		return mesh;
 	}
 
-	mesh_t init(const mesh_template_t& mesh_template, GLenum usage) {
-		mesh_t mesh;
+	packed_mesh_t pack(mesh_template_t&& mesh_template, bool quantize) {
+		// bounds cover every vertex given, including any the optimizer drops
+		auto aabb = bounds::from_points(mesh_template.positions);
+		auto sphere = bounds::bounding_sphere(mesh_template.positions, aabb);
+
+		mesh_optimizer::optimize(mesh_template);
+		auto packed = geometry_pool::pack(mesh_template, aabb, quantize);
+		packed.aabb = aabb;
+		packed.sphere = sphere;
+		return packed;
+	}
 
-		glGenVertexArrays(1, &mesh.vao);
-		glBindVertexArray(mesh.vao);
+	mesh_t init(const packed_mesh_t& packed) {
+		mesh_t mesh;
+		mesh.aabb = packed.aabb;
+		mesh.sphere = packed.sphere;
+
+		auto allocation = geometry_pool::upload(packed);
+		mesh.vao = allocation.vao;
+		mesh.indices_count = allocation.index_count;
+		mesh.pool_format = (int)allocation.format;
+		mesh.first_index = allocation.first_index;
+		mesh.base_vertex = allocation.base_vertex;
+		mesh.index_type = allocation.index_type;
+		mesh.vertex_count = allocation.vertex_count;
+		mesh.primitive = packed.primitive;
+		mesh.primitive_restart = packed.primitive == GL_TRIANGLE_STRIP;
+		mesh.triangle_count = packed.triangle_count;
+		return mesh;
+	}
 
-		bool has_indices = !mesh_template.indices.empty();
-		mesh.indices_count =
-		   (GLsizei)(has_indices ? mesh_template.indices.size() : mesh_template.positions.size());
-		if (has_indices) {
-			glGenBuffers(1, &mesh.ebo);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+	mesh_t init(const mesh_template_t& mesh_template, GLenum usage, bool quantize) {
+		if (usage == GL_STATIC_DRAW) {
+			// the optimizer reorders in place, so it gets a copy
+			return init(mesh_template_t(mesh_template), usage, quantize);
 		}
 
-		glGenBuffers(1, &mesh.vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
-
-		init_data(mesh_template, usage);
+		mesh_t mesh;
+		stream(mesh, mesh_template);
+		return mesh;
+	}
 
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	GLsizeiptr index_size(GLenum index_type) {
+		return index_type == GL_UNSIGNED_SHORT ? (GLsizeiptr)sizeof(GLushort) : (GLsizeiptr)sizeof(GLuint);
+	}
 
-		GLuint attrib_index = 1;
-		size_t offset = mesh_template.positions.size() * sizeof(glm::vec3);
+	GLuint restart_index(GLenum index_type) {
+		return index_type == GL_UNSIGNED_SHORT ? (GLuint)0xffff : RESTART_INDEX;
+	}
 
-		if (!mesh_template.colors.empty()) {
-			glEnableVertexAttribArray(attrib_index);
-			glVertexAttribPointer(attrib_index, 3, GL_FLOAT, GL_FALSE, 0, (void*)offset);
-			offset += mesh_template.colors.size() * sizeof(glm::vec3);
+	GLsizei triangle_count(const mesh_template_t& mesh_template) {
+		const auto& indices = mesh_template.indices;
+		auto count = indices.empty() ? mesh_template.positions.size() : indices.size();
+		if (mesh_template.primitive != GL_TRIANGLE_STRIP) return (GLsizei)(count / 3);
+		if (indices.empty()) return (GLsizei)std::max(count, (size_t)2) - 2;
+
+		// every strip of n indices makes n - 2 triangles
+		auto triangles = size_t{0};
+		auto strip = size_t{0};
+		for (auto index : indices) {
+			if (index == RESTART_INDEX) {
+				triangles += std::max(strip, (size_t)2) - 2;
+				strip = 0;
+			} else {
+				++strip;
+			}
 		}
-		++attrib_index;
+		return (GLsizei)(triangles + std::max(strip, (size_t)2) - 2);
+	}
 
-		if (!mesh_template.tex_coords.empty()) {
-			glEnableVertexAttribArray(attrib_index);
-			glVertexAttribPointer(attrib_index, 2, GL_FLOAT, GL_FALSE, 0, (void*)offset);
-			offset += mesh_template.tex_coords.size() * sizeof(glm::vec2);
-		}
-		++attrib_index;
+	void set_primitive_restart(const mesh_t& mesh) {
+		gl_state::set_enabled(GL_PRIMITIVE_RESTART, mesh.primitive_restart);
+		if (mesh.primitive_restart) gl_state::primitive_restart_index(restart_index(mesh.index_type));
+	}
 
-		if (!mesh_template.normals.empty()) {
-			glEnableVertexAttribArray(attrib_index);
-			glVertexAttribPointer(attrib_index, 3, GL_FLOAT, GL_FALSE, 0, (void*)offset);
-			offset += mesh_template.normals.size() * sizeof(glm::vec3);
-		}
-		++attrib_index;
+	bool operator==(shape_t const& a, shape_t const& b) {
+		return a.kind == b.kind && a.columns == b.columns && a.rows == b.rows && a.radius == b.radius &&
+		       a.thickness == b.thickness && a.start_angle == b.start_angle && a.end_angle == b.end_angle;
+	}
 
-		glBindVertexArray(0);
-		return mesh;
+	void draw(const mesh_t& mesh) {
+		// the vao is left bound, gl_state skips rebinding it for the next draw of the same vao
+		gl_state::bind_vertex_array(mesh.vao);
+		if (mesh.shape.kind) {
+			glDrawArrays(mesh.primitive, 0, mesh.indices_count);
+			return;
+		}
+		set_primitive_restart(mesh);
+		glDrawElementsBaseVertex(mesh.primitive, mesh.indices_count, mesh.index_type,
+		                         (void*)(mesh.first_index * index_size(mesh.index_type)), mesh.base_vertex);
 	}
 
-	void draw(const mesh_t& mesh, GLenum draw_mode) {
-		glBindVertexArray(mesh.vao);
-		if (mesh.ebo) {
-			glDrawElements(draw_mode, mesh.indices_count, GL_UNSIGNED_INT, nullptr);
+	void bind_instances(GLuint vao, GLuint instance_buffer, GLsizei first) {
+		gl_state::bind_vertex_array(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+
+		auto stride = (GLsizei) sizeof(instance_t);
+		auto base = (size_t) first * sizeof(instance_t);
+		GLuint location = INSTANCE_ATTRIB_LOCATION;
+		for (int column = 0; column < 4; ++column, ++location) {
+			glEnableVertexAttribArray(location);
+			glVertexAttribDivisor(location, 1);
+			glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride,
+			                      (void*)(base + offsetof(instance_t, model) + column * sizeof(glm::vec4)));
 		}
-		else {
-			glDrawArrays(draw_mode, 0, mesh.indices_count);
+		for (int column = 0; column < 3; ++column, ++location) {
+			glEnableVertexAttribArray(location);
+			glVertexAttribDivisor(location, 1);
+			glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride,
+			                      (void*)(base + offsetof(instance_t, color_rotation) + column * sizeof(glm::vec3)));
 		}
-		glBindVertexArray(0);
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(instance_t, rainbow)));
 	}
 
-	void dynamic_draw(mesh_t& mesh, const mesh_template_t& mesh_template, GLenum draw_mode) {
-		glBindVertexArray(mesh.vao);
-		glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
-
-		init_data(mesh_template, GL_DYNAMIC_DRAW);
+	void draw_instanced(const mesh_t& mesh, GLuint instance_buffer, GLsizei first, GLsizei count) {
+		// GL 3.3 has no base instance, so point the instance attributes at the first instance instead
+		bind_instances(mesh.vao, instance_buffer, first);
 
-		bool has_indices = !mesh_template.indices.empty();
-		mesh.indices_count =
-		   (GLsizei)(has_indices ? mesh_template.indices.size() : mesh_template.positions.size());
-
-		if (mesh.ebo) {
-			glDrawElements(draw_mode, mesh.indices_count, GL_UNSIGNED_INT, nullptr);
+		if (mesh.shape.kind) {
+			glDrawArraysInstanced(mesh.primitive, 0, mesh.indices_count, count);
+			return;
 		}
-		else {
-			glDrawArrays(draw_mode, 0, mesh.indices_count);
+		set_primitive_restart(mesh);
+		glDrawElementsInstancedBaseVertex(mesh.primitive, mesh.indices_count, mesh.index_type,
+		                                  (void*)(mesh.first_index * index_size(mesh.index_type)), count,
+		                                  mesh.base_vertex);
+	}
+
+	void draw_ranges(const mesh_t& mesh, GLuint instance_buffer, GLsizei instance, const GLuint* first_indices,
+	                 const GLsizei* index_counts, GLsizei range_count) {
+		bind_instances(mesh.vao, instance_buffer, instance);
+		set_primitive_restart(mesh);
+
+		auto& scratch = arena::scratch();
+		auto mark = arena::mark(scratch);
+		auto offsets = arena::make_vector<const void*>(scratch, (size_t)range_count);
+		auto base_vertices = arena::make_vector<GLint>(scratch, (size_t)range_count, mesh.base_vertex);
+		for (auto i = GLsizei{0}; i < range_count; ++i) {
+			offsets[i] = (void*)((mesh.first_index + first_indices[i]) * index_size(mesh.index_type));
 		}
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		glMultiDrawElementsBaseVertex(mesh.primitive, index_counts, mesh.index_type, offsets.data(), range_count,
+		                              base_vertices.data());
+		arena::rewind(scratch, mark);
+	}
+
+	void dynamic_draw(mesh_t& mesh, const mesh_template_t& mesh_template, GLuint instance_buffer, GLsizei first,
+	                  GLsizei count) {
+		chicken3421::expect(mesh.pool_format < 0 && !mesh.shape.kind,
+		                    "pooled meshes can't be updated, make the mesh with GL_DYNAMIC_DRAW");
+		stream(mesh, mesh_template);
+		draw_instanced(mesh, instance_buffer, first, count);
 	}
 
 	void destroy(const mesh_t& mesh) {
-		glDeleteVertexArrays(1, &mesh.vao);
-		glDeleteBuffers(1, &mesh.vbo);
+		if (mesh.pool_format >= 0) {
+			auto allocation = geometry_pool::allocation_t{};
+			allocation.format = (std::uint32_t)mesh.pool_format;
+			allocation.base_vertex = mesh.base_vertex;
+			allocation.vertex_count = mesh.vertex_count;
+			allocation.first_index = mesh.first_index;
+			allocation.index_count = mesh.indices_count;
+			allocation.index_type = mesh.index_type;
+			geometry_pool::free(allocation);
+		}
+		// streamed meshes hold nothing, their region is reused a few frames on, and procedural ones
+		// share an empty vertex array
 	}
 } // namespace mesh
@@ -0,0 +1,21 @@
+#include "mesh_adjacency.hpp"
+
+#include <numeric>
+
+namespace mesh_adjacency {
+    adjacency_t build(arena::arena_t &scratch, const GLuint *indices, size_t index_count, size_t vertex_count) {
+        auto adjacency = adjacency_t{arena::make_vector<std::uint32_t>(scratch, vertex_count + 1),
+                                     arena::make_vector<std::uint32_t>(scratch, index_count)};
+        for (auto i = size_t{0}; i < index_count; ++i) {
+            ++adjacency.offsets[indices[i] + 1];
+        }
+        std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin());
+
+        auto fill = arena::make_vector<std::uint32_t>(scratch);
+        fill.assign(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+        for (auto i = size_t{0}; i < index_count; ++i) {
+            adjacency.triangles[fill[indices[i]]++] = (std::uint32_t) (i / 3);
+        }
+        return adjacency;
+    }
+} // namespace mesh_adjacency
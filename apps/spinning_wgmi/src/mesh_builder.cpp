@@ -0,0 +1,71 @@
+#include "mesh_builder.hpp"
+#include "vertex_layout.hpp"
+
+#include <algorithm>
+#include <chicken3421/chicken3421.hpp>
+
+namespace mesh_builder {
+    builder_t make_builder(counts_t counts, std::uint32_t attributes, GLenum primitive) {
+        auto builder = builder_t{};
+        auto &mesh = builder.mesh;
+        mesh.primitive = primitive;
+        mesh.positions.resize(counts.vertices);
+        if (attributes & vertex_layout::COLORS) mesh.colors.resize(counts.vertices);
+        if (attributes & vertex_layout::TEX_COORDS) mesh.tex_coords.resize(counts.vertices);
+        if (attributes & vertex_layout::NORMALS) mesh.normals.resize(counts.vertices);
+        mesh.indices.resize(counts.indices);
+        return builder;
+    }
+
+    void add_quads(builder_t &builder, size_t first, size_t second, size_t count) {
+        auto *out = builder.mesh.indices.data() + builder.index;
+        if (builder.mesh.primitive == GL_TRIANGLE_STRIP) {
+            // second, first, second + 1, ... makes (second + j, first + j, second + j + 1) and then
+            // (second + j + 1, first + j, first + j + 1), both wound like the triangle list's
+            for (auto j = size_t{0}; j <= count; ++j, out += 2) {
+                out[0] = (GLuint) (second + j);
+                out[1] = (GLuint) (first + j);
+            }
+            *out = mesh::RESTART_INDEX;
+            builder.index += quad_indices(count, GL_TRIANGLE_STRIP);
+            return;
+        }
+
+        for (auto j = size_t{0}; j < count; ++j, out += 6) {
+            out[0] = (GLuint) (second + j);
+            out[1] = (GLuint) (first + j);
+            out[2] = (GLuint) (first + j + 1);
+            out[3] = (GLuint) (first + j + 1);
+            out[4] = (GLuint) (second + j + 1);
+            out[5] = (GLuint) (second + j);
+        }
+        builder.index += 6 * count;
+    }
+
+    void append(builder_t &builder, const mesh::mesh_template_t &part) {
+        auto &mesh = builder.mesh;
+        chicken3421::expect(vertex_layout::attributes_of(part) == vertex_layout::attributes_of(mesh) &&
+                            part.primitive == mesh.primitive &&
+                            builder.vertex + part.positions.size() <= mesh.positions.size() &&
+                            builder.index + part.indices.size() <= mesh.indices.size(),
+                            "mesh_builder::append: the part doesn't fit the builder");
+        auto vertex = builder.vertex;
+        std::copy(part.positions.begin(), part.positions.end(), mesh.positions.begin() + vertex);
+        std::copy(part.colors.begin(), part.colors.end(), mesh.colors.begin() + vertex);
+        std::copy(part.tex_coords.begin(), part.tex_coords.end(), mesh.tex_coords.begin() + vertex);
+        std::copy(part.normals.begin(), part.normals.end(), mesh.normals.begin() + vertex);
+        std::transform(part.indices.begin(), part.indices.end(), mesh.indices.begin() + builder.index,
+                       [vertex](GLuint index) {
+                           return index == mesh::RESTART_INDEX ? index : (GLuint) (vertex + index);
+                       });
+        builder.vertex += part.positions.size();
+        builder.index += part.indices.size();
+    }
+
+    mesh::mesh_template_t finish(builder_t &builder) {
+        chicken3421::expect(builder.vertex == builder.mesh.positions.size() &&
+                            builder.index == builder.mesh.indices.size(),
+                            "mesh_builder::finish: a different number of vertices or indices were written than sized for");
+        return std::move(builder.mesh);
+    }
+} // namespace mesh_builder
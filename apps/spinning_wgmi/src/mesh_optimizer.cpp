@@ -0,0 +1,313 @@
+#include "mesh_optimizer.hpp"
+#include "shapes.hpp"
+#include "arena.hpp"
+#include "mesh_adjacency.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+
+namespace {
+    // Tipsify: emit every remaining triangle around one vertex, then move on to the vertex that
+    // will still be cached after its own remaining triangles are emitted. cluster_starts receives
+    // the first triangle of every run that begins with a cold cache. Both outputs must have room
+    // reserved, the working memory is released again before returning
+    void tipsify(arena::arena_t &scratch, const GLuint *indices, size_t index_count, size_t vertex_count,
+                 unsigned cache_size, arena::vector<GLuint> &out, arena::vector<size_t> &cluster_starts) {
+        auto mark = arena::mark(scratch);
+        auto adjacency = mesh_adjacency::build(scratch, indices, index_count, vertex_count);
+        auto live = arena::make_vector<int>(scratch, vertex_count);
+        for (auto v = size_t{0}; v < vertex_count; ++v) {
+            live[v] = (int) (adjacency.offsets[v + 1] - adjacency.offsets[v]);
+        }
+        auto cache_time = arena::make_vector<int>(scratch, vertex_count, 0);
+        auto emitted = arena::make_vector<bool>(scratch, index_count / 3, false);
+        // every emitted index is pushed once, so this never has to grow
+        auto dead_end = arena::make_vector<GLuint>(scratch);
+        dead_end.reserve(index_count);
+        auto candidates = arena::make_vector<GLuint>(scratch);
+
+        auto time = (int) cache_size + 1;
+        auto cursor = size_t{0};
+        auto cached = [&](GLuint v) { return time - cache_time[v] <= (int) cache_size; };
+
+        long fan = -1;
+        while (cursor < vertex_count && fan < 0) {
+            if (live[cursor] > 0) fan = (long) cursor;
+            ++cursor;
+        }
+        if (fan >= 0) cluster_starts.push_back(0);
+
+        while (fan >= 0) {
+            candidates.clear();
+            for (auto a = adjacency.offsets[fan]; a < adjacency.offsets[fan + 1]; ++a) {
+                auto t = adjacency.triangles[a];
+                if (emitted[t]) continue;
+                for (int k = 0; k < 3; ++k) {
+                    auto v = indices[3 * t + k];
+                    out.push_back(v);
+                    dead_end.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    if (!cached(v)) cache_time[v] = time++;
+                }
+                emitted[t] = true;
+            }
+
+            fan = -1;
+            int best = -1;
+            for (auto v: candidates) {
+                if (live[v] <= 0) continue;
+                int priority = 0;
+                if (time - cache_time[v] + 2 * live[v] <= (int) cache_size) priority = time - cache_time[v];
+                if (priority > best) {
+                    best = priority;
+                    fan = v;
+                }
+            }
+            if (fan >= 0) continue;
+
+            // dead end, so go back to a recently used vertex, or failing that any vertex with triangles left
+            while (!dead_end.empty() && fan < 0) {
+                auto v = dead_end.back();
+                dead_end.pop_back();
+                if (live[v] > 0) fan = v;
+            }
+            while (cursor < vertex_count && fan < 0) {
+                if (live[cursor] > 0) fan = (long) cursor;
+                ++cursor;
+            }
+            if (fan >= 0 && !cached((GLuint) fan)) cluster_starts.push_back(out.size() / 3);
+        }
+        arena::rewind(scratch, mark);
+    }
+
+    // Sort clusters so those facing most outwards from the mesh centre come first. They are the
+    // ones likeliest to hide the rest, from whichever side the mesh is seen. Writes over out, which
+    // must be as long as indices
+    void order_clusters(arena::arena_t &scratch, const arena::vector<GLuint> &indices,
+                        const std::vector<glm::vec3> &positions, arena::vector<size_t> &cluster_starts,
+                        std::vector<GLuint> &out) {
+        auto triangle_count = indices.size() / 3;
+        cluster_starts.push_back(triangle_count);
+
+        auto corner = [&](size_t t, int k) { return positions[indices[3 * t + k]]; };
+
+        // area weighted, so dense patches don't drag the centre around
+        auto centre = glm::vec3(0.0f);
+        auto total_area = 0.0f;
+        for (auto t = size_t{0}; t < triangle_count; ++t) {
+            auto area = glm::length(glm::cross(corner(t, 1) - corner(t, 0), corner(t, 2) - corner(t, 0)));
+            centre += area * (corner(t, 0) + corner(t, 1) + corner(t, 2)) / 3.0f;
+            total_area += area;
+        }
+        if (total_area > 0.0f) centre /= total_area;
+
+        struct cluster_t {
+            size_t first;
+            size_t end;
+            float facing;
+        };
+        auto clusters = arena::make_vector<cluster_t>(scratch);
+        clusters.reserve(cluster_starts.size());
+        for (auto c = size_t{0}; c + 1 < cluster_starts.size(); ++c) {
+            auto cluster = cluster_t{cluster_starts[c], cluster_starts[c + 1], 0.0f};
+            auto normal = glm::vec3(0.0f);
+            auto middle = glm::vec3(0.0f);
+            auto area = 0.0f;
+            for (auto t = cluster.first; t < cluster.end; ++t) {
+                auto n = glm::cross(corner(t, 1) - corner(t, 0), corner(t, 2) - corner(t, 0));
+                auto a = glm::length(n);
+                normal += n;
+                middle += a * (corner(t, 0) + corner(t, 1) + corner(t, 2)) / 3.0f;
+                area += a;
+            }
+            if (area > 0.0f && glm::length(normal) > 0.0f) {
+                cluster.facing = glm::dot(middle / area - centre, glm::normalize(normal));
+            }
+            clusters.push_back(cluster);
+        }
+        std::stable_sort(clusters.begin(), clusters.end(),
+                         [](const cluster_t &a, const cluster_t &b) { return a.facing > b.facing; });
+
+        auto next = out.begin();
+        for (const auto &cluster: clusters) {
+            next = std::copy(indices.begin() + 3 * cluster.first, indices.begin() + 3 * cluster.end, next);
+        }
+    }
+
+    // Tipsify each group of the template's triangles on its own, so the groups keep their place and
+    // their triangles. Each group's vertices are numbered from 0 for it, so the working memory is
+    // the size of a group and not of the mesh
+    void tipsify_groups(arena::arena_t &scratch, mesh::mesh_template_t &mesh_template) {
+        auto &indices = mesh_template.indices;
+        const auto &groups = mesh_template.groups;
+        auto group_end = [&](size_t g) { return g + 1 < groups.size() ? (size_t) groups[g + 1] : indices.size(); };
+        auto largest = size_t{0};
+        for (auto g = size_t{0}; g < groups.size(); ++g) {
+            largest = std::max(largest, group_end(g) - groups[g]);
+        }
+
+        const auto unused = ~GLuint{0};
+        auto local = arena::make_vector<GLuint>(scratch, mesh_template.positions.size(), unused);
+        auto vertices = arena::make_vector<GLuint>(scratch); // local number -> template's
+        vertices.reserve(largest);
+        auto group_indices = arena::make_vector<GLuint>(scratch);
+        group_indices.reserve(largest);
+        auto tipsified = arena::make_vector<GLuint>(scratch);
+        tipsified.reserve(largest);
+        auto cluster_starts = arena::make_vector<size_t>(scratch);
+        cluster_starts.reserve(largest / 3 + 1);
+        for (auto g = size_t{0}; g < groups.size(); ++g) {
+            vertices.clear();
+            group_indices.clear();
+            for (auto i = (size_t) groups[g]; i < group_end(g); ++i) {
+                auto v = indices[i];
+                if (local[v] == unused) {
+                    local[v] = (GLuint) vertices.size();
+                    vertices.push_back(v);
+                }
+                group_indices.push_back(local[v]);
+            }
+
+            tipsified.clear();
+            cluster_starts.clear();
+            tipsify(scratch, group_indices.data(), group_indices.size(), vertices.size(), mesh_optimizer::CACHE_SIZE,
+                    tipsified, cluster_starts);
+            for (auto i = size_t{0}; i < tipsified.size(); ++i) {
+                indices[groups[g] + i] = vertices[tipsified[i]];
+            }
+            for (auto v: vertices) {
+                local[v] = unused;
+            }
+        }
+    }
+
+    // values[i] = old values[order[i]], shrinking in place
+    template<typename T>
+    void remap_attribute(arena::arena_t &scratch, std::vector<T> &values, const arena::vector<GLuint> &order) {
+        if (values.empty()) return;
+        auto mark = arena::mark(scratch);
+        auto original = arena::make_vector<T>(scratch);
+        original.assign(values.begin(), values.end());
+        values.resize(order.size());
+        for (auto i = size_t{0}; i < order.size(); ++i) {
+            values[i] = original[order[i]];
+        }
+        arena::rewind(scratch, mark);
+    }
+
+    // number vertices in the order the triangles first use them, so fetches walk the buffer forwards
+    void order_vertices(arena::arena_t &scratch, mesh::mesh_template_t &mesh_template) {
+        const auto unused = ~GLuint{0};
+        auto new_index = arena::make_vector<GLuint>(scratch, mesh_template.positions.size(), unused);
+        auto order = arena::make_vector<GLuint>(scratch);
+        order.reserve(mesh_template.positions.size());
+        for (auto &index: mesh_template.indices) {
+            if (index == mesh::RESTART_INDEX) continue;
+            if (new_index[index] == unused) {
+                new_index[index] = (GLuint) order.size();
+                order.push_back(index);
+            }
+            index = new_index[index];
+        }
+        remap_attribute(scratch, mesh_template.positions, order);
+        remap_attribute(scratch, mesh_template.colors, order);
+        remap_attribute(scratch, mesh_template.tex_coords, order);
+        remap_attribute(scratch, mesh_template.normals, order);
+    }
+
+    void report_shape(std::ostream &out, const std::string &name, mesh::mesh_template_t mesh_template) {
+        auto before = mesh_optimizer::analyze(mesh_template);
+        mesh_optimizer::optimize(mesh_template);
+        auto after = mesh_optimizer::analyze(mesh_template);
+        out << std::left << std::setw(16) << name << std::right
+            << std::setw(8) << mesh::triangle_count(mesh_template)
+            << std::setw(8) << mesh_template.positions.size()
+            << std::setw(9) << mesh_template.indices.size()
+            << std::setw(10) << before.acmr << std::setw(8) << after.acmr
+            << std::setw(10) << before.atvr << std::setw(8) << after.atvr << '\n';
+    }
+} // namespace
+
+namespace mesh_optimizer {
+    stats_t analyze(const mesh::mesh_template_t &mesh_template, unsigned cache_size) {
+        const auto &indices = mesh_template.indices;
+        auto stats = stats_t{};
+        if (indices.empty()) return stats;
+
+        // a vertex is in the FIFO while fewer than cache_size misses followed its own
+        const auto never = ~size_t{0};
+        auto inserted = std::vector<size_t>(mesh_template.positions.size(), never);
+        auto misses = size_t{0};
+        auto used = size_t{0};
+        for (auto index: indices) {
+            if (index == mesh::RESTART_INDEX) continue;
+            if (inserted[index] == never) ++used;
+            if (inserted[index] == never || misses - inserted[index] >= cache_size) {
+                inserted[index] = misses++;
+            }
+        }
+        stats.acmr = (float) misses / (float) mesh::triangle_count(mesh_template);
+        stats.atvr = (float) misses / (float) used;
+        return stats;
+    }
+
+    void optimize(mesh::mesh_template_t &mesh_template) {
+        auto &indices = mesh_template.indices;
+        if (indices.empty()) return;
+        if (mesh_template.primitive == GL_TRIANGLE_STRIP) {
+            // a strip's triangles can't be reordered, but its vertices can still follow them
+            auto &scratch = arena::scratch();
+            auto mark = arena::mark(scratch);
+            order_vertices(scratch, mesh_template);
+            arena::rewind(scratch, mark);
+            return;
+        }
+        if (indices.size() % 3 != 0) return;
+
+        // all the working memory is scratch, only the template's own arrays are written
+        auto &scratch = arena::scratch();
+        auto mark = arena::mark(scratch);
+        if (!mesh_template.groups.empty()) {
+            tipsify_groups(scratch, mesh_template);
+            order_vertices(scratch, mesh_template);
+            arena::rewind(scratch, mark);
+            return;
+        }
+        auto tipsified = arena::make_vector<GLuint>(scratch);
+        tipsified.reserve(indices.size());
+        // one per triangle at most, and order_clusters adds an end
+        auto cluster_starts = arena::make_vector<size_t>(scratch);
+        cluster_starts.reserve(indices.size() / 3 + 1);
+        tipsify(scratch, indices.data(), indices.size(), mesh_template.positions.size(), CACHE_SIZE, tipsified,
+                cluster_starts);
+        order_clusters(scratch, tipsified, mesh_template.positions, cluster_starts, indices);
+        order_vertices(scratch, mesh_template);
+        arena::rewind(scratch, mark);
+    }
+
+    void report(std::ostream &out) {
+        auto thickness = glm::radians(5.0f);
+        out << std::fixed << std::setprecision(3)
+            << "shape           triangles   verts  indices  ACMR  -> after  ATVR  -> after  (FIFO of " << CACHE_SIZE << ")\n";
+        report_shape(out, "sphere", shapes::make_sphere(1.0f));
+        report_shape(out, "sphere strips", shapes::make_sphere(1.0f, 64, shapes::TRIANGLE_STRIPS));
+        report_shape(out, "zero_character", shapes::make_zero_character(1.0f, 0.0f, thickness));
+        report_shape(out, "ring", shapes::make_ring(1.0f, thickness));
+        report_shape(out, "ring strips", shapes::make_ring(1.0f, thickness, 64, false, shapes::TRIANGLE_STRIPS));
+        report_shape(out, "rect_circle", shapes::make_rect_circle(1.0f, thickness));
+        report_shape(out, "sphere_rings", shapes::make_sphere_rings(1.0f, thickness, 8));
+        report_shape(out, "sphere_zeros", shapes::make_sphere_zeros(1.0f, thickness, 8));
+        report_shape(out, "sphere_skeleton", shapes::make_sphere_skeleton(1.0f, thickness, 8));
+        report_shape(out, "wgmi_face", shapes::make_wgmi_face(1.0f));
+        report_shape(out, "torus", shapes::make_torus(1.0f, thickness));
+        report_shape(out, "torus strips", shapes::make_torus(1.0f, thickness, 64, shapes::TRIANGLE_STRIPS));
+        report_shape(out, "cube", shapes::make_cube(1.0f));
+        report_shape(out, "plane", shapes::make_plane(32, 32));
+        report_shape(out, "plane strips", shapes::make_plane(32, 32, shapes::TRIANGLE_STRIPS));
+        report_shape(out, "circle", shapes::make_circle(1.0f));
+        report_shape(out, "cylinder", shapes::make_cylinder(1.0f, 2.0f));
+        report_shape(out, "cylinder strips", shapes::make_cylinder(1.0f, 2.0f, 64, shapes::TRIANGLE_STRIPS));
+    }
+} // namespace mesh_optimizer
@@ -0,0 +1,320 @@
+#include "mesh_store.hpp"
+#include "vertex_layout.hpp"
+#include "arena.hpp"
+
+#include <chicken3421/chicken3421.hpp>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const std::uint32_t MAGIC = 0x534d4757; // "WGMS"
+
+    struct header_t {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t key;
+        std::uint64_t file_size;
+        std::uint32_t mesh_count;
+        std::uint32_t extra_size;
+        std::uint64_t extra_offset;
+    };
+
+    struct record_t {
+        std::uint32_t attributes;
+        std::uint32_t index_type;
+        std::uint32_t vertex_count;
+        std::uint32_t index_count;
+        std::uint32_t primitive;
+        std::uint32_t triangle_count;
+        std::uint64_t vertex_offset;
+        std::uint64_t index_offset;
+        float aabb_min[3];
+        float aabb_max[3];
+        float sphere_center[3];
+        float sphere_radius;
+        std::int32_t tag;
+        std::uint32_t pad;
+    };
+
+    mesh_store::stats_t load_stats;
+
+    // a whole file mapped read-only, data is null if it couldn't be
+    struct mapping_t {
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE map = nullptr;
+#endif
+    };
+
+#ifdef _WIN32
+    mapping_t map_file(const std::string &path) {
+        auto mapping = mapping_t{};
+        mapping.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL, nullptr);
+        auto size = LARGE_INTEGER{};
+        if (mapping.file == INVALID_HANDLE_VALUE || !GetFileSizeEx(mapping.file, &size) || size.QuadPart == 0) {
+            return mapping;
+        }
+        mapping.map = CreateFileMappingA(mapping.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping.map) {
+            mapping.data = static_cast<const unsigned char *>(MapViewOfFile(mapping.map, FILE_MAP_READ, 0, 0, 0));
+            mapping.size = mapping.data ? (size_t) size.QuadPart : 0;
+        }
+        return mapping;
+    }
+
+    void unmap(mapping_t &mapping) {
+        if (mapping.data) UnmapViewOfFile(mapping.data);
+        if (mapping.map) CloseHandle(mapping.map);
+        if (mapping.file != INVALID_HANDLE_VALUE) CloseHandle(mapping.file);
+        mapping = mapping_t{};
+    }
+#else
+    mapping_t map_file(const std::string &path) {
+        auto mapping = mapping_t{};
+        auto fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return mapping;
+        struct stat info{};
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            auto *data = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                mapping.data = static_cast<const unsigned char *>(data);
+                mapping.size = (size_t) info.st_size;
+            }
+        }
+        // the mapping outlives the descriptor
+        close(fd);
+        return mapping;
+    }
+
+    void unmap(mapping_t &mapping) {
+        if (mapping.data) munmap(const_cast<unsigned char *>(mapping.data), mapping.size);
+        mapping = mapping_t{};
+    }
+#endif
+
+    std::string path_of(std::uint64_t key) {
+        auto path = std::stringstream{};
+        path << mesh_store::DIRECTORY << '/' << std::hex << std::setw(16) << std::setfill('0') << key << ".mesh";
+        return path.str();
+    }
+
+    std::uint64_t align_up(std::uint64_t offset) {
+        return (offset + mesh_store::BLOB_ALIGNMENT - 1) & ~(mesh_store::BLOB_ALIGNMENT - 1);
+    }
+
+    bool within(const mapping_t &mapping, std::uint64_t offset, std::uint64_t size) {
+        return offset <= mapping.size && size <= mapping.size - offset;
+    }
+
+    // the file's records if its header and every record check out, otherwise null
+    const record_t *check(const mapping_t &mapping, std::uint64_t key) {
+        if (!mapping.data || mapping.size < sizeof(header_t)) return nullptr;
+        auto header = header_t{};
+        std::memcpy(&header, mapping.data, sizeof(header));
+        if (header.magic != MAGIC || header.version != mesh_store::VERSION || header.key != key ||
+            header.file_size != mapping.size ||
+            !within(mapping, sizeof(header_t), (std::uint64_t) header.mesh_count * sizeof(record_t)) ||
+            !within(mapping, header.extra_offset, header.extra_size)) {
+            return nullptr;
+        }
+
+        // mappings are page aligned, so records right after the header are aligned too
+        const auto *records = reinterpret_cast<const record_t *>(mapping.data + sizeof(header_t));
+        for (auto i = std::uint32_t{0}; i < header.mesh_count; ++i) {
+            const auto &record = records[i];
+            if (record.attributes >= vertex_layout::ATTRIBUTE_SETS ||
+                (record.index_type != GL_UNSIGNED_SHORT && record.index_type != GL_UNSIGNED_INT) ||
+                (record.primitive != GL_TRIANGLES && record.primitive != GL_TRIANGLE_STRIP) ||
+                record.vertex_offset % mesh_store::BLOB_ALIGNMENT || record.index_offset % mesh_store::BLOB_ALIGNMENT) {
+                return nullptr;
+            }
+            auto stride = (std::uint64_t) vertex_layout::describe(record.attributes).stride;
+            auto index_size = (std::uint64_t) mesh::index_size(record.index_type);
+            if (!within(mapping, record.vertex_offset, record.vertex_count * stride) ||
+                !within(mapping, record.index_offset, record.index_count * index_size)) {
+                return nullptr;
+            }
+        }
+        return records;
+    }
+
+    mesh_store::stored_t upload(const mapping_t &mapping, const record_t *records) {
+        auto header = header_t{};
+        std::memcpy(&header, mapping.data, sizeof(header));
+        auto stored = mesh_store::stored_t{};
+        for (auto i = std::uint32_t{0}; i < header.mesh_count; ++i) {
+            const auto &record = records[i];
+            auto packed = mesh::packed_mesh_t{};
+            packed.attributes = record.attributes;
+            packed.vertex_count = (GLsizei) record.vertex_count;
+            packed.vertices = mapping.data + record.vertex_offset;
+            packed.index_type = record.index_type;
+            packed.index_count = (GLsizei) record.index_count;
+            packed.indices = mapping.data + record.index_offset;
+            packed.primitive = record.primitive;
+            packed.triangle_count = (GLsizei) record.triangle_count;
+            packed.aabb.min = glm::vec3(record.aabb_min[0], record.aabb_min[1], record.aabb_min[2]);
+            packed.aabb.max = glm::vec3(record.aabb_max[0], record.aabb_max[1], record.aabb_max[2]);
+            packed.sphere.center = glm::vec3(record.sphere_center[0], record.sphere_center[1], record.sphere_center[2]);
+            packed.sphere.radius = record.sphere_radius;
+            stored.meshes.push_back(mesh::init(packed));
+            stored.tags.push_back(record.tag);
+        }
+        stored.extra.assign(reinterpret_cast<const char *>(mapping.data + header.extra_offset), header.extra_size);
+        return stored;
+    }
+
+    // lay the packed meshes out as a file, see mesh_store.hpp
+    std::string serialise(std::uint64_t key, const std::vector<mesh::packed_mesh_t> &packed,
+                          const std::vector<std::int32_t> &tags, const std::string &extra) {
+        auto header = header_t{MAGIC, mesh_store::VERSION, key, 0, (std::uint32_t) packed.size(), 0, 0};
+        auto records = std::vector<record_t>(packed.size());
+        auto offset = align_up(sizeof(header_t) + packed.size() * sizeof(record_t));
+        for (auto i = size_t{0}; i < packed.size(); ++i) {
+            const auto &mesh = packed[i];
+            auto &record = records[i];
+            record = record_t{};
+            record.attributes = mesh.attributes;
+            record.index_type = mesh.index_type;
+            record.vertex_count = (std::uint32_t) mesh.vertex_count;
+            record.index_count = (std::uint32_t) mesh.index_count;
+            record.primitive = mesh.primitive;
+            record.triangle_count = (std::uint32_t) mesh.triangle_count;
+            record.vertex_offset = offset;
+            offset = align_up(offset + mesh.vertex_count * (std::uint64_t) vertex_layout::describe(mesh.attributes).stride);
+            record.index_offset = offset;
+            offset = align_up(offset + mesh.index_count * (std::uint64_t) mesh::index_size(mesh.index_type));
+            std::memcpy(record.aabb_min, &mesh.aabb.min.x, sizeof(record.aabb_min));
+            std::memcpy(record.aabb_max, &mesh.aabb.max.x, sizeof(record.aabb_max));
+            std::memcpy(record.sphere_center, &mesh.sphere.center.x, sizeof(record.sphere_center));
+            record.sphere_radius = mesh.sphere.radius;
+            record.tag = tags.empty() ? 0 : tags[i];
+        }
+        header.extra_offset = offset;
+        header.extra_size = (std::uint32_t) extra.size();
+        header.file_size = offset + extra.size();
+
+        auto file = std::string(header.file_size, '\0');
+        std::memcpy(&file[0], &header, sizeof(header));
+        std::memcpy(&file[sizeof(header)], records.data(), records.size() * sizeof(record_t));
+        for (auto i = size_t{0}; i < packed.size(); ++i) {
+            auto stride = (size_t) vertex_layout::describe(packed[i].attributes).stride;
+            std::memcpy(&file[records[i].vertex_offset], packed[i].vertices, packed[i].vertex_count * stride);
+            std::memcpy(&file[records[i].index_offset], packed[i].indices,
+                        packed[i].index_count * (size_t) mesh::index_size(packed[i].index_type));
+        }
+        std::memcpy(&file[header.extra_offset], extra.data(), extra.size());
+        return file;
+    }
+
+    // written beside the target and renamed over it, so a reader never sees half a file
+    void write(const std::string &path, const std::string &contents) {
+        auto error = std::error_code{};
+        std::filesystem::create_directories(mesh_store::DIRECTORY, error);
+        auto temporary = path + ".tmp";
+        {
+            auto out = std::ofstream(temporary, std::ios::binary | std::ios::trunc);
+            out.write(contents.data(), (std::streamsize) contents.size());
+            if (!out) {
+                // the store is only a shortcut, without it the meshes get built every launch
+                return;
+            }
+        }
+        std::filesystem::rename(temporary, path, error);
+    }
+
+    double ms_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+} // namespace
+
+namespace mesh_store {
+    std::uint64_t hash(const void *data, size_t size, std::uint64_t hash) {
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        for (auto i = size_t{0}; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::uint64_t hash_file(const std::string &path, std::uint64_t hash) {
+        auto mapping = map_file(path);
+        hash = mesh_store::hash(mapping.data, mapping.size, hash);
+        unmap(mapping);
+        return hash;
+    }
+
+    stored_t load(std::uint64_t key, const std::function<source_t()> &build) {
+        auto start = std::chrono::steady_clock::now();
+        auto path = path_of(key);
+        auto mapping = map_file(path);
+        if (const auto *records = check(mapping, key)) {
+            auto stored = upload(mapping, records);
+            unmap(mapping);
+            ++load_stats.mapped;
+            load_stats.mapped_ms += ms_since(start);
+            return stored;
+        }
+        unmap(mapping);
+
+        auto source = build();
+        chicken3421::expect(source.tags.empty() || source.tags.size() == source.templates.size(),
+                            "mesh_store::load: give one tag per template or none");
+        auto &scratch = arena::scratch();
+        auto mark = arena::mark(scratch);
+        auto packed = std::vector<mesh::packed_mesh_t>{};
+        for (auto &mesh_template: source.templates) {
+            packed.push_back(mesh::pack(std::move(mesh_template), source.quantize));
+        }
+        write(path, serialise(key, packed, source.tags, source.extra));
+
+        auto stored = stored_t{};
+        for (auto i = size_t{0}; i < packed.size(); ++i) {
+            stored.meshes.push_back(mesh::init(packed[i]));
+            stored.tags.push_back(source.tags.empty() ? 0 : source.tags[i]);
+        }
+        stored.extra = std::move(source.extra);
+        arena::rewind(scratch, mark);
+        ++load_stats.built;
+        load_stats.built_ms += ms_since(start);
+        return stored;
+    }
+
+    mesh::mesh_t load(std::uint64_t key, const std::function<mesh::mesh_template_t()> &build, bool quantize) {
+        auto stored = load(key, [&] {
+            auto source = source_t{};
+            source.templates.push_back(build());
+            source.quantize = quantize;
+            return source;
+        });
+        chicken3421::expect(stored.meshes.size() == 1, "mesh_store::load: the stored file doesn't hold one mesh");
+        return stored.meshes[0];
+    }
+
+    void clear() {
+        auto error = std::error_code{};
+        std::filesystem::remove_all(DIRECTORY, error);
+    }
+
+    const stats_t &stats() {
+        return load_stats;
+    }
+} // namespace mesh_store
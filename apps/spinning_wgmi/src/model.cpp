@@ -1,15 +1,206 @@
 #include "model.hpp"
 #include "texture_2d.hpp"
+#include "geometry_cache.hpp"
+#include "mesh_store.hpp"
+#include "shapes.hpp"
+#include "simplifier.hpp"
+#include "clusters.hpp"
 
 #include <tiny_obj_loader.h>
 #include <chicken3421/chicken3421.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
-namespace model {
-	model_t load(const std::string& path) {
+namespace {
+	struct index_hash_t {
+		size_t operator()(const tinyobj::index_t& index) const {
+			auto h = (size_t)(std::uint32_t)index.vertex_index * 73856093u;
+			h ^= (size_t)(std::uint32_t)index.texcoord_index * 19349663u;
+			h ^= (size_t)(std::uint32_t)index.normal_index * 83492791u;
+			return h;
+		}
+	};
+
+	struct index_equal_t {
+		bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const {
+			return a.vertex_index == b.vertex_index && a.texcoord_index == b.texcoord_index
+			       && a.normal_index == b.normal_index;
+		}
+	};
+
+	// one vertex per distinct (position, tex coord, normal) triple the shape's corners refer to
+	mesh::mesh_template_t make_template(const tinyobj::attrib_t& attrib, const tinyobj::mesh_t& shape) {
+		mesh::mesh_template_t mesh_template;
+		bool has_tex_coords = !attrib.texcoords.empty();
+		bool has_normals = !attrib.normals.empty();
+
+		// triangulated, so three corners a face. closed meshes have about half as many vertices as faces,
+		// open or faceted ones up to three times as many, so start from one vertex per face
+		auto faces = shape.num_face_vertices.size();
+		mesh_template.indices.reserve(3 * faces);
+		mesh_template.positions.reserve(faces);
+		if (has_tex_coords) mesh_template.tex_coords.reserve(faces);
+		if (has_normals) mesh_template.normals.reserve(faces);
+		auto vertex_of = std::unordered_map<tinyobj::index_t, GLuint, index_hash_t, index_equal_t>{};
+		vertex_of.reserve(faces);
+
+		for (const auto& index : shape.indices) {
+			auto found = vertex_of.emplace(index, (GLuint)mesh_template.positions.size());
+			mesh_template.indices.push_back(found.first->second);
+			if (!found.second) continue;
+
+			const float* pos = &attrib.vertices[3 * index.vertex_index];
+			mesh_template.positions.emplace_back(pos[0], pos[1], pos[2]);
+			if (has_tex_coords) {
+				const float* tc = &attrib.texcoords[2 * index.texcoord_index];
+				mesh_template.tex_coords.emplace_back(tc[0], tc[1]);
+			}
+			if (has_normals) {
+				const float* norm = &attrib.normals[3 * index.normal_index];
+				mesh_template.normals.emplace_back(norm[0], norm[1], norm[2]);
+			}
+		}
+		return mesh_template;
+	}
+
+	// the OBJ's contents and those of the material libraries it names, so editing any of them rebuilds it
+	std::uint64_t source_key(const std::string& path, const std::string& search_path) {
+		auto in = std::ifstream(path, std::ios::binary);
+		auto text = std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		auto hash = mesh_store::hash(text.data(), text.size());
+		for (auto at = text.find("mtllib"); at != std::string::npos; at = text.find("mtllib", at + 1)) {
+			if (at != 0 && text[at - 1] != '\n') continue;
+			auto end = text.find('\n', at);
+			auto names = std::istringstream(text.substr(at + 6, end == std::string::npos ? end : end - at - 6));
+			for (std::string name; names >> name;) {
+				hash = mesh_store::hash_file(search_path + name, hash);
+			}
+		}
+		return hash;
+	}
+
+	// the parts of the materials load uses, kept with the meshes in mesh_store
+	void write_string(std::string& out, const std::string& value) {
+		auto size = (std::uint32_t)value.size();
+		out.append(reinterpret_cast<const char*>(&size), sizeof(size));
+		out.append(value);
+	}
+
+	std::string read_string(const std::string& in, size_t& at) {
+		auto size = std::uint32_t{0};
+		std::memcpy(&size, in.data() + at, sizeof(size));
+		at += sizeof(size);
+		auto value = in.substr(at, size);
+		at += size;
+		return value;
+	}
+
+	std::string write_materials(const std::vector<tinyobj::material_t>& materials) {
+		auto out = std::string{};
+		for (const auto& m : materials) {
+			out.append(reinterpret_cast<const char*>(m.diffuse), sizeof(m.diffuse));
+			out.append(reinterpret_cast<const char*>(m.specular), sizeof(m.specular));
+			write_string(out, m.diffuse_texname);
+			write_string(out, m.specular_texname);
+		}
+		return out;
+	}
+
+	std::vector<tinyobj::material_t> read_materials(const std::string& in, size_t at) {
+		auto materials = std::vector<tinyobj::material_t>{};
+		for (; at < in.size();) {
+			auto m = tinyobj::material_t{};
+			std::memcpy(m.diffuse, in.data() + at, sizeof(m.diffuse));
+			at += sizeof(m.diffuse);
+			std::memcpy(m.specular, in.data() + at, sizeof(m.specular));
+			at += sizeof(m.specular);
+			m.diffuse_texname = read_string(in, at);
+			m.specular_texname = read_string(in, at);
+			materials.push_back(m);
+		}
+		return materials;
+	}
+
+	// the store's templates are the shapes, tagged with their material ids, then the shapes' levels of
+	// detail, tagged with their shape. The extra bytes start with how many of each there are and the
+	// levels' errors
+	void write_levels(std::string& out, std::uint32_t shape_count, const std::vector<float>& errors) {
+		auto level_count = (std::uint32_t)errors.size();
+		out.append(reinterpret_cast<const char*>(&shape_count), sizeof(shape_count));
+		out.append(reinterpret_cast<const char*>(&level_count), sizeof(level_count));
+		out.append(reinterpret_cast<const char*>(errors.data()), errors.size() * sizeof(float));
+	}
+
+	std::vector<float> read_levels(const std::string& in, std::uint32_t& shape_count, size_t& at) {
+		auto level_count = std::uint32_t{0};
+		std::memcpy(&shape_count, in.data() + at, sizeof(shape_count));
+		at += sizeof(shape_count);
+		std::memcpy(&level_count, in.data() + at, sizeof(level_count));
+		at += sizeof(level_count);
+		auto errors = std::vector<float>(level_count);
+		std::memcpy(errors.data(), in.data() + at, level_count * sizeof(float));
+		at += level_count * sizeof(float);
+		return errors;
+	}
+
+	template <typename T>
+	void write_array(std::string& out, const std::vector<T>& values) {
+		out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+	}
+
+	template <typename T>
+	std::vector<T> read_array(const std::string& in, size_t count, size_t& at) {
+		auto values = std::vector<T>(count);
+		std::memcpy(values.data(), in.data() + at, count * sizeof(T));
+		at += count * sizeof(T);
+		return values;
+	}
+
+	// after the levels, each shape's cluster count and its clusters' arrays
+	void write_clusters(std::string& out, const std::vector<clusters::clusters_t>& shape_clusters) {
+		for (const auto& c : shape_clusters) {
+			auto count = (std::uint32_t)c.count;
+			out.append(reinterpret_cast<const char*>(&count), sizeof(count));
+			for (const auto* array : {&c.center_x, &c.center_y, &c.center_z, &c.radius, &c.axis_x, &c.axis_y,
+			                          &c.axis_z, &c.cutoff}) {
+				write_array(out, *array);
+			}
+			write_array(out, c.first_index);
+			write_array(out, c.index_count);
+		}
+	}
+
+	std::vector<clusters::clusters_t> read_clusters(const std::string& in, std::uint32_t shape_count, size_t& at) {
+		auto shape_clusters = std::vector<clusters::clusters_t>(shape_count);
+		for (auto& c : shape_clusters) {
+			auto count = std::uint32_t{0};
+			std::memcpy(&count, in.data() + at, sizeof(count));
+			at += sizeof(count);
+			c.count = count;
+			auto padded = (c.count + 3) / 4 * 4;
+			for (auto* array : {&c.center_x, &c.center_y, &c.center_z, &c.radius, &c.axis_x, &c.axis_y, &c.axis_z,
+			                    &c.cutoff}) {
+				*array = read_array<float>(in, padded, at);
+			}
+			c.first_index = read_array<GLuint>(in, c.count, at);
+			c.index_count = read_array<GLsizei>(in, c.count, at);
+		}
+		return shape_clusters;
+	}
+
+	// parse the OBJ, tagging each shape's template with its material id, and if it's for drawing
+	// decimate each shape into its levels of detail and split it into clusters
+	mesh_store::source_t parse(const std::string& path, const std::string& search_path, bool for_drawing) {
 		tinyobj::ObjReader reader;
 		tinyobj::ObjReaderConfig config{};
 		config.triangulate = true;
-		config.mtl_search_path = path.substr(0, path.find_last_of('/') + 1);
+		config.mtl_search_path = search_path;
 
 		bool did_load = reader.ParseFromFile(path, config);
 		chicken3421::expect(did_load && reader.Error().empty() && reader.Warning().empty(),
@@ -17,7 +208,69 @@ namespace model {
 
 		auto& attrib = reader.GetAttrib();
 		auto& shapes = reader.GetShapes();
-		auto& materials = reader.GetMaterials();
+
+		// build every shape's template and levels on its own thread. A lone shape splits its normals between
+		// threads instead, however many triangles it has
+		auto source = mesh_store::source_t{};
+		source.templates.resize(shapes.size());
+		source.quantize = true;
+		auto levels = std::vector<std::vector<simplifier::level_t>>(shapes.size());
+		auto shape_clusters = std::vector<clusters::clusters_t>(shapes.size());
+		auto normal_threads = shapes.size() == 1 ? 0u : 1u;
+		auto next_shape = std::atomic<size_t>{0};
+		auto worker = [&]() {
+			for (auto i = next_shape++; i < shapes.size(); i = next_shape++) {
+				auto& mesh_template = source.templates[i];
+				mesh_template = make_template(attrib, shapes[i].mesh);
+				if (mesh_template.normals.empty() && !mesh_template.indices.empty()) {
+					shapes::calc_vertex_normals(mesh_template, shapes::ANGLE_WEIGHTS, normal_threads);
+				}
+				if (!for_drawing) continue;
+				levels[i] = simplifier::make_levels(mesh_template);
+				// after the levels, it reorders the triangles
+				shape_clusters[i] = clusters::build(mesh_template);
+			}
+		};
+		auto workers = std::vector<std::thread>{};
+		auto n_workers = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), shapes.size());
+		for (auto i = size_t{1}; i < n_workers; ++i) {
+			workers.emplace_back(worker);
+		}
+		worker();
+		for (auto& w : workers) {
+			w.join();
+		}
+
+		// tinyobj gives faces without a material -1, so shapes without faces get it too
+		for (const auto& shape : shapes) {
+			const auto& ids = shape.mesh.material_ids;
+			source.tags.push_back(ids.empty() ? -1 : ids[0]);
+		}
+		auto errors = std::vector<float>{};
+		for (auto i = size_t{0}; i < levels.size(); ++i) {
+			for (auto& level : levels[i]) {
+				source.templates.push_back(std::move(level.mesh_template));
+				source.tags.push_back((std::int32_t)i);
+				errors.push_back(level.error);
+			}
+		}
+		write_levels(source.extra, (std::uint32_t)shapes.size(), errors);
+		write_clusters(source.extra, shape_clusters);
+		source.extra += write_materials(reader.GetMaterials());
+		return source;
+	}
+} // namespace
+
+namespace model {
+	model_t load(const std::string& path) {
+		auto search_path = path.substr(0, path.find_last_of('/') + 1);
+		// the shapes are mapped from mesh_store if an earlier launch stored them, otherwise parsed and stored
+		auto stored = mesh_store::load(source_key(path, search_path), [&] { return parse(path, search_path, true); });
+		auto shape_count = std::uint32_t{0};
+		auto at = size_t{0};
+		auto errors = read_levels(stored.extra, shape_count, at);
+		auto shape_clusters = read_clusters(stored.extra, shape_count, at);
+		auto materials = read_materials(stored.extra, at);
 		auto model = model_t{};
 
 		std::vector<material_t> mats;
@@ -27,38 +280,57 @@ namespace model {
 			mat.diffuse = glm::vec4{m.diffuse[0], m.diffuse[1], m.diffuse[2], 1.0f};
 			mat.diffuse_map = m.diffuse_texname.empty()
 			                     ? 0
-			                     : texture_2d::init(config.mtl_search_path + m.diffuse_texname);
+			                     : texture_2d::init(search_path + m.diffuse_texname);
 			mat.specular = glm::vec3{m.specular[0], m.specular[1], m.specular[2]};
 			mat.specular_map = m.specular_texname.empty()
 			                      ? 0
-			                      : texture_2d::init(config.mtl_search_path + m.diffuse_texname);
+			                      : texture_2d::init(search_path + m.specular_texname);
 			mats.push_back(mat);
 		}
 
-		// initialise the static meshes
-		for (const auto& shape : shapes) {
-			mesh::mesh_template_t mesh_template;
-			for (const auto& index : shape.mesh.indices) {
-				const float* pos = &attrib.vertices[3 * index.vertex_index];
-				mesh_template.positions.emplace_back(pos[0], pos[1], pos[2]);
-				if (!attrib.texcoords.empty()) {
-					const float* tc = &attrib.texcoords[2 * index.texcoord_index];
-					mesh_template.tex_coords.emplace_back(tc[0], tc[1]);
-				}
-				if (!attrib.normals.empty()) {
-					const float* norm = &attrib.normals[3 * index.normal_index];
-					mesh_template.normals.emplace_back(norm[0], norm[1], norm[2]);
-				}
+		for (auto i = size_t{0}; i < shape_count; ++i) {
+			model.meshes.push_back(stored.meshes[i]);
+			auto tag = stored.tags[i];
+			model.materials.push_back(tag < 0 || (size_t)tag >= mats.size() ? material_t{} : mats[tag]);
+		}
+		if (!errors.empty()) {
+			model.lods.resize(shape_count);
+			for (auto i = size_t{0}; i < errors.size(); ++i) {
+				model.lods[stored.tags[shape_count + i]].push_back({stored.meshes[shape_count + i], errors[i]});
 			}
-			model.meshes.push_back(mesh::init(mesh_template));
-			model.materials.push_back(mats[shape.mesh.material_ids[0]]);
 		}
+		auto clustered = [](const clusters::clusters_t& c) { return c.count > 0; };
+		if (std::any_of(shape_clusters.begin(), shape_clusters.end(), clustered)) {
+			model.clusters = std::move(shape_clusters);
+		}
+		update_bounds(model);
 		return model;
 	}
 
+	std::vector<mesh::mesh_template_t> load_templates(const std::string& path) {
+		return parse(path, path.substr(0, path.find_last_of('/') + 1), false).templates;
+	}
+
+	void update_bounds(model_t& model) {
+		model.aabb = bounds::aabb_t{};
+		for (const auto& mesh : model.meshes) {
+			model.aabb = bounds::merge(model.aabb, mesh.aabb);
+		}
+	}
+
 	void destroy(const model_t& model) {
 		for (auto const& mesh : model.meshes) {
-			mesh::destroy(mesh);
+			// cached meshes are shared, the cache destroys them when the last user lets go
+			if (!geometry_cache::release(mesh)) {
+				mesh::destroy(mesh);
+			}
+		}
+		for (auto const& levels : model.lods) {
+			for (auto const& lod : levels) {
+				if (!geometry_cache::release(lod.mesh)) {
+					mesh::destroy(lod.mesh);
+				}
+			}
 		}
 		for (auto const& mat : model.materials) {
 			texture_2d::destroy(mat.diffuse_map);
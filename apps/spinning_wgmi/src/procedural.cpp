@@ -0,0 +1,68 @@
+#include "procedural.hpp"
+
+#include <chicken3421/chicken3421.hpp>
+#include <cmath>
+
+namespace {
+    // every procedural mesh draws from this, its only attributes are the instance ones the renderer
+    // points at its instance buffer
+    GLuint empty_vao = 0;
+
+    // the shapes:: generators' grids of quads
+    void set_grid(mesh::mesh_t &mesh, unsigned int tessellation) {
+        auto &shape = mesh.shape;
+        shape.columns = tessellation;
+        switch (shape.kind) {
+            case procedural::SPHERE:
+                shape.rows = tessellation / 2;
+                break;
+            case procedural::TORUS:
+                // the tube is the columns, the ring round it the rows
+                shape.rows = (std::uint32_t) std::ceil(shape.radius / shape.thickness) * tessellation;
+                break;
+            case procedural::RING:
+            default:
+                shape.rows = 1;
+                break;
+        }
+        mesh.indices_count = (GLsizei) (6 * shape.columns * shape.rows);
+        mesh.triangle_count = (GLsizei) (2 * shape.columns * shape.rows);
+    }
+
+    mesh::mesh_t make(procedural::kind_t kind, float radius, float thickness, unsigned int tessellation,
+                      float start_angle, float end_angle, const glm::vec3 &extent, float bounding_radius) {
+        if (!empty_vao) glGenVertexArrays(1, &empty_vao);
+
+        auto mesh = mesh::mesh_t{};
+        mesh.vao = empty_vao;
+        mesh.shape = mesh::shape_t{kind, 0, 0, radius, thickness, start_angle, end_angle};
+        set_grid(mesh, tessellation);
+        // the whole shape's, however little of it is swept
+        mesh.aabb = bounds::aabb_t{-extent, extent};
+        mesh.sphere = bounds::sphere_t{glm::vec3(0), bounding_radius};
+        return mesh;
+    }
+} // namespace
+
+namespace procedural {
+    mesh::mesh_t sphere(float radius, unsigned int tessellation, float start_angle, float end_angle) {
+        return make(SPHERE, radius, 0.0f, tessellation, start_angle, end_angle, glm::vec3(radius), radius);
+    }
+
+    mesh::mesh_t torus(float radius, float thickness, unsigned int tessellation, float start_angle, float end_angle) {
+        // the rows round the ring are counted in tube thicknesses
+        chicken3421::expect(thickness > 0.0f, "a procedural torus needs a positive thickness");
+        auto outer = radius + thickness;
+        return make(TORUS, radius, thickness, tessellation, start_angle, end_angle,
+                    glm::vec3(outer, thickness, outer), outer);
+    }
+
+    mesh::mesh_t ring(float radius, float thickness, unsigned int tessellation, float start_angle, float end_angle) {
+        auto extent = glm::vec3(radius, radius, thickness / 2);
+        return make(RING, radius, thickness, tessellation, start_angle, end_angle, extent, glm::length(extent));
+    }
+
+    void set_tessellation(mesh::mesh_t &mesh, unsigned int tessellation) {
+        set_grid(mesh, tessellation);
+    }
+} // namespace procedural
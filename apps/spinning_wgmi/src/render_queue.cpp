@@ -0,0 +1,114 @@
+#include "render_queue.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // key layout, most significant first
+    //   opaque:      0 | program:10 | material:12 | texture:12 | mesh:13 | depth:16
+    //   translucent: 1 | far-to-near depth:20 | program:10 | material:12 | texture:12 | mesh:9
+    const std::uint64_t TRANSLUCENT_BIT = std::uint64_t{1} << 63;
+
+    std::uint64_t field(std::uint64_t value, unsigned width, unsigned shift) {
+        return (value & ((std::uint64_t{1} << width) - 1)) << shift;
+    }
+
+    // vertex array in the high bits so meshes sharing one stay together, then a hash of where the
+    // mesh sits in it, or for a procedural mesh of its shape
+    std::uint64_t mesh_bits(const mesh::mesh_t &mesh, unsigned width) {
+        auto where = (std::uint32_t) (mesh.first_index * 2654435761u) ^ (std::uint32_t) (mesh.base_vertex * 40503u);
+        if (mesh.shape.kind) {
+            const auto &shape = mesh.shape;
+            for (auto param: {shape.radius, shape.thickness, shape.start_angle, shape.end_angle}) {
+                std::uint32_t bits;
+                std::memcpy(&bits, &param, sizeof(bits));
+                where = (where ^ bits) * 16777619u;
+            }
+            where ^= (shape.kind * 2654435761u) ^ (shape.columns * 40503u) ^ shape.rows;
+        }
+        auto low = width - 5;
+        return ((std::uint64_t) (mesh.vao & 0x1f) << low) | ((where >> (32 - low)) & ((1u << low) - 1));
+    }
+
+    std::uint64_t quantize(float depth, unsigned width) {
+        auto max = (std::uint64_t{1} << width) - 1;
+        return (std::uint64_t) (std::min(std::max(depth, 0.0f), 1.0f) * (float) max);
+    }
+} // namespace
+
+namespace render_queue {
+    std::uint64_t make_key(const item_t &item, float depth) {
+        auto material = (std::uint64_t) std::max(item.material->ubo_slot, 0);
+        auto texture = (std::uint64_t) item.material->diffuse_map;
+
+        if (item.flags & TRANSLUCENT) {
+            auto far_to_near = (std::uint64_t{1} << 20) - 1 - quantize(depth, 20);
+            return TRANSLUCENT_BIT
+                   | field(far_to_near, 20, 43)
+                   | field(item.program, PROGRAM_BITS, 33)
+                   | field(material, 12, 21)
+                   | field(texture, 12, 9)
+                   | field(mesh_bits(*item.mesh, 9), 9, 0);
+        }
+        return field(item.program, PROGRAM_BITS, 53)
+               | field(material, 12, 41)
+               | field(texture, 12, 29)
+               | field(mesh_bits(*item.mesh, 13), 13, 16)
+               | field(quantize(depth, 16), 16, 0);
+    }
+
+    void clear(queue_t &queue) {
+        queue.items.clear();
+        queue.entries.clear();
+    }
+
+    void push(queue_t &queue, const item_t &item) {
+        queue.items.push_back(item);
+    }
+
+    void sort(queue_t &queue) {
+        auto max_depth = 0.0f;
+        for (const auto &item: queue.items) {
+            max_depth = std::max(max_depth, item.depth);
+        }
+        auto scale = max_depth > 0.0f ? 1.0f / max_depth : 0.0f;
+
+        queue.entries.clear();
+        for (auto i = std::uint32_t{0}; i < queue.items.size(); ++i) {
+            queue.entries.push_back({make_key(queue.items[i], queue.items[i].depth * scale), i});
+        }
+
+        // stable, so equal keys keep their scene graph order
+        std::stable_sort(queue.entries.begin(), queue.entries.end(),
+                         [](const entry_t &a, const entry_t &b) { return a.key < b.key; });
+    }
+
+    bool same_batch(const item_t &a, const item_t &b) {
+        return a.mesh->first_index == b.mesh->first_index
+               && a.mesh->base_vertex == b.mesh->base_vertex
+               && a.mesh->indices_count == b.mesh->indices_count
+               && same_state(a, b);
+    }
+
+    bool same_state(const item_t &a, const item_t &b) {
+        const auto &ma = *a.material;
+        const auto &mb = *b.material;
+        return a.mesh->vao == b.mesh->vao
+               && a.range_count == 0 && b.range_count == 0
+               && a.stream == b.stream
+               && a.mesh->primitive == b.mesh->primitive
+               && a.mesh->shape == b.mesh->shape
+               && a.program == b.program
+               && a.flags == b.flags
+               && a.polygon_offset == b.polygon_offset
+               && ma.ubo_slot == mb.ubo_slot
+               && ma.diffuse_map == mb.diffuse_map
+               && ma.specular_map == mb.specular_map
+               && ma.cube_map == mb.cube_map
+               && ma.normal_map == mb.normal_map
+               && ma.height_map == mb.height_map
+               && ma.ambient_map == mb.ambient_map
+               && ma.roughness_map == mb.roughness_map
+               && ma.reflection_map == mb.reflection_map;
+    }
+} // namespace render_queue
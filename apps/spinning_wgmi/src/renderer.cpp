@@ -2,9 +2,20 @@
 #include "texture_2d.hpp"
 #include "euler_camera.hpp"
 #include "mesh.hpp"
+#include "gl_state.hpp"
+#include "stream_buffer.hpp"
+#include "vertex_layout.hpp"
 
 #include "chicken3421/chicken3421.hpp"
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
 
 const char *VERT_PATH = "res/shaders/shader.vert";
 const char *FRAG_PATH = "res/shaders/shader.frag";
@@ -12,38 +23,216 @@ const char *FRAG_PATH = "res/shaders/shader.frag";
 const char *SKYBOX_VERT_PATH = "res/shaders/skybox.vert";
 const char *SKYBOX_FRAG_PATH = "res/shaders/skybox.frag";
 
+namespace {
+    const char *UNIFORM_NAMES[renderer::UNIFORM_COUNT] = {
+            "uViewProj",
+
+            "uDiffuseMap",
+            "uSpecularMap",
+            "uCubeMap",
+            "uNormalMap",
+            "uHeightMap",
+            "uAmbientMap",
+            "uRoughnessMap",
+            "uReflectionMap",
+
+            "uShape",
+            "uShapeGrid",
+    };
+
+    // std140 mirrors of the uniform blocks in shader.vert/shader.frag
+    struct light_block_t {
+        glm::vec3 direction; // position for the spot light
+        float pad0;
+        glm::vec3 diffuse;
+        float pad1;
+        glm::vec3 ambient;
+        float pad2;
+        glm::vec3 specular;
+        float pad3;
+    };
+
+    struct frame_block_t {
+        glm::mat4 view_proj;
+        glm::vec3 camera_pos;
+        float now;
+        light_block_t sun;
+        light_block_t spot;
+    };
+    static_assert(sizeof(frame_block_t) == 208, "FrameBlock must match its std140 layout");
+
+    struct material_block_t {
+        glm::vec3 ambient;
+        float pad0;
+        glm::vec4 diffuse;
+        glm::vec3 specular;
+        float phong_exp;
+        float diffuse_map_factor;
+        float specular_map_factor;
+        float cube_map_factor;
+        float normal_map_factor;
+        float ambient_map_factor;
+        float roughness_map_factor;
+        float reflection_map_factor;
+        // std140 rounds a block holding a struct up to 16 bytes, and GL wants at least that much bound
+        float pad1;
+    };
+    static_assert(sizeof(material_block_t) == 80, "MaterialBlock must match its std140 layout");
+
+    const char *FEATURE_NAMES[renderer::FEATURE_COUNT] = {
+            "HAS_DIFFUSE_MAP",
+            "HAS_SPECULAR_MAP",
+            "HAS_CUBE_MAP",
+            "HAS_NORMAL_MAP",
+            "HAS_HEIGHT_MAP",
+            "HAS_AMBIENT_MAP",
+            "HAS_ROUGHNESS_MAP",
+            "HAS_REFLECTION_MAP",
+            "IS_WATER",
+            "IS_WATER_SURFACE",
+            "RAINBOW",
+            "PROCEDURAL",
+            "QUANTIZED",
+    };
+
+    std::uint32_t material_features(const model::material_t &mat) {
+        auto features = std::uint32_t{0};
+        if (mat.diffuse_map) features |= renderer::HAS_DIFFUSE_MAP;
+        if (mat.specular_map) features |= renderer::HAS_SPECULAR_MAP;
+        if (mat.cube_map) features |= renderer::HAS_CUBE_MAP;
+        if (mat.normal_map) features |= renderer::HAS_NORMAL_MAP;
+        if (mat.height_map) features |= renderer::HAS_HEIGHT_MAP;
+        if (mat.ambient_map) features |= renderer::HAS_AMBIENT_MAP;
+        if (mat.roughness_map) features |= renderer::HAS_ROUGHNESS_MAP;
+        if (mat.reflection_map) features |= renderer::HAS_REFLECTION_MAP;
+        return features;
+    }
+
+    // like chicken3421::make_shader, with the defines placed after the #version line
+    GLuint make_shader(const std::string &path, GLenum type, const std::vector<std::string> &defines) {
+        auto source = chicken3421::read_file(path);
+        auto header = std::string{};
+        for (const auto &define: defines) {
+            header += "#define " + define + "\n";
+        }
+        auto version_end = source.find('\n', source.find("#version"));
+        source.insert(version_end == std::string::npos ? source.size() : version_end + 1, header);
+
+        GLuint shader = glCreateShader(type);
+        const char *src = source.c_str();
+        glShaderSource(shader, 1, &src, nullptr);
+        glCompileShader(shader);
+
+        GLint did_compile = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &did_compile);
+        chicken3421::expect(did_compile, path + ": " + chicken3421::get_shader_log(shader));
+        return shader;
+    }
+
+    material_block_t make_material_block(const model::material_t &mat) {
+        auto block = material_block_t{};
+        block.ambient = mat.ambient;
+        block.diffuse = mat.diffuse;
+        block.specular = mat.specular;
+        block.phong_exp = mat.phong_exp;
+        block.diffuse_map_factor = mat.diffuse_map ? 1.0f : 0.0f;
+        block.specular_map_factor = mat.specular_map ? 1.0f : 0.0f;
+        block.cube_map_factor = mat.cube_map ? mat.cube_map_factor : 0.0f;
+        block.normal_map_factor = mat.normal_map ? 1.0f : 0.0f;
+        block.ambient_map_factor = mat.ambient_map ? 1.0f : 0.0f;
+        block.roughness_map_factor = mat.roughness_map ? 1.0f : 0.0f;
+        block.reflection_map_factor = mat.reflection_map ? mat.reflection_map_factor : 0.0f;
+        return block;
+    }
+} // namespace
+
 namespace renderer {
-    int locate(const std::string &name) {
-        GLint program;
-        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-        int loc = glGetUniformLocation(program, name.c_str());
-        chicken3421::expect(loc != -1, "uniform not found: " + name);
-        return loc;
+    void set_uniform(GLint location, float value) {
+        glUniform1f(location, value);
     }
 
-    void set_uniform(const std::string &name, float value) {
-        glUniform1f(locate(name), value);
+    void set_uniform(GLint location, int value) {
+        glUniform1i(location, value);
     }
 
-    void set_uniform(const std::string &name, int value) {
-        glUniform1i(locate(name), value);
+    void set_uniform(GLint location, glm::vec4 value) {
+        glUniform4fv(location, 1, glm::value_ptr(value));
     }
 
-    void set_uniform(const std::string &name, glm::vec4 value) {
-        glUniform4fv(locate(name), 1, glm::value_ptr(value));
+    void set_uniform(GLint location, glm::vec3 value) {
+        glUniform3fv(location, 1, glm::value_ptr(value));
     }
 
-    void set_uniform(const std::string &name, glm::vec3 value) {
-        glUniform3fv(locate(name), 1, glm::value_ptr(value));
+    void set_uniform(GLint location, glm::ivec3 value) {
+        glUniform3iv(location, 1, glm::value_ptr(value));
     }
 
-    void set_uniform(const std::string &name, const glm::mat4 &value) {
-        glUniformMatrix4fv(locate(name), 1, GL_FALSE, glm::value_ptr(value));
+    void set_uniform(GLint location, const glm::mat4 &value) {
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
     }
 
-    GLuint load_program(const std::string &vs_path, const std::string &fs_path) {
-        GLuint vs = chicken3421::make_shader(vs_path, GL_VERTEX_SHADER);
-        GLuint fs = chicken3421::make_shader(fs_path, GL_FRAGMENT_SHADER);
+    // reflect the active uniforms of a linked program once, so drawing never looks names up
+    program_t reflect_program(GLuint handle) {
+        auto program = program_t{};
+        program.handle = handle;
+        program.uniforms.fill(-1);
+
+        GLint n_uniforms = 0;
+        GLint max_name_length = 0;
+        glGetProgramiv(handle, GL_ACTIVE_UNIFORMS, &n_uniforms);
+        glGetProgramiv(handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+        auto name = std::string((size_t) max_name_length, '\0');
+        for (GLint i = 0; i < n_uniforms; ++i) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(handle, (GLuint) i, max_name_length, &length, &size, &type, &name[0]);
+            auto active = name.substr(0, (size_t) length);
+            // arrays are reported as "name[0]"
+            auto bracket = active.find('[');
+            if (bracket != std::string::npos) active.resize(bracket);
+
+            for (int u = 0; u < UNIFORM_COUNT; ++u) {
+                if (active == UNIFORM_NAMES[u]) {
+                    program.uniforms[u] = glGetUniformLocation(handle, active.c_str());
+                    break;
+                }
+            }
+        }
+
+        // the ranges bound to the blocks are the size of their mirrors, which mustn't be short of what the
+        // program says the blocks take
+        auto bind_block = [handle](const char *name, GLuint binding, size_t mirror_size) {
+            GLuint block = glGetUniformBlockIndex(handle, name);
+            if (block == GL_INVALID_INDEX) return;
+            glUniformBlockBinding(handle, block, binding);
+            GLint data_size = 0;
+            glGetActiveUniformBlockiv(handle, block, GL_UNIFORM_BLOCK_DATA_SIZE, &data_size);
+            chicken3421::expect((size_t) data_size <= mirror_size,
+                                std::string(name) + " is bigger than its mirror, update the std140 layout");
+        };
+        bind_block("FrameBlock", FRAME_BLOCK_BINDING, sizeof(frame_block_t));
+        bind_block("MaterialBlock", MATERIAL_BLOCK_BINDING, sizeof(material_block_t));
+
+        // sampler units never change, so set them once
+        gl_state::use_program(handle);
+        set_uniform(program.uniforms[U_DIFFUSE_MAP], 0);
+        set_uniform(program.uniforms[U_SPECULAR_MAP], 1);
+        set_uniform(program.uniforms[U_CUBE_MAP], 2);
+        set_uniform(program.uniforms[U_NORMAL_MAP], 3);
+        set_uniform(program.uniforms[U_HEIGHT_MAP], 4);
+        set_uniform(program.uniforms[U_AMBIENT_MAP], 5);
+        set_uniform(program.uniforms[U_ROUGHNESS_MAP], 6);
+        set_uniform(program.uniforms[U_REFLECTION_MAP], 7);
+
+        return program;
+    }
+
+    GLuint load_program(const std::string &vs_path, const std::string &fs_path,
+                        const std::vector<std::string> &defines) {
+        GLuint vs = make_shader(vs_path, GL_VERTEX_SHADER, defines);
+        GLuint fs = make_shader(fs_path, GL_FRAGMENT_SHADER, defines);
         GLuint handle = chicken3421::make_program(vs, fs);
         chicken3421::delete_shader(vs);
         chicken3421::delete_shader(fs);
@@ -51,151 +240,478 @@ namespace renderer {
         return handle;
     }
 
+    std::uint32_t get_variant(renderer_t &renderer, std::uint32_t features) {
+        auto found = renderer.variant_of.find(features);
+        if (found != renderer.variant_of.end()) return found->second;
+
+        auto defines = std::vector<std::string>{};
+        for (auto f = 0u; f < FEATURE_COUNT; ++f) {
+            if (features & (1u << f)) defines.emplace_back(FEATURE_NAMES[f]);
+        }
+        auto index = (std::uint32_t) renderer.variants.size();
+        chicken3421::expect(index < (1u << render_queue::PROGRAM_BITS), "too many program variants to sort by");
+        renderer.variants.push_back(reflect_program(load_program(VERT_PATH, FRAG_PATH, defines)));
+        renderer.variant_of.emplace(features, index);
+        return index;
+    }
+
     renderer_t init(const glm::mat4 &projection) {
-        glEnable(GL_DEPTH_TEST);
-//        glEnable(GL_CULL_FACE);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        gl_state::enable(GL_DEPTH_TEST);
+//        gl_state::enable(GL_CULL_FACE);
+        // blending is switched on per draw item, only translucent ones need it
+        gl_state::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         auto renderer = renderer_t{};
         renderer.projection = projection;
 
-        // make the render program
-        renderer.program = load_program(VERT_PATH, FRAG_PATH);
-        renderer.skybox_program = load_program(SKYBOX_VERT_PATH, SKYBOX_FRAG_PATH);
+        // variants of the render program are made as they're needed
+        renderer.skybox_program = reflect_program(load_program(SKYBOX_VERT_PATH, SKYBOX_FRAG_PATH));
+
+        glGenBuffers(1, &renderer.frame_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, renderer.frame_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(frame_block_t), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, renderer.frame_ubo);
+
+        // material ranges are bound by offset, which has to respect the implementation's alignment
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = std::max(alignment, 1);
+        renderer.material_stride = (sizeof(material_block_t) + alignment - 1) / alignment * alignment;
+        glGenBuffers(1, &renderer.material_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glGenBuffers(1, &renderer.instance_vbo);
+
+        GLint major = 0;
+        GLint minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major > 4 || (major == 4 && minor >= 3)) {
+            renderer.multi_draw_indirect = reinterpret_cast<multi_draw_elements_indirect_t>(
+                    glfwGetProcAddress("glMultiDrawElementsIndirect"));
+        }
+        if (renderer.multi_draw_indirect) glGenBuffers(1, &renderer.indirect_buffer);
 
         return renderer;
     }
 
+    void upload_materials(renderer_t &renderer, scene::scene_t &scene) {
+        auto materials = std::vector<model::material_t *>{};
+        for (auto &model: scene.models) {
+            for (auto &mat: model.materials) {
+                materials.push_back(&mat);
+            }
+        }
+
+        // separately built models often carry equal materials, give them a single slot
+        auto slots = std::unordered_map<std::string, int>{};
+        auto data = std::vector<char>{};
+        for (auto mat: materials) {
+            auto block = make_material_block(*mat);
+            auto bytes = std::string(reinterpret_cast<const char *>(&block), sizeof(block));
+            auto slot = slots.emplace(bytes, (int) slots.size());
+            if (slot.second) {
+                data.resize(slots.size() * renderer.material_stride, 0);
+                std::memcpy(&data[slot.first->second * renderer.material_stride], &block, sizeof(block));
+            }
+            mat->ubo_slot = slot.first->second;
+        }
+        data.resize(std::max<size_t>(slots.size(), 1) * renderer.material_stride, 0);
+
+        glBindBuffer(GL_UNIFORM_BUFFER, renderer.material_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr) data.size(), data.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
     void draw_skybox(const model::model_t &model, const renderer_t &renderer, const glm::mat4 &view) {
-        glUseProgram(renderer.skybox_program);
-        glFrontFace(GL_CW);
-        glDepthMask(GL_FALSE);
+        const auto &u = renderer.skybox_program.uniforms;
+        gl_state::use_program(renderer.skybox_program.handle);
+        gl_state::front_face(GL_CW);
+        gl_state::depth_mask(false);
 
-        set_uniform("uCubeMap", 0);
-        set_uniform("uViewProj", renderer.projection * glm::mat4(glm::mat3(view)));
+        set_uniform(u[U_CUBE_MAP], 0);
+        set_uniform(u[U_VIEW_PROJ], renderer.projection * glm::mat4(glm::mat3(view)));
         for (auto i = size_t{0}; i < model.meshes.size(); ++i) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, model.materials[i].cube_map);
+            gl_state::bind_texture_unit(0, GL_TEXTURE_CUBE_MAP, model.materials[i].cube_map);
             mesh::draw(model.meshes[i]);
         }
-        glFrontFace(GL_CCW);
-        glDepthMask(GL_TRUE);
-        glUseProgram(0);
-    }
-
-    void draw(const scene::node_t &node, const renderer_t &renderer, glm::mat4 model,
-              glm::vec2 polygon_offset = glm::vec2(0)) {
-        model *= glm::translate(glm::mat4(1.0), node.translation);
-        model *= glm::rotate(glm::mat4(1.0), node.rotation.z, glm::vec3(0, 0, 1));
-        model *= glm::rotate(glm::mat4(1.0), node.rotation.y, glm::vec3(0, 1, 0));
-        model *= glm::rotate(glm::mat4(1.0), node.rotation.x, glm::vec3(1, 0, 0));
-        model *= glm::scale(glm::mat4(1.0), node.scale);
-
-        auto color_rotation = glm::mat4(1.0f);
-        color_rotation *= glm::rotate(glm::mat4(1.0), node.color_rotation.z, glm::vec3(0,0,1));
-        color_rotation *= glm::rotate(glm::mat4(1.0), node.color_rotation.y, glm::vec3(0,1,0));
-        color_rotation *= glm::rotate(glm::mat4(1.0), node.color_rotation.x, glm::vec3(1,0,0));
-
-        set_uniform("uModel", model);
-        set_uniform("uRainbow", (float)node.rainbow_colors);
-        set_uniform("uColorRotation", color_rotation);
-        set_uniform("uColorOffset", node.color_offset);
-
-        if (!node.visible) return;
-        if(node.clipping) glEnable(GL_CLIP_DISTANCE0);
-//        if(node.show_line_mesh) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-
-        polygon_offset += node.polygon_offset;
-        glPolygonOffset(polygon_offset.x, polygon_offset.y);
-        for (auto i = size_t{0}; i < node.model.meshes.size(); ++i) {
-            set_uniform("uDiffuseMapFactor", node.model.materials[i].diffuse_map ? 1.0f : 0.0f);
-            set_uniform("uSpecularMapFactor", node.model.materials[i].specular_map ? 1.0f : 0.0f);
-            set_uniform("uCubeMapFactor",
-                        node.model.materials[i].cube_map ? node.model.materials[i].cube_map_factor : 0.0f);
-            set_uniform("uNormalMapFactor", node.model.materials[i].normal_map ? 1.0f : 0.0f);
-            set_uniform("uAmbientMapFactor", node.model.materials[i].ambient_map ? 1.0f : 0.0f);
-            set_uniform("uRoughnessMapFactor", node.model.materials[i].roughness_map ? 1.0f : 0.0f);
-            set_uniform("uReflectionMapFactor",
-                        node.model.materials[i].reflection_map ? node.model.materials[i].reflection_map_factor
-                                                               : 0.0f);
-
-            set_uniform("uMat.ambient", node.model.materials[i].ambient);
-            set_uniform("uMat.diffuse", node.model.materials[i].diffuse);
-            set_uniform("uMat.specular", node.model.materials[i].specular);
-            set_uniform("uMat.phongExp", node.model.materials[i].phong_exp);
-            set_uniform("uIsWater", node.kind == scene::node_t::WATER || node.kind == scene::node_t::WATER_SURFACE);
-            set_uniform("uIsWaterSurface", node.kind == scene::node_t::WATER_SURFACE);
-
-            glActiveTexture(GL_TEXTURE0);
-            texture_2d::bind(node.model.materials[i].diffuse_map);
-            glActiveTexture(GL_TEXTURE1);
-            texture_2d::bind(node.model.materials[i].specular_map);
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, node.model.materials[i].cube_map);
-            glActiveTexture(GL_TEXTURE3);
-            texture_2d::bind(node.model.materials[i].normal_map);
-            glActiveTexture(GL_TEXTURE4);
-            texture_2d::bind(node.model.materials[i].height_map);
-            glActiveTexture(GL_TEXTURE5);
-            texture_2d::bind(node.model.materials[i].ambient_map);
-            glActiveTexture(GL_TEXTURE6);
-            texture_2d::bind(node.model.materials[i].roughness_map);
-            glActiveTexture(GL_TEXTURE7);
-            texture_2d::bind(node.model.materials[i].reflection_map);
-
-            mesh::draw(node.model.meshes[i]);
-        }
-
-//        if(node.clipping) glDisable(GL_CLIP_DISTANCE0);
-        if(node.show_line_mesh) glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-        for (auto const &child: node.children) {
-            draw(child, renderer, model, polygon_offset);
-        }
-    }
-
-    void render(const renderer_t &renderer,
+        gl_state::front_face(GL_CCW);
+        gl_state::depth_mask(true);
+    }
+
+    // the worst error of the model's meshes at a level of detail, meshes with shorter chains staying at
+    // their coarsest
+    float level_error(const model::model_t &model, size_t level) {
+        auto error = 0.0f;
+        if (level == 0) return error;
+        for (const auto &lods: model.lods) {
+            if (!lods.empty()) error = std::max(error, lods[std::min(level, lods.size()) - 1].error);
+        }
+        return error;
+    }
+
+    const mesh::mesh_t &level_mesh(const model::model_t &model, size_t i, size_t level) {
+        if (level == 0 || model.lods.empty() || model.lods[i].empty()) return model.meshes[i];
+        const auto &lods = model.lods[i];
+        return lods[std::min(level, lods.size()) - 1].mesh;
+    }
+
+    // the level of detail to draw a node's model at, from how many pixels a model space unit covers at
+    // the nearest point of its bounds. Moves one way or the other from the level the node was last
+    // drawn at, see MAX_LOD_ERROR_PIXELS
+    size_t select_level(renderer_t &renderer, const scene::scene_t &scene, std::uint32_t node,
+                        const model::model_t &model, const glm::mat4 &view) {
+        auto levels = size_t{0};
+        for (const auto &lods: model.lods) levels = std::max(levels, lods.size());
+        if (levels == 0) return 0;
+
+        auto handle = scene.handle[node];
+        if (handle >= renderer.lod_levels.size()) renderer.lod_levels.resize(handle + 1, 0);
+        auto &level = renderer.lod_levels[handle];
+
+        const auto &world = scene.world[node];
+        auto scale = std::max({glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])),
+                               glm::length(glm::vec3(world[2]))});
+        auto center = (model.aabb.min + model.aabb.max) * 0.5f;
+        auto radius = glm::length(model.aabb.max - model.aabb.min) * 0.5f * scale;
+        auto depth = -(view * world * glm::vec4(center, 1.0f)).z - radius;
+        if (depth <= 0.0f) {
+            // the camera is at or inside the bounds
+            level = 0;
+            return level;
+        }
+        auto pixels = scale * renderer.projection[1][1] * renderer.viewport_height * 0.5f / depth;
+
+        level = (std::uint8_t) std::min((size_t) level, levels);
+        while (level > 0 && level_error(model, level) * pixels > MAX_LOD_ERROR_PIXELS) --level;
+        while (level < levels &&
+               level_error(model, level + 1) * pixels <= MAX_LOD_ERROR_PIXELS * (1.0f - LOD_HYSTERESIS)) {
+            ++level;
+        }
+        return level;
+    }
+
+    // flatten the visible part of the scene into draw items in one pass over its nodes, skipping
+    // subtrees that are hidden or outside the frustum, and the clusters of big meshes that can't be seen
+    void enqueue(const scene::scene_t &scene, renderer_t &renderer, const glm::mat4 &view,
+                 const bounds::frustum_t &frustum, const glm::vec3 &camera_pos) {
+        auto n = (std::uint32_t) scene.parent.size();
+        auto inside_end = std::uint32_t{0}; // nodes before this are below a node entirely inside the frustum
+        for (auto node = std::uint32_t{0}; node < n;) {
+            auto flags = scene.flags[node];
+            if (!(flags & scene::VISIBLE)) {
+                node = scene.subtree_end[node];
+                continue;
+            }
+
+            bool inside = node < inside_end;
+            if (!inside) {
+                auto containment = bounds::classify(frustum, scene.bounds[node]);
+                if (containment == bounds::OUTSIDE) {
+                    ++renderer.stats.nodes_culled;
+                    node = scene.subtree_end[node];
+                    continue;
+                }
+                if (containment == bounds::INSIDE) {
+                    inside = true;
+                    inside_end = scene.subtree_end[node];
+                }
+            }
+            ++renderer.stats.nodes_visible;
+
+            if (scene.model[node] != scene::NO_MODEL) {
+                const auto &model = scene.models[scene.model[node]];
+                const auto &world = scene.world[node];
+
+                auto node_instance = mesh::instance_t{};
+                node_instance.model = world;
+                node_instance.color_rotation = scene.color_matrix[node];
+                auto color_offset = scene.color_offset[node];
+                node_instance.rainbow = glm::vec4((flags & scene::RAINBOW_COLORS) ? 1.0f : 0.0f,
+                                                  color_offset, color_offset, color_offset);
+
+                auto item = render_queue::item_t{};
+                item.polygon_offset = scene.world_polygon_offset[node];
+
+                auto kind = scene.kind[node];
+                auto item_flags = std::uint32_t{0};
+                auto node_features = std::uint32_t{0};
+                if (flags & scene::CLIPPING) item_flags |= render_queue::CLIPPING;
+                if (kind == scene::WATER || kind == scene::WATER_SURFACE) {
+                    item_flags |= render_queue::WATER;
+                    node_features |= IS_WATER;
+                }
+                if (kind == scene::WATER_SURFACE) {
+                    item_flags |= render_queue::WATER_SURFACE;
+                    node_features |= IS_WATER_SURFACE;
+                }
+                if (flags & scene::SHOW_LINE_MESH) item_flags |= render_queue::LINE_MESH;
+                if (flags & scene::RAINBOW_COLORS) node_features |= RAINBOW;
+
+                auto level = select_level(renderer, scene, node, model, view);
+                for (auto i = size_t{0}; i < model.meshes.size(); ++i) {
+                    const auto &mesh = model.meshes[i];
+                    auto sphere = bounds::transform(mesh.sphere, world);
+                    if (!inside && !bounds::intersects(frustum, sphere)) continue;
+
+                    const auto &mat = model.materials[i];
+                    item.mesh = &level_mesh(model, i, level);
+                    item.material = &mat;
+                    item.instance = node_instance;
+                    auto mesh_features = item.mesh->shape.kind ? PROCEDURAL : 0u;
+                    if (item.mesh->pool_format >= 0 && (item.mesh->pool_format & vertex_layout::QUANTIZED)) {
+                        // positions arrive as fractions of the mesh's quantization cube, so scale and move the
+                        // cube into place, and the rainbow offset with it (its colours are normalized)
+                        auto quantization = vertex_layout::quantization_of(item.mesh->aabb);
+                        item.instance.model = world * glm::translate(glm::mat4(1.0f), quantization.origin) *
+                                              glm::scale(glm::mat4(1.0f), glm::vec3(quantization.scale));
+                        auto offset = glm::vec3(node_instance.rainbow.y) + node_instance.color_rotation * quantization.origin;
+                        offset /= quantization.scale;
+                        item.instance.rainbow = glm::vec4(node_instance.rainbow.x, offset.x, offset.y, offset.z);
+                        mesh_features |= QUANTIZED;
+                    }
+                    item.program = get_variant(renderer, node_features | mesh_features | material_features(mat));
+                    item.depth = std::max(-(view * glm::vec4(sphere.center, 1.0f)).z, 0.0f);
+                    // a diffuse map can carry its own alpha, which makes it translucent too if any is below 1
+                    item.flags = item_flags;
+                    if (mat.diffuse.a < 1.0f || (mat.diffuse_map && texture_2d::is_translucent(mat.diffuse_map))) {
+                        item.flags |= render_queue::TRANSLUCENT;
+                    }
+
+                    // the finest level of a clustered mesh is drawn as the ranges of its clusters that can be
+                    // seen. Water and height maps move vertices past the clusters' bounds, so they're drawn whole
+                    item.first_range = 0;
+                    item.range_count = 0;
+                    item.stream = model.templates.empty() || item.mesh != &mesh ? nullptr : model.templates[i];
+                    auto clustered = !model.clusters.empty() && model.clusters[i].count && item.mesh == &mesh &&
+                                     !(item_flags & render_queue::WATER) && !mat.height_map;
+                    if (clustered) {
+                        // backs of a closed mesh are only hidden by its fronts when they're filled and opaque
+                        auto mode = item_flags & render_queue::LINE_MESH ? GL_LINE : renderer.polygon_mode;
+                        auto cull_backfaces = mode == GL_FILL &&
+                                              !(item.flags & (render_queue::TRANSLUCENT | render_queue::CLIPPING));
+                        auto &ranges = renderer.cluster_ranges;
+                        item.first_range = (std::uint32_t) ranges.first_indices.size();
+                        auto visible = clusters::cull(model.clusters[i], world, frustum, camera_pos, cull_backfaces,
+                                                      ranges);
+                        item.range_count = (std::uint32_t) ranges.first_indices.size() - item.first_range;
+                        renderer.stats.clusters_visible += visible;
+                        renderer.stats.clusters_culled += model.clusters[i].count - visible;
+                        if (visible == 0) continue;
+                    }
+                    render_queue::push(renderer.queue, item);
+                }
+            }
+            ++node;
+        }
+    }
+
+    // set up everything item is drawn with except its vertex state
+    void apply_state(const render_queue::item_t &item, const renderer_t &renderer) {
+        const auto &mat = *item.material;
+
+        gl_state::set_enabled(GL_BLEND, item.flags & render_queue::TRANSLUCENT);
+        gl_state::set_enabled(GL_CLIP_DISTANCE0, item.flags & render_queue::CLIPPING);
+        gl_state::polygon_mode(item.flags & render_queue::LINE_MESH ? GL_LINE : renderer.polygon_mode);
+        gl_state::polygon_offset(item.polygon_offset.x, item.polygon_offset.y);
+
+        const auto &program = renderer.variants[item.program];
+        gl_state::use_program(program.handle);
+        const auto &shape = item.mesh->shape;
+        if (shape.kind) {
+            set_uniform(program.uniforms[U_SHAPE],
+                        glm::vec4(shape.radius, shape.thickness, shape.start_angle, shape.end_angle));
+            set_uniform(program.uniforms[U_SHAPE_GRID], glm::ivec3(shape.kind, shape.columns, shape.rows));
+        }
+
+        chicken3421::expect(mat.ubo_slot >= 0, "material has no uniform buffer slot, call renderer::upload_materials");
+        gl_state::bind_buffer_range(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, renderer.material_ubo,
+                                    mat.ubo_slot * renderer.material_stride, sizeof(material_block_t));
+
+        gl_state::bind_texture_unit(0, GL_TEXTURE_2D, mat.diffuse_map);
+        gl_state::bind_texture_unit(1, GL_TEXTURE_2D, mat.specular_map);
+        gl_state::bind_texture_unit(2, GL_TEXTURE_CUBE_MAP, mat.cube_map);
+        gl_state::bind_texture_unit(3, GL_TEXTURE_2D, mat.normal_map);
+        gl_state::bind_texture_unit(4, GL_TEXTURE_2D, mat.height_map);
+        gl_state::bind_texture_unit(5, GL_TEXTURE_2D, mat.ambient_map);
+        gl_state::bind_texture_unit(6, GL_TEXTURE_2D, mat.roughness_map);
+        gl_state::bind_texture_unit(7, GL_TEXTURE_2D, mat.reflection_map);
+    }
+
+    // a clustered item is a batch of its own, drawn as the ranges of its visible clusters
+    void draw_clusters(renderer_t &renderer, const render_queue::item_t &item, GLsizei instance) {
+        const auto &ranges = renderer.cluster_ranges;
+        mesh::draw_ranges(*item.mesh, renderer.instance_vbo, instance, &ranges.first_indices[item.first_range],
+                          &ranges.index_counts[item.first_range], (GLsizei) item.range_count);
+        ++renderer.stats.draw_calls;
+    }
+
+    // a streamed item's mesh is rewritten from its template before its instances are drawn
+    void draw_streamed(renderer_t &renderer, const render_queue::item_t &item, const batch_t &batch) {
+        auto mesh = *item.mesh;
+        mesh::dynamic_draw(mesh, *item.stream, renderer.instance_vbo, batch.first, batch.count);
+        ++renderer.stats.draw_calls;
+    }
+
+    // one multi-draw per run of batches that share state
+    void submit_indirect(renderer_t &renderer) {
+        const auto &queue = renderer.queue;
+        const auto &batches = renderer.batches;
+
+        renderer.commands.clear();
+        for (const auto &batch: batches) {
+            const auto &mesh = *queue.items[queue.entries[batch.first].item].mesh;
+            renderer.commands.push_back({(GLuint) mesh.indices_count, (GLuint) batch.count, mesh.first_index,
+                                         mesh.base_vertex, (GLuint) batch.first});
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer.indirect_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, (GLsizeiptr) (renderer.commands.size() * sizeof(draw_command_t)),
+                     renderer.commands.data(), GL_STREAM_DRAW);
+
+        for (auto first = size_t{0}; first < batches.size();) {
+            const auto &item = queue.items[queue.entries[batches[first].first].item];
+            apply_state(item, renderer);
+            if (item.range_count) {
+                draw_clusters(renderer, item, batches[first].first);
+                ++first;
+                continue;
+            }
+            if (item.stream) {
+                draw_streamed(renderer, item, batches[first]);
+                ++first;
+                continue;
+            }
+            if (item.mesh->shape.kind) {
+                // nothing to index, and same_state keeps other shapes out of the batch's run
+                mesh::draw_instanced(*item.mesh, renderer.instance_vbo, batches[first].first, batches[first].count);
+                ++renderer.stats.draw_calls;
+                ++first;
+                continue;
+            }
+
+            auto last = first + 1;
+            while (last < batches.size()) {
+                const auto &next = queue.items[queue.entries[batches[last].first].item];
+                if (!render_queue::same_state(item, next)) break;
+                ++last;
+            }
+            // base instance offsets the instance attributes, so they can stay at the start of the buffer
+            mesh::bind_instances(item.mesh->vao, renderer.instance_vbo, 0);
+            // same_state implies the same vertex array, and so the same pool and index type, and the
+            // same primitive
+            mesh::set_primitive_restart(*item.mesh);
+            renderer.multi_draw_indirect(item.mesh->primitive, item.mesh->index_type,
+                                         (void *) (first * sizeof(draw_command_t)), (GLsizei) (last - first), 0);
+            ++renderer.stats.draw_calls;
+            first = last;
+        }
+    }
+
+    void submit(renderer_t &renderer) {
+        const auto &queue = renderer.queue;
+        for (const auto &batch: renderer.batches) {
+            const auto &item = queue.items[queue.entries[batch.first].item];
+            apply_state(item, renderer);
+            if (item.range_count) {
+                draw_clusters(renderer, item, batch.first);
+                continue;
+            }
+            if (item.stream) {
+                draw_streamed(renderer, item, batch);
+                continue;
+            }
+            mesh::draw_instanced(*item.mesh, renderer.instance_vbo, batch.first, batch.count);
+            ++renderer.stats.draw_calls;
+        }
+    }
+
+    void render(renderer_t &renderer,
                 const euler_camera::camera_t &camera,
-                const scene::node_t &scene) {
+                const scene::scene_t &scene) {
+        auto start = std::chrono::steady_clock::now();
+        gl_state::reset_stats();
+
         glClearColor(0, 0, 0, 1.0);
 //        glClearColor(1, 1, 1, 1.0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_POLYGON_OFFSET_FILL);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        gl_state::enable(GL_POLYGON_OFFSET_FILL);
         auto view = euler_camera::get_view(camera);
 
-        glUseProgram(renderer.program);
-        set_uniform("uCameraPos", camera.pos);
-
-        set_uniform("uSun.direction", renderer.sun_light_dir);
-        set_uniform("uSun.diffuse", renderer.sun_light_diffuse);
-        set_uniform("uSun.ambient", renderer.sun_light_ambient);
-        set_uniform("uSun.specular", renderer.sun_light_specular);
-
-        set_uniform("uSpot.position", renderer.spot_light_pos);
-        set_uniform("uSpot.diffuse", renderer.spot_light_diffuse);
-        set_uniform("uSpot.ambient", renderer.spot_light_ambient);
-        set_uniform("uSpot.specular", renderer.spot_light_specular);
-
-        set_uniform("uDiffuseMap", 0);
-        set_uniform("uSpecularMap", 1);
-        set_uniform("uCubeMap", 2);
-        set_uniform("uNormalMap", 3);
-        set_uniform("uHeightMap", 4);
-        set_uniform("uAmbientMap", 5);
-        set_uniform("uRoughnessMap", 6);
-        set_uniform("uReflectionMap", 7);
-
-        set_uniform("uNow", (float) glfwGetTime());
+        auto frame = frame_block_t{};
+        frame.view_proj = renderer.projection * view;
+        frame.camera_pos = camera.pos;
+        frame.now = (float) glfwGetTime();
+        frame.sun.direction = renderer.sun_light_dir;
+        frame.sun.diffuse = renderer.sun_light_diffuse;
+        frame.sun.ambient = renderer.sun_light_ambient;
+        frame.sun.specular = renderer.sun_light_specular;
+        frame.spot.direction = renderer.spot_light_pos;
+        frame.spot.diffuse = renderer.spot_light_diffuse;
+        frame.spot.ambient = renderer.spot_light_ambient;
+        frame.spot.specular = renderer.spot_light_specular;
+        glBindBuffer(GL_UNIFORM_BUFFER, renderer.frame_ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
 //        set_uniform("uClipPlane", renderer.clip_plane);
 
-        auto view_proj = renderer.projection * view;
-        set_uniform("uViewProj", view_proj);
+        renderer.stats.nodes_visible = 0;
+        renderer.stats.nodes_culled = 0;
+        renderer.stats.clusters_visible = 0;
+        renderer.stats.clusters_culled = 0;
+        render_queue::clear(renderer.queue);
+        clusters::clear(renderer.cluster_ranges);
+        enqueue(scene, renderer, view, bounds::make_frustum(frame.view_proj), camera.pos);
+        render_queue::sort(renderer.queue);
+
+        // lay the instances out in draw order, so every batch is a contiguous range
+        const auto &queue = renderer.queue;
+        renderer.instances.clear();
+        for (const auto &entry: queue.entries) {
+            renderer.instances.push_back(queue.items[entry.item].instance);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, renderer.instance_vbo);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (renderer.instances.size() * sizeof(mesh::instance_t)),
+                     renderer.instances.data(), GL_STREAM_DRAW);
+
+        renderer.batches.clear();
+        for (auto first = size_t{0}; first < queue.entries.size();) {
+            const auto &item = queue.items[queue.entries[first].item];
+            auto last = first + 1;
+            while (last < queue.entries.size() && render_queue::same_batch(item, queue.items[queue.entries[last].item])) {
+                ++last;
+            }
+            renderer.batches.push_back({(GLsizei) first, (GLsizei) (last - first)});
+            first = last;
+        }
 
-        draw(scene, renderer, glm::mat4(1.0f));
+        renderer.stats.draw_calls = 0;
+        if (renderer.multi_draw_indirect) {
+            submit_indirect(renderer);
+        } else {
+            submit(renderer);
+        }
 
-        glDisable(GL_POLYGON_OFFSET_FILL);
+        gl_state::disable(GL_POLYGON_OFFSET_FILL);
+        // everything streamed this frame has been drawn
+        stream_buffer::next_frame();
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        renderer.stats.cpu_ms = elapsed.count();
+        renderer.stats.state_calls = gl_state::stats();
+        renderer.stats.draw_items = renderer.queue.entries.size();
+        renderer.stats.batches = renderer.batches.size();
+        renderer.stats.triangles = 0;
+        const auto &ranges = renderer.cluster_ranges;
+        for (const auto &entry: queue.entries) {
+            const auto &item = queue.items[entry.item];
+            if (item.range_count == 0) {
+                renderer.stats.triangles += (unsigned long) item.mesh->triangle_count;
+                continue;
+            }
+            for (auto r = item.first_range; r < item.first_range + item.range_count; ++r) {
+                renderer.stats.triangles += (unsigned long) ranges.index_counts[r] / 3;
+            }
+        }
     }
 } // namespace renderer
@@ -1,46 +1,329 @@
 #include "scene.hpp"
-#include "shapes.hpp"
+#include "geometry_cache.hpp"
+#include "procedural.hpp"
 #include "cubemap.hpp"
 #include "texture_2d.hpp"
 #include <iostream>
+#include <numeric>
+#include <type_traits>
+
+namespace {
+    // every per-node array, for reordering them all at once
+    template<typename Each>
+    void for_each_array(scene::scene_t &scene, Each &&each) {
+        each(scene.parent);
+        each(scene.subtree_end);
+        each(scene.handle);
+        each(scene.model);
+        each(scene.kind);
+        each(scene.flags);
+        each(scene.translation);
+        each(scene.rotation);
+        each(scene.scale);
+        each(scene.polygon_offset);
+        each(scene.color_rotation);
+        each(scene.color_offset);
+        each(scene.local);
+        each(scene.world);
+        each(scene.color_matrix);
+        each(scene.world_polygon_offset);
+        each(scene.bounds);
+        each(scene.dirty);
+    }
+
+    // add a default node after every other. It's only in pre-order if the parent's subtree ended the
+    // arrays, anything else is left for linearize
+    void append_node(scene::scene_t &scene, std::uint32_t parent, scene::node_handle_t handle,
+                     scene::model_handle_t model) {
+        auto at = (std::uint32_t) scene.parent.size();
+        if (parent != scene::NO_NODE && scene.subtree_end[parent] != at) scene.in_pre_order = false;
+
+        scene.parent.push_back(parent);
+        scene.subtree_end.push_back(at + 1);
+        scene.handle.push_back(handle);
+        scene.model.push_back(model);
+        scene.kind.push_back(scene::EMPTY);
+        scene.flags.push_back((std::uint8_t) scene::VISIBLE);
+        scene.translation.push_back(glm::vec3(0.0f));
+        scene.rotation.push_back(glm::quat(1, 0, 0, 0));
+        scene.scale.push_back(glm::vec3(1.0f));
+        scene.polygon_offset.push_back(glm::vec2(0.0f));
+        scene.color_rotation.push_back(glm::quat(1, 0, 0, 0));
+        scene.color_offset.push_back(0.0f);
+        scene.local.push_back(glm::mat4(1.0f));
+        scene.world.push_back(glm::mat4(1.0f));
+        scene.color_matrix.push_back(glm::mat3(1.0f));
+        scene.world_polygon_offset.push_back(glm::vec2(0.0f));
+        scene.bounds.push_back(bounds::aabb_t{});
+        scene.dirty.push_back((std::uint8_t) 1);
+
+        if (!scene.in_pre_order) return;
+        for (auto ancestor = parent; ancestor != scene::NO_NODE; ancestor = scene.parent[ancestor]) {
+            ++scene.subtree_end[ancestor];
+        }
+    }
+
+    // put nodes appended out of order back in pre-order, each after its parent's other descendants, in
+    // one pass however many there are
+    void linearize(scene::scene_t &scene) {
+        if (scene.in_pre_order) return;
+        auto n = (std::uint32_t) scene.parent.size();
+
+        // children of each node in the order they were added, which is index order. Roots are the
+        // children of n
+        auto offsets = std::vector<std::uint32_t>(n + 3, 0);
+        for (auto i = std::uint32_t{0}; i < n; ++i) {
+            ++offsets[(scene.parent[i] == scene::NO_NODE ? n : scene.parent[i]) + 2];
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        auto children = std::vector<std::uint32_t>(n);
+        for (auto i = std::uint32_t{0}; i < n; ++i) {
+            children[offsets[(scene.parent[i] == scene::NO_NODE ? n : scene.parent[i]) + 1]++] = i;
+        }
+
+        // walk down from the roots, order[new index] = old index
+        auto order = std::vector<std::uint32_t>{};
+        order.reserve(n);
+        auto new_index = std::vector<std::uint32_t>(n);
+        auto subtree_end = std::vector<std::uint32_t>(n);
+        auto stack = std::vector<std::uint32_t>{};
+        for (auto root = offsets[n + 1]; root-- > offsets[n];) {
+            stack.push_back(children[root]);
+        }
+        while (!stack.empty()) {
+            auto node = stack.back();
+            stack.pop_back();
+            if (node >= n) {
+                // pushed again under its own children to close its subtree once they're all placed
+                subtree_end[node - n] = (std::uint32_t) order.size();
+                continue;
+            }
+            new_index[node] = (std::uint32_t) order.size();
+            order.push_back(node);
+            stack.push_back(node + n);
+            for (auto child = offsets[node + 1]; child-- > offsets[node];) {
+                stack.push_back(children[child]);
+            }
+        }
+
+        for_each_array(scene, [&](auto &values) {
+            auto moved = std::remove_reference_t<decltype(values)>{};
+            moved.reserve(n);
+            for (auto old: order) {
+                moved.push_back(values[old]);
+            }
+            values.swap(moved);
+        });
+        for (auto i = std::uint32_t{0}; i < n; ++i) {
+            auto old = order[i];
+            if (scene.parent[i] != scene::NO_NODE) scene.parent[i] = new_index[scene.parent[i]];
+            scene.subtree_end[i] = subtree_end[old];
+            scene.index_of[scene.handle[i]] = i;
+        }
+        scene.in_pre_order = true;
+    }
+
+    // box around the node's own model in world space
+    bounds::aabb_t own_bounds(const scene::scene_t &scene, std::uint32_t i) {
+        if (scene.model[i] == scene::NO_MODEL) return bounds::aabb_t{};
+        return bounds::transform(scene.models[scene.model[i]].aabb, scene.world[i]);
+    }
+} // namespace
 
 namespace scene {
-    node_t make_wgmi_head(float radius, float thickness) {
+    model_handle_t add_model(scene_t &scene, model::model_t model) {
+        model::update_bounds(model);
+        scene.models.push_back(std::move(model));
+        return (model_handle_t) (scene.models.size() - 1);
+    }
 
-        auto torus = scene::node_t{};
-        auto torus_template = shapes::make_torus(radius, thickness);
-        torus.model.meshes.push_back(mesh::init(torus_template));
-        auto torus_mat = model::material_t{};
-        torus_mat.diffuse = glm::vec4(0,0,0,1);
-        torus_mat.specular = glm::vec3(0);
-        torus.model.materials.push_back({});
+    node_handle_t add_node(scene_t &scene, node_handle_t parent, model_handle_t model) {
+        auto parent_index = parent == NO_NODE ? NO_NODE : index(scene, parent);
+        auto handle = (node_handle_t) scene.index_of.size();
 
-        auto horiz = scene::node_t{};
-        for(int i = 0; i < 4; ++i) {
-            auto ring = torus;
-            ring.rotation.z = glm::radians(45.0f) * i;
-            horiz.children.push_back(ring);
+        scene.index_of.push_back((std::uint32_t) scene.parent.size());
+        append_node(scene, parent_index, handle, model);
+        return handle;
+    }
+
+    node_handle_t copy_subtree(scene_t &scene, node_handle_t node, node_handle_t parent) {
+        // the subtree is contiguous once in pre-order, and copies are appended after it, so its
+        // indices stay put and a source's parent is found by its offset from the first
+        linearize(scene);
+        auto first = index(scene, node);
+        auto count = scene.subtree_end[first] - first;
+        auto copies = std::vector<node_handle_t>{};
+        copies.reserve(count);
+
+        for (auto i = std::uint32_t{0}; i < count; ++i) {
+            auto src = first + i;
+            auto copy_parent = i == 0 ? parent : copies[scene.parent[src] - first];
+            auto copy = add_node(scene, copy_parent, scene.model[src]);
+            auto dst = index(scene, copy);
+
+            scene.kind[dst] = scene.kind[src];
+            scene.flags[dst] = scene.flags[src];
+            scene.translation[dst] = scene.translation[src];
+            scene.rotation[dst] = scene.rotation[src];
+            scene.scale[dst] = scene.scale[src];
+            scene.polygon_offset[dst] = scene.polygon_offset[src];
+            scene.color_rotation[dst] = scene.color_rotation[src];
+            scene.color_offset[dst] = scene.color_offset[src];
+            copies.push_back(copy);
+        }
+        return copies.front();
+    }
+
+    std::uint32_t index(const scene_t &scene, node_handle_t node) {
+        return scene.index_of[node];
+    }
+
+    model::model_t &get_model(scene_t &scene, node_handle_t node) {
+        return scene.models[scene.model[index(scene, node)]];
+    }
+
+    glm::quat from_euler(const glm::vec3 &angles) {
+        return glm::angleAxis(angles.z, glm::vec3(0, 0, 1))
+               * glm::angleAxis(angles.y, glm::vec3(0, 1, 0))
+               * glm::angleAxis(angles.x, glm::vec3(1, 0, 0));
+    }
+
+    void set_translation(scene_t &scene, node_handle_t node, const glm::vec3 &translation) {
+        auto i = index(scene, node);
+        scene.translation[i] = translation;
+        scene.dirty[i] = 1;
+    }
+
+    void set_rotation(scene_t &scene, node_handle_t node, const glm::quat &rotation) {
+        auto i = index(scene, node);
+        scene.rotation[i] = rotation;
+        scene.dirty[i] = 1;
+    }
+
+    void set_scale(scene_t &scene, node_handle_t node, const glm::vec3 &scale) {
+        auto i = index(scene, node);
+        scene.scale[i] = scale;
+        scene.dirty[i] = 1;
+    }
+
+    void set_polygon_offset(scene_t &scene, node_handle_t node, const glm::vec2 &offset) {
+        auto i = index(scene, node);
+        scene.polygon_offset[i] = offset;
+        scene.dirty[i] = 1;
+    }
+
+    void set_color_rotation(scene_t &scene, node_handle_t node, const glm::quat &rotation) {
+        auto i = index(scene, node);
+        scene.color_rotation[i] = rotation;
+        scene.dirty[i] = 1;
+    }
+
+    void set_color_offset(scene_t &scene, node_handle_t node, float offset) {
+        scene.color_offset[index(scene, node)] = offset;
+    }
+
+    void set_kind(scene_t &scene, node_handle_t node, kind_t kind) {
+        scene.kind[index(scene, node)] = kind;
+    }
+
+    void set_flag(scene_t &scene, node_handle_t node, node_flags_t flag, bool value) {
+        auto &flags = scene.flags[index(scene, node)];
+        flags = value ? (std::uint8_t) (flags | flag) : (std::uint8_t) (flags & ~flag);
+    }
+
+    void mark_dirty(scene_t &scene, node_handle_t node) {
+        scene.dirty[index(scene, node)] = 1;
+    }
+
+    void update(scene_t &scene) {
+        linearize(scene);
+        auto n = (std::uint32_t) scene.parent.size();
+
+        // parents come first, so one forward pass pushes transforms down. dirty is widened to
+        // "moved" (dirty or below a dirty node) for the bounds pass
+        for (auto i = std::uint32_t{0}; i < n; ++i) {
+            auto parent = scene.parent[i];
+            bool parent_moved = parent != NO_NODE && scene.dirty[parent] != 0;
+            if (!scene.dirty[i] && !parent_moved) continue;
+
+            if (scene.dirty[i]) {
+                // translate * rotate * scale, without the matrix products
+                auto &local = scene.local[i];
+                local = glm::mat4_cast(scene.rotation[i]);
+                local[0] *= scene.scale[i].x;
+                local[1] *= scene.scale[i].y;
+                local[2] *= scene.scale[i].z;
+                local[3] = glm::vec4(scene.translation[i], 1.0f);
+                scene.color_matrix[i] = glm::mat3_cast(scene.color_rotation[i]);
+                if (scene.model[i] != NO_MODEL) model::update_bounds(scene.models[scene.model[i]]);
+            }
+            scene.world[i] = parent == NO_NODE ? scene.local[i] : scene.world[parent] * scene.local[i];
+            scene.world_polygon_offset[i] = parent == NO_NODE
+                                            ? scene.polygon_offset[i]
+                                            : scene.world_polygon_offset[parent] + scene.polygon_offset[i];
+            scene.dirty[i] = 1;
         }
-        horiz.rotation.x = glm::radians(90.0f);
 
-        auto verts = scene::node_t{};
+        // children come after their parent, so a backward pass rebuilds bounds bottom up
+        for (auto i = n; i-- > 0;) {
+            if (!scene.dirty[i]) continue;
+
+            auto box = own_bounds(scene, i);
+            for (auto child = i + 1; child < scene.subtree_end[i]; child = scene.subtree_end[child]) {
+                box = bounds::merge(box, scene.bounds[child]);
+            }
+            scene.bounds[i] = box;
+            if (scene.parent[i] != NO_NODE) scene.dirty[scene.parent[i]] = 1;
+            scene.dirty[i] = 0;
+        }
+    }
+
+    node_handle_t make_wgmi_head(scene_t &scene, node_handle_t parent, float radius, float thickness,
+                                 bool procedural) {
+        auto head = add_node(scene, parent);
+        // procedural tori are made at their size, there's nothing to share
+        auto make_torus = [&](float torus_radius) {
+            if (!procedural) return geometry_cache::torus(torus_radius, thickness);
+            auto cached = geometry_cache::cached_mesh_t{};
+            cached.mesh = procedural::torus(torus_radius, thickness);
+            return cached;
+        };
+
+        auto verts = add_node(scene, head);
         float start_angle = glm::radians(315.0f);
         for(int i = 0; i < 3; ++i) {
             float angle = start_angle + i * glm::radians(45.0f);
             float x = radius * glm::cos(angle);
             float y = radius * glm::sin(angle);
-            auto temp = shapes::make_torus(x, thickness);
-            auto ring = scene::node_t{};
-            ring.model.meshes.push_back(mesh::init(temp));
-            ring.model.materials.push_back({});
-            ring.translation.y = y;
-            verts.children.push_back(ring);
+            auto ring_mesh = make_torus(x);
+            auto ring_model = model::model_t{};
+            ring_model.meshes.push_back(ring_mesh.mesh);
+            ring_model.lods.push_back(ring_mesh.lods);
+            ring_model.materials.push_back({});
+            auto ring = add_node(scene, verts, add_model(scene, ring_model));
+            set_translation(scene, ring, glm::vec3(0, y, 0));
+            set_scale(scene, ring, glm::vec3(ring_mesh.scale));
         }
 
-        auto head = scene::node_t{};
-        head.children.push_back(verts);
-        head.children.push_back(horiz);
+        // the horizontal rings are all the same torus, rotated about the vertical axis
+        auto torus = model::model_t{};
+        auto torus_mesh = make_torus(radius);
+        torus.meshes.push_back(torus_mesh.mesh);
+        torus.lods.push_back(torus_mesh.lods);
+        auto torus_mat = model::material_t{};
+        torus_mat.diffuse = glm::vec4(0,0,0,1);
+        torus_mat.specular = glm::vec3(0);
+        torus.materials.push_back({});
+        auto torus_model = add_model(scene, torus);
+
+        auto horiz = add_node(scene, head);
+        for(int i = 0; i < 4; ++i) {
+            auto ring = add_node(scene, horiz, torus_model);
+            set_rotation(scene, ring, glm::angleAxis(glm::radians(45.0f) * i, glm::vec3(0, 0, 1)));
+            set_scale(scene, ring, glm::vec3(torus_mesh.scale));
+        }
+        set_rotation(scene, horiz, glm::angleAxis(glm::radians(90.0f), glm::vec3(1, 0, 0)));
 
         return head;
     }
-} // namespace scene
\ No newline at end of file
+} // namespace scene
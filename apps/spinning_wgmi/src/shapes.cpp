@@ -1,58 +1,401 @@
 #include "mesh.hpp"
 #include "shapes.hpp"
+#include "vertex_layout.hpp"
+#include "mesh_builder.hpp"
+#include "arena.hpp"
+#include "parallel.hpp"
 #include <glm/ext.hpp>
 #include <utility>
 #include <chicken3421/chicken3421.hpp>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <vector>
 
-namespace shapes {
-    void calc_vertex_normals(mesh::mesh_template_t &mesh_template) {
-        mesh_template.normals = std::vector<glm::vec3>(mesh_template.positions.size(), glm::vec3(0));
-        chicken3421::expect(mesh_template.indices.size() != 0,
-                            "shapes::calc_normals requires the mesh_template_t to have indices "
-                            "defined");
-        const auto &pos = mesh_template.positions;
-        for (auto i = size_t{0}; i < mesh_template.indices.size() - 2; i += 3) {
-            GLuint i1 = mesh_template.indices[i];
-            GLuint i2 = mesh_template.indices[i + 1];
-            GLuint i3 = mesh_template.indices[i + 2];
-            auto a = pos[i2] - pos[i1];
-            auto b = pos[i3] - pos[i1];
-            auto face_normal = glm::normalize(glm::cross(a, b));
-            mesh_template.normals[i1] += face_normal;
-            mesh_template.normals[i2] += face_normal;
-            mesh_template.normals[i3] += face_normal;
+// The generators size their templates exactly up front and fill them in place with mesh_builder,
+// four vertices at a time. Every row of a shape is a circle (or part of one), so the sines and cosines
+// come from one table per shape and the per-vertex work is a few multiplies, a rotation about y
+// and the odd normalize, done in SSE where we have it
+namespace {
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "shapes writes vertices as packed floats");
+    static_assert(sizeof(glm::vec2) == 2 * sizeof(float), "shapes writes vertices as packed floats");
+
+    using parallel::float4_t;
+    using parallel::splat;
+    using parallel::load4;
+    using parallel::lane_indices;
+
+    // same sum and 1 / sqrt as glm::normalize, so results match it
+    inline void normalize4(float4_t &x, float4_t &y, float4_t &z) {
+        auto inverse_length = splat(1.0f) / sqrt4(x * x + y * y + z * z);
+        x = x * inverse_length;
+        y = y * inverse_length;
+        z = z * inverse_length;
+    }
+
+    // a turn about the y axis, as glm::rotate(angle, {0, 1, 0}) would make it
+    struct rotation_t {
+        float c = 1.0f;
+        float s = 0.0f;
+    };
+
+    inline void rotate(const rotation_t &rotation, float4_t &x, float4_t &z) {
+        auto c = splat(rotation.c), s = splat(rotation.s);
+        auto rotated_x = c * x + s * z;
+        z = c * z - s * x;
+        x = rotated_x;
+    }
+
+    inline glm::vec3 rotate(const rotation_t &rotation, const glm::vec3 &v) {
+        return {rotation.c * v.x + rotation.s * v.z, v.y, rotation.c * v.z - rotation.s * v.x};
+    }
+
+    // cos and sin of i * 2pi / n for i = 0..n, padded so whole lanes can be read past the end. They
+    // are in the scratch arena, so last until the generator that made them rewinds it
+    struct trig_table_t {
+        float *cos;
+        float *sin;
+    };
+
+    trig_table_t make_trig_table(unsigned int n) {
+        auto padded = (n + 1 + 3) & ~size_t{3};
+        auto &scratch = arena::scratch();
+        auto table = trig_table_t{
+                static_cast<float *>(arena::allocate(scratch, padded * sizeof(float), alignof(float))),
+                static_cast<float *>(arena::allocate(scratch, padded * sizeof(float), alignof(float))),
+        };
+        float angle_inc = 2.0f * (float) M_PI / (float) n;
+        for (auto i = size_t{0}; i < padded; ++i) {
+            float angle = angle_inc * (float) i;
+            table.cos[i] = std::cos(angle);
+            table.sin[i] = std::sin(angle);
+        }
+        return table;
+    }
+
+    // calls emit(j, lanes, cos, sin) for each run of up to four of the table's first count entries
+    template<typename Emit>
+    void for_each_lane(const trig_table_t &table, size_t count, Emit &&emit) {
+        for (auto j = size_t{0}; j < count; j += 4) {
+            emit(j, std::min(count - j, size_t{4}), load4(table.cos + j), load4(table.sin + j));
+        }
+    }
+
+    GLenum primitive_of(shapes::index_mode_t index_mode) {
+        return index_mode == shapes::TRIANGLE_STRIPS ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+    }
+
+    // rows of tessellation + 1 vertices with a strip of quads between consecutive ones
+    mesh_builder::counts_t grid_counts(size_t rows, size_t tessellation, GLenum primitive = GL_TRIANGLES) {
+        return {rows * (tessellation + 1), (rows - 1) * mesh_builder::quad_indices(tessellation, primitive)};
+    }
+
+    // make_zero_character and make_ring are both one strip between two circles
+    mesh_builder::counts_t ring_counts(size_t tessellation, GLenum primitive = GL_TRIANGLES) {
+        return grid_counts(2, tessellation, primitive);
+    }
+
+    mesh_builder::counts_t rect_circle_counts(size_t tessellation) { return 4 * ring_counts(tessellation); }
+
+    // make_sphere_rings and make_sphere_zeros, two strips across each group of four circles
+    mesh_builder::counts_t band_counts(size_t slices, size_t tessellation) {
+        auto groups = slices / 2 + 1;
+        return {groups * 4 * (tessellation + 1), groups * 2 * tessellation * 6};
+    }
+
+    // tessellation + 1 points around the circle of the given radius in the plane z, turned about y
+    void emit_circle(mesh_builder::builder_t &builder, const trig_table_t &table, unsigned int tessellation, float radius, float z,
+                     const rotation_t &rotation) {
+        auto *positions = builder.mesh.positions.data() + builder.vertex;
+        for_each_lane(table, tessellation + 1u, [&](size_t j, size_t lanes, float4_t cos_j, float4_t sin_j) {
+            auto x = splat(radius) * cos_j, y = splat(radius) * sin_j, rotated_z = splat(z);
+            rotate(rotation, x, rotated_z);
+            store(positions + j, lanes, x, y, rotated_z);
+        });
+        builder.vertex += tessellation + 1u;
+    }
+
+    // the flat face of make_zero_character, normals along the face's own z axis
+    void write_zero(mesh_builder::builder_t &builder, const trig_table_t &table, unsigned int tessellation, float radius, float z,
+                    float thickness, bool flip_normals, const rotation_t &rotation) {
+        auto first = builder.vertex;
+        emit_circle(builder, table, tessellation, radius, z, rotation);
+        emit_circle(builder, table, tessellation, radius - thickness, z, rotation);
+
+        float flip = (flip_normals * -1) * 2 + 1;
+        auto normal = glm::normalize(rotate(rotation, flip * glm::normalize(glm::vec3(0, 0, z))));
+        std::fill(builder.mesh.normals.begin() + first, builder.mesh.normals.begin() + builder.vertex, normal);
+
+        auto prev = first;
+        auto curr = first + tessellation + 1u;
+        if (flip_normals) std::swap(prev, curr);
+        mesh_builder::add_quads(builder, prev, curr, tessellation);
+    }
+
+    // the curved face of make_ring, normals pointing away from its axis
+    void write_ring(mesh_builder::builder_t &builder, const trig_table_t &table, unsigned int tessellation, float radius,
+                    float thickness, bool flip_normals, const rotation_t &rotation) {
+        auto first = builder.vertex;
+        auto *normals = builder.mesh.normals.data() + first;
+        auto flip = splat((flip_normals * -1) * 2 + 1);
+        for (auto z: {thickness / 2, -thickness / 2}) {
+            emit_circle(builder, table, tessellation, radius, z, rotation);
+            for_each_lane(table, tessellation + 1u, [&](size_t j, size_t lanes, float4_t cos_j, float4_t sin_j) {
+                auto x = flip * cos_j, y = flip * sin_j, rotated_z = splat(0.0f);
+                rotate(rotation, x, rotated_z);
+                normalize4(x, y, rotated_z);
+                store(normals + j, lanes, x, y, rotated_z);
+            });
+            normals += tessellation + 1u;
+        }
+
+        auto prev = first;
+        auto curr = first + tessellation + 1u;
+        if (flip_normals) std::swap(prev, curr);
+        mesh_builder::add_quads(builder, curr, prev, tessellation);
+    }
+
+    void write_rect_circle(mesh_builder::builder_t &builder, const trig_table_t &table, unsigned int tessellation, float radius,
+                           float thickness, const rotation_t &rotation) {
+        write_zero(builder, table, tessellation, radius, thickness / 2, thickness, false, rotation);
+        write_zero(builder, table, tessellation, radius, -thickness / 2, thickness, true, rotation);
+        write_ring(builder, table, tessellation, radius, thickness, false, rotation);
+        write_ring(builder, table, tessellation, radius - thickness, thickness, true, rotation);
+    }
+
+    // The latitude bands shared by make_sphere_rings and make_sphere_zeros. Each band is four
+    // circles: outer and inner at its lower edge then at its upper edge. Rings join outer to outer
+    // and inner to inner with normals out of and into the sphere, zeros join each edge's circles
+    // with normals down and up
+    void write_sphere_bands(mesh_builder::builder_t &builder, const trig_table_t &table, unsigned int tessellation, float radius,
+                            float angle_thickness, unsigned int slices, bool rings) {
+        float slice_ang_inc = (float) 2 * M_PI / (float) slices;
+        unsigned int start_angle_i = 3 * slices / 4;
+        float depth_thickness = radius * angle_thickness;
+        const float delta_angles[] = {-angle_thickness / 2, angle_thickness / 2};
+        const float delta_radius[] = {0, -depth_thickness};
+        auto row = tessellation + 1u;
+        auto first = builder.vertex;
+        for (unsigned int i = start_angle_i; i <= start_angle_i + (slices / 2); ++i) {
+            for (auto delta_angle: delta_angles) {
+                float alpha = ((slice_ang_inc * (float) i) + delta_angle - 2 * M_PI) * 0.9;
+                auto y = splat(radius * std::sin(alpha));
+                for (auto delta: delta_radius) {
+                    auto slice_radius = splat((radius * std::cos(alpha)) + delta);
+                    auto *positions = builder.mesh.positions.data() + builder.vertex;
+                    auto *normals = builder.mesh.normals.data() + builder.vertex;
+                    auto inwards = splat(delta < 0 ? -1.0f : 1.0f);
+                    auto upwards = splat(delta_angle > 0 ? 1.0f : -1.0f);
+                    for_each_lane(table, row, [&](size_t j, size_t lanes, float4_t cos_j, float4_t sin_j) {
+                        auto x = slice_radius * sin_j, z = slice_radius * cos_j;
+                        store(positions + j, lanes, x, y, z);
+                        if (rings) {
+                            auto nx = x, ny = y, nz = z;
+                            normalize4(nx, ny, nz);
+                            store(normals + j, lanes, inwards * nx, inwards * ny, inwards * nz);
+                        } else {
+                            store(normals + j, lanes, splat(0.0f), upwards, splat(0.0f));
+                        }
+                    });
+                    builder.vertex += row;
+                }
+            }
+        }
+        for (unsigned int i = 0; i <= slices * 2; i += 4) {
+            auto br = first + row * i;
+            auto bl = first + row * (i + 1);
+            auto tr = first + row * (i + 2);
+            auto tl = first + row * (i + 3);
+            if (rings) {
+                mesh_builder::add_quads(builder, tl, bl, tessellation);
+                mesh_builder::add_quads(builder, br, tr, tessellation);
+            } else {
+                mesh_builder::add_quads(builder, bl, br, tessellation);
+                mesh_builder::add_quads(builder, tr, tl, tessellation);
+            }
+        }
+    }
+
+    // The rows of make_sphere and make_wgmi_face, from the south pole up. The face's texture
+    // runs the other way around
+    void write_sphere_surface(mesh_builder::builder_t &builder, const trig_table_t &table, unsigned int tessellation, float radius,
+                              bool mirror_tex_coords) {
+        float ang_inc = 2.0f * (float) M_PI / (float) tessellation;
+        unsigned int stacks = tessellation / 2;
+        unsigned int start_angle_i = 3 * tessellation / 4;
+        auto row = tessellation + 1u;
+        for (unsigned int i = start_angle_i; i <= start_angle_i + stacks; ++i) {
+            float alpha = ang_inc * (float) i;
+            auto y = splat(radius * std::sin(alpha));
+            auto slice_radius = splat(radius * std::cos(alpha));
+            auto v = splat((float) (i - start_angle_i) * 2.0f / (float) tessellation);
+            auto *positions = builder.mesh.positions.data() + builder.vertex;
+            auto *tex_coords = builder.mesh.tex_coords.data() + builder.vertex;
+            auto *normals = builder.mesh.normals.data() + builder.vertex;
+            auto *colors = builder.mesh.colors.data() + builder.vertex;
+            for_each_lane(table, row, [&](size_t j, size_t lanes, float4_t cos_j, float4_t sin_j) {
+                auto x = slice_radius * sin_j, z = slice_radius * cos_j;
+                store(positions + j, lanes, x, y, z);
+
+                auto u = lane_indices(j) / splat((float) tessellation);
+                store(tex_coords + j, lanes, mirror_tex_coords ? splat(1.0f) - u : u, v);
+
+                auto nx = x, ny = y, nz = z;
+                normalize4(nx, ny, nz);
+                store(normals + j, lanes, nx, ny, nz);
+
+                auto cx = x + splat(radius), cy = y + splat(radius), cz = z + splat(radius);
+                normalize4(cx, cy, cz);
+                store(colors + j, lanes, cx, cy, cz);
+            });
+            builder.vertex += row;
         }
-        // normalise all the normals
-        for (auto i = size_t{0}; i < mesh_template.normals.size(); ++i) {
-            mesh_template.normals[i] = glm::normalize(mesh_template.normals[i]);
+    }
+
+    // out[i] = normalize(in[i] + offset)
+    void normalize_offset(const glm::vec3 *in, size_t count, float offset, glm::vec3 *out) {
+        for (auto i = size_t{0}; i < count; i += 4) {
+            auto lanes = std::min(count - i, size_t{4});
+            float4_t x, y, z;
+            load(in + i, lanes, x, y, z);
+            x = x + splat(offset);
+            y = y + splat(offset);
+            z = z + splat(offset);
+            normalize4(x, y, z);
+            store(out + i, lanes, x, y, z);
+        }
+    }
+
+    // normal_weighting_t's work is split between threads in runs of at least this many triangles
+    const size_t MIN_TRIANGLES_PER_THREAD = 1 << 15;
+
+    // as normalize4, but vectors of zero length stay zero instead of becoming NaNs
+    inline void normalize4_or_zero(float4_t &x, float4_t &y, float4_t &z) {
+        auto length_squared = max4(x * x + y * y + z * z, splat(std::numeric_limits<float>::min()));
+        auto inverse_length = splat(1.0f) / sqrt4(length_squared);
+        x = x * inverse_length;
+        y = y * inverse_length;
+        z = z * inverse_length;
+    }
+
+    // angle between two vectors, accurate even when it is tiny
+    inline float angle_between(const glm::vec3 &a, const glm::vec3 &b) {
+        return std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b));
+    }
+
+    // add the weighted normals of triangles [begin, end) to their corners' sums. Degenerate triangles
+    // have no direction to give and are skipped
+    void accumulate_normals(const glm::vec3 *positions, const GLuint *indices, size_t begin, size_t end,
+                            shapes::normal_weighting_t weighting, glm::vec3 *sums) {
+        for (auto t = begin; t < end; ++t) {
+            auto i0 = indices[3 * t], i1 = indices[3 * t + 1], i2 = indices[3 * t + 2];
+            auto e01 = positions[i1] - positions[i0];
+            auto e02 = positions[i2] - positions[i0];
+            auto normal = glm::cross(e01, e02); // twice the triangle's area long
+            auto length = glm::length(normal);
+            if (length == 0.0f) continue;
+
+            if (weighting == shapes::AREA_WEIGHTS) {
+                sums[i0] += normal;
+                sums[i1] += normal;
+                sums[i2] += normal;
+                continue;
+            }
+            normal /= length;
+            if (weighting == shapes::EQUAL_WEIGHTS) {
+                sums[i0] += normal;
+                sums[i1] += normal;
+                sums[i2] += normal;
+                continue;
+            }
+            auto angle0 = angle_between(e01, e02);
+            auto angle1 = angle_between(-e01, positions[i2] - positions[i1]);
+            auto angle2 = std::max(glm::pi<float>() - angle0 - angle1, 0.0f);
+            sums[i0] += angle0 * normal;
+            sums[i1] += angle1 * normal;
+            sums[i2] += angle2 * normal;
         }
     }
+} // namespace
+
+namespace shapes {
+    void calc_vertex_normals(mesh::mesh_template_t &mesh_template, normal_weighting_t weighting,
+                             unsigned int max_threads) {
+        chicken3421::expect(mesh_template.indices.size() != 0 && mesh_template.primitive == GL_TRIANGLES,
+                            "shapes::calc_normals requires the mesh_template_t to have indices "
+                            "defined, as a triangle list");
+        const auto *positions = mesh_template.positions.data();
+        const auto *indices = mesh_template.indices.data();
+        auto vertices = mesh_template.positions.size();
+        auto triangles = mesh_template.indices.size() / 3;
+        mesh_template.normals.assign(vertices, glm::vec3(0));
+
+        // each thread sums its own run of triangles, the first straight into the normals
+        auto parts = parallel::parts_for(triangles, MIN_TRIANGLES_PER_THREAD, max_threads);
+        auto sums = std::vector<std::vector<glm::vec3>>(parts - 1);
+        parallel::for_each_part(triangles, parts, [&](size_t part, size_t begin, size_t end) {
+            auto *out = mesh_template.normals.data();
+            if (part > 0) {
+                sums[part - 1].assign(vertices, glm::vec3(0));
+                out = sums[part - 1].data();
+            }
+            accumulate_normals(positions, indices, begin, end, weighting, out);
+        });
+
+        // then each thread adds up and normalizes its own run of vertices
+        parallel::for_each_part(vertices, parts, [&](size_t, size_t begin, size_t end) {
+            auto *normals = mesh_template.normals.data();
+            for (auto i = begin; i < end; i += 4) {
+                auto lanes = std::min(end - i, size_t{4});
+                float4_t x, y, z;
+                load(normals + i, lanes, x, y, z);
+                for (const auto &other: sums) {
+                    float4_t ox, oy, oz;
+                    load(other.data() + i, lanes, ox, oy, oz);
+                    x = x + ox;
+                    y = y + oy;
+                    z = z + oz;
+                }
+                normalize4_or_zero(x, y, z);
+                store(normals + i, lanes, x, y, z);
+            }
+        });
+    }
 
     // assumes the mesh_template does not have indices
-    void calc_face_normals(mesh::mesh_template_t &mesh_template) {
+    void calc_face_normals(mesh::mesh_template_t &mesh_template, unsigned int max_threads) {
         chicken3421::expect(mesh_template.indices.size() == 0,
                             "shapes::calc_face_normals requires the mesh_template to not use "
                             "indices");
         mesh_template.normals =
                 std::vector<glm::vec3>(mesh_template.positions.size(), glm::vec3(1, 0, 0));
-        const auto &pos = mesh_template.positions;
-        for (auto i = size_t{0}; i < mesh_template.positions.size() - 2; i += 3) {
-            auto a = pos[i + 1] - pos[i];
-            auto b = pos[i + 2] - pos[i];
-            auto face_normal = glm::normalize(glm::cross(a, b));
-            for (auto j = size_t{0}; j < 3; ++j) {
-                mesh_template.normals[i + j] = face_normal;
+        const auto *pos = mesh_template.positions.data();
+        auto *normals = mesh_template.normals.data();
+        auto triangles = mesh_template.positions.size() / 3;
+        auto parts = parallel::parts_for(triangles, MIN_TRIANGLES_PER_THREAD, max_threads);
+        parallel::for_each_part(triangles, parts, [&](size_t, size_t begin, size_t end) {
+            for (auto t = begin; t < end; ++t) {
+                auto i = 3 * t;
+                auto face_normal = glm::cross(pos[i + 1] - pos[i], pos[i + 2] - pos[i]);
+                auto length = glm::length(face_normal);
+                if (length > 0.0f) face_normal /= length;
+                normals[i] = normals[i + 1] = normals[i + 2] = face_normal;
             }
-        }
+        });
     }
 
     // Duplicates any attributes based on the indices provided
     mesh::mesh_template_t expand_indices(const mesh::mesh_template_t &mesh_template) {
-        chicken3421::expect(mesh_template.indices.size() != 0,
+        chicken3421::expect(mesh_template.indices.size() != 0 && mesh_template.primitive == GL_TRIANGLES,
                             "shapes::expand_indices requires the mesh_template to have indices to "
-                            "expand");
+                            "expand, as a triangle list");
         auto new_mesh_template = mesh::mesh_template_t{};
+        auto count = mesh_template.indices.size();
+        new_mesh_template.positions.reserve(count);
+        if (!mesh_template.colors.empty()) new_mesh_template.colors.reserve(count);
+        if (!mesh_template.tex_coords.empty()) new_mesh_template.tex_coords.reserve(count);
+        if (!mesh_template.normals.empty()) new_mesh_template.normals.reserve(count);
         for (auto i: mesh_template.indices) {
             new_mesh_template.positions.push_back(mesh_template.positions[i]);
             if (!mesh_template.colors.empty()) {
@@ -69,320 +412,153 @@ namespace shapes {
     }
 
     mesh::mesh_template_t make_zero_character(float radius, float z, float thickness, unsigned int tessellation, bool flip_normals) {
-        mesh::mesh_template_t circle;
-        float angle_inc = 2.0 * M_PI / tessellation;
-        auto delta_radius = std::vector<float>{0, -thickness};
-        for(int dri = 0; dri < delta_radius.size(); ++dri) {
-            for (int i = 0; i <= tessellation; ++i) {
-                float rad = radius + delta_radius[dri];
-                float angle = i * angle_inc;
-                float x = rad * std::cos(angle);
-                float y = rad * std::sin(angle);
-                circle.positions.emplace_back(x, y, z);
-                auto center = glm::vec3(0,0, z);
-                float flip = (flip_normals * -1) * 2 + 1;
-                circle.normals.push_back(flip * glm::normalize(center));
-            }
-        }
-        unsigned int prev = 0;
-        unsigned int curr = (1u + tessellation);
-        if(flip_normals) std::swap(prev, curr);
-        for (unsigned int j = 0; j < tessellation; ++j) {
-            circle.indices.push_back(curr + j);
-            circle.indices.push_back(prev + j);
-            circle.indices.push_back(prev + j + 1);
-            circle.indices.push_back(prev + j + 1);
-            circle.indices.push_back(curr + j + 1);
-            circle.indices.push_back(curr + j);
-        }
-        circle.colors = circle.positions;
-        return circle;
-    }
-
-    mesh::mesh_template_t make_ring(float radius, float thickness, unsigned int tessellation, bool flip_normals) {
-        mesh::mesh_template_t circle;
-        float angle_inc = 2.0 * M_PI / tessellation;
-        auto delta_thickness = std::vector<float>{thickness/2, -thickness/2};
-        for(int dti = 0; dti < delta_thickness.size(); ++dti) {
-            for (int i = 0; i <= tessellation; ++i) {
-                float angle = i * angle_inc;
-                float x = radius * std::cos(angle);
-                float y = radius * std::sin(angle);
-                circle.positions.emplace_back(x, y, delta_thickness[dti]);
-                auto center = glm::vec3(0,0, delta_thickness[dti]);
-                float flip = (flip_normals * -1) * 2 + 1;
-                circle.normals.push_back(flip * glm::normalize(circle.positions.back() - center));
-            }
-        }
-        unsigned int prev = 0;
-        unsigned int curr = (1u + tessellation);
-        if(flip_normals) std::swap(prev, curr);
-        for (unsigned int j = 0; j < tessellation; ++j) {
-            circle.indices.push_back(prev + j);
-            circle.indices.push_back(curr + j);
-            circle.indices.push_back(curr + j + 1);
-            circle.indices.push_back(curr + j + 1);
-            circle.indices.push_back(prev + j + 1);
-            circle.indices.push_back(prev + j);
-        }
-        return circle;
+        auto mark = arena::mark(arena::scratch());
+        auto table = make_trig_table(tessellation);
+        auto builder = mesh_builder::make_builder(ring_counts(tessellation), vertex_layout::COLORS | vertex_layout::NORMALS);
+        write_zero(builder, table, tessellation, radius, z, thickness, flip_normals, rotation_t{});
+        builder.mesh.colors = builder.mesh.positions;
+        arena::rewind(arena::scratch(), mark);
+        return mesh_builder::finish(builder);
+    }
+
+    mesh::mesh_template_t make_ring(float radius, float thickness, unsigned int tessellation, bool flip_normals,
+                                    index_mode_t index_mode) {
+        auto mark = arena::mark(arena::scratch());
+        auto table = make_trig_table(tessellation);
+        auto primitive = primitive_of(index_mode);
+        auto builder = mesh_builder::make_builder(ring_counts(tessellation, primitive), vertex_layout::NORMALS, primitive);
+        write_ring(builder, table, tessellation, radius, thickness, flip_normals, rotation_t{});
+        arena::rewind(arena::scratch(), mark);
+        return mesh_builder::finish(builder);
     }
 
     mesh::mesh_template_t make_rect_circle(float radius, float thickness, unsigned int tessellation) {
-        auto circle = mesh::mesh_template_t{};
-        auto zero1 = make_zero_character(radius, thickness/2, thickness, tessellation, false);
-        auto zero2 = make_zero_character(radius, -thickness/2, thickness, tessellation, true);
-        auto ring1 = make_ring(radius, thickness, tessellation, false);
-        auto ring2 = make_ring(radius - thickness, thickness, tessellation, true);
-        auto meshes = std::vector<mesh::mesh_template_t>{zero1, zero2, ring1, ring2};
-        for(int i = 0; i < meshes.size(); ++i) {
-            auto size = circle.positions.size();
-            circle.positions.insert(circle.positions.end(), meshes[i].positions.begin(), meshes[i].positions.end());
-            circle.normals.insert(circle.normals.end(), meshes[i].normals.begin(), meshes[i].normals.end());
-            for(auto idx : meshes[i].indices) circle.indices.push_back(size + idx);
-        }
-        return circle;
+        auto mark = arena::mark(arena::scratch());
+        auto table = make_trig_table(tessellation);
+        auto builder = mesh_builder::make_builder(rect_circle_counts(tessellation), vertex_layout::NORMALS);
+        write_rect_circle(builder, table, tessellation, radius, thickness, rotation_t{});
+        arena::rewind(arena::scratch(), mark);
+        return mesh_builder::finish(builder);
     }
 
     mesh::mesh_template_t make_sphere_rings(float radius, float angle_thickness, unsigned int slices, unsigned int tessellation) {
-        mesh::mesh_template_t sphere;
-        float slice_ang_inc = (float) 2 * M_PI / (float) slices;
-        float ang_inc = 2.0f * (float) M_PI / (float) tessellation;
-        unsigned int start_angle_i = 3 * slices / 4;
-        float depth_thickness = radius * angle_thickness;
-        auto delta_angles = std::vector<float>{-angle_thickness/2, angle_thickness/2};
-        auto delta_radius = std::vector<float>{0, -depth_thickness};
-        for (unsigned int i = start_angle_i; i <= start_angle_i + (slices/2); ++i) {
-            for(int dai = 0; dai < delta_angles.size(); ++dai) {
-                float alpha = ((slice_ang_inc * (float) i) + delta_angles[dai] - 2 * M_PI) * 0.9;
-                float y = radius * std::sin(alpha);
-                for(int dri = 0; dri < delta_radius.size(); ++dri) {
-                    float slice_radius = (radius * std::cos(alpha)) + delta_radius[dri];
-                    for (unsigned int j = 0; j <= tessellation; ++j) {
-                        float beta = ang_inc * (float) j;
-                        float z = slice_radius * std::cos(beta);
-                        float x = slice_radius * std::sin(beta);
-                        sphere.positions.emplace_back(x, y, z);
-                        sphere.normals.push_back(glm::normalize(sphere.positions.back()));
-                        if(delta_radius[dri] < 0) sphere.normals.back() *= -1;
-                    }
-                }
-            }
-        }
-        // create the indices
-        for (unsigned int i = 0; i <= slices * 2; i+=4) {
-            unsigned int br = (1u + tessellation) * i;
-            unsigned int bl = (1u + tessellation) * (i+1);
-            unsigned int tr = (1u + tessellation) * (i+2);
-            unsigned int tl = (1u + tessellation) * (i+3);
-            auto sides = std::vector<std::pair<unsigned int, unsigned int>>{{tl,bl}, {br,tr}};
-            for(int s = 0; s < sides.size(); ++s) {
-                for (unsigned int j = 0; j < tessellation; ++j) {
-                    sphere.indices.push_back(sides[s].second + j);
-                    sphere.indices.push_back(sides[s].first + j);
-                    sphere.indices.push_back(sides[s].first + j + 1);
-                    sphere.indices.push_back(sides[s].first + j + 1);
-                    sphere.indices.push_back(sides[s].second + j + 1);
-                    sphere.indices.push_back(sides[s].second + j);
-                }
-            }
-        }
-        return sphere;
+        auto mark = arena::mark(arena::scratch());
+        auto table = make_trig_table(tessellation);
+        auto builder = mesh_builder::make_builder(band_counts(slices, tessellation), vertex_layout::NORMALS);
+        write_sphere_bands(builder, table, tessellation, radius, angle_thickness, slices, true);
+        arena::rewind(arena::scratch(), mark);
+        return mesh_builder::finish(builder);
     }
 
     mesh::mesh_template_t make_sphere_zeros(float radius, float angle_thickness, unsigned int slices, unsigned int tessellation) {
-        mesh::mesh_template_t sphere;
-        float slice_ang_inc = (float) 2 * M_PI / (float) slices;
-        float ang_inc = 2.0f * (float) M_PI / (float) tessellation;
-        unsigned int start_angle_i = 3 * slices / 4;
-        float depth_thickness = radius * angle_thickness;
-        auto delta_angles = std::vector<float>{-angle_thickness/2, angle_thickness/2};
-        auto delta_radius = std::vector<float>{0, -depth_thickness};
-        for (unsigned int i = start_angle_i; i <= start_angle_i + (slices/2); ++i) {
-            for(int dai = 0; dai < delta_angles.size(); ++dai) {
-                float alpha = ((slice_ang_inc * (float) i) + delta_angles[dai] - 2 * M_PI) * 0.9;
-                float y = radius * std::sin(alpha);
-                for(int dri = 0; dri < delta_radius.size(); ++dri) {
-                    float slice_radius = (radius * std::cos(alpha)) + delta_radius[dri];
-                    for (unsigned int j = 0; j <= tessellation; ++j) {
-                        float beta = ang_inc * (float) j;
-                        float z = slice_radius * std::cos(beta);
-                        float x = slice_radius * std::sin(beta);
-                        sphere.positions.emplace_back(x, y, z);
-                        if(delta_angles[dai] > 0) sphere.normals.emplace_back(0,1,0);
-                        else sphere.normals.emplace_back(0,-1,0);
-                    }
-                }
-            }
-        }
-        // create the indices
-        for (unsigned int i = 0; i <= slices * 2; i+=4) {
-            unsigned int br = (1u + tessellation) * i;
-            unsigned int bl = (1u + tessellation) * (i+1);
-            unsigned int tr = (1u + tessellation) * (i+2);
-            unsigned int tl = (1u + tessellation) * (i+3);
-            auto sides = std::vector<std::pair<unsigned int, unsigned int>>{{bl,br}, {tr,tl}};
-            for(int s = 0; s < sides.size(); ++s) {
-                for (unsigned int j = 0; j < tessellation; ++j) {
-                    sphere.indices.push_back(sides[s].second + j);
-                    sphere.indices.push_back(sides[s].first + j);
-                    sphere.indices.push_back(sides[s].first + j + 1);
-                    sphere.indices.push_back(sides[s].first + j + 1);
-                    sphere.indices.push_back(sides[s].second + j + 1);
-                    sphere.indices.push_back(sides[s].second + j);
-                }
-            }
-        }
-        return sphere;
+        auto mark = arena::mark(arena::scratch());
+        auto table = make_trig_table(tessellation);
+        auto builder = mesh_builder::make_builder(band_counts(slices, tessellation), vertex_layout::NORMALS);
+        write_sphere_bands(builder, table, tessellation, radius, angle_thickness, slices, false);
+        arena::rewind(arena::scratch(), mark);
+        return mesh_builder::finish(builder);
     }
 
     mesh::mesh_template_t make_sphere_skeleton(float radius, float angle_thickness, unsigned int slices, unsigned int tessellation) {
-        auto sphere = mesh::mesh_template_t{};
-        auto sphere_zeros = make_sphere_zeros(radius, angle_thickness, slices, tessellation);
-        auto sphere_rings = make_sphere_rings(radius, angle_thickness, slices, tessellation);
+        auto mark = arena::mark(arena::scratch());
+        auto table = make_trig_table(tessellation);
+        auto counts = 2 * band_counts(slices, tessellation) + (slices / 2) * rect_circle_counts(tessellation);
+        auto builder = mesh_builder::make_builder(counts, vertex_layout::COLORS | vertex_layout::NORMALS);
+        write_sphere_bands(builder, table, tessellation, radius, angle_thickness, slices, false);
+        write_sphere_bands(builder, table, tessellation, radius, angle_thickness, slices, true);
         auto thickness = radius * angle_thickness;
-        auto meshes = std::vector<mesh::mesh_template_t>{sphere_zeros, sphere_rings};
-        auto rect_circle = make_rect_circle(radius, thickness, tessellation);
-        for(int i = 0; i < slices/2; ++i) {
-            auto vert_circle = rect_circle;
-            auto rot = glm::rotate(glm::mat4(1.0f), (float)(i * 2.0f * M_PI / (float) slices), glm::vec3(0,1,0));
-            for(auto& pos: vert_circle.positions) pos = glm::vec3(rot * glm::vec4(pos,1));
-            for(auto& norm: vert_circle.normals) norm = glm::normalize(glm::vec3(rot * glm::vec4(norm, 1)));
-            meshes.push_back(vert_circle);
-        }
-        for(int i = 0; i < meshes.size(); ++i) {
-            auto size = sphere.positions.size();
-            sphere.positions.insert(sphere.positions.end(), meshes[i].positions.begin(), meshes[i].positions.end());
-            sphere.normals.insert(sphere.normals.end(), meshes[i].normals.begin(), meshes[i].normals.end());
-            for(auto idx : meshes[i].indices) sphere.indices.push_back(size + idx);
+        for (unsigned int i = 0; i < slices / 2; ++i) {
+            auto theta = (float) (i * 2.0f * M_PI / (float) slices);
+            write_rect_circle(builder, table, tessellation, radius, thickness, {std::cos(theta), std::sin(theta)});
         }
-        for(auto p : sphere.positions) sphere.colors.push_back(glm::normalize(radius + p));
-        return sphere;
+        auto &sphere = builder.mesh;
+        normalize_offset(sphere.positions.data(), sphere.positions.size(), radius, sphere.colors.data());
+        arena::rewind(arena::scratch(), mark);
+        return mesh_builder::finish(builder);
     }
 
-    mesh::mesh_template_t make_sphere(float radius, unsigned int tessellation) {
-        mesh::mesh_template_t sphere;
-
-        float ang_inc = 2.0f * (float) M_PI / (float) tessellation;
-        unsigned int stacks = tessellation / 2;
-        unsigned int start_angle_i = 3 * tessellation / 4;
-        for (unsigned int i = start_angle_i; i <= start_angle_i + stacks; ++i) {
-            float alpha = ang_inc * (float) i;
-            float y = radius * std::sin(alpha);
-            float slice_radius = radius * std::cos(alpha);
-            for (unsigned int j = 0; j <= tessellation; ++j) {
-                float beta = ang_inc * (float) j;
-                float z = slice_radius * std::cos(beta);
-                float x = slice_radius * std::sin(beta);
-                sphere.positions.emplace_back(x, y, z);
-                sphere.tex_coords.emplace_back((float) j * 1.0f / (float) tessellation,
-                                               (float) (i - start_angle_i) * 2.0f / (float) tessellation);
-                sphere.normals.emplace_back(glm::normalize(sphere.positions.back()));
-                sphere.colors.push_back(glm::normalize(sphere.positions.back() + radius));
-            }
-        }
+    mesh::mesh_template_t make_sphere(float radius, unsigned int tessellation, index_mode_t index_mode) {
+        auto mark = arena::mark(arena::scratch());
+        auto table = make_trig_table(tessellation);
+        auto stacks = tessellation / 2;
+        auto primitive = primitive_of(index_mode);
+        auto builder = mesh_builder::make_builder(grid_counts(stacks + 1, tessellation, primitive),
+                                    vertex_layout::COLORS | vertex_layout::TEX_COORDS | vertex_layout::NORMALS, primitive);
+        write_sphere_surface(builder, table, tessellation, radius, false);
         // create the indices
-        for (unsigned int i = 1; i <= tessellation / 2; ++i) {
-            unsigned int prev = (1u + tessellation) * (i - 1);
-            unsigned int curr = (1u + tessellation) * i;
-            for (unsigned int j = 0; j < tessellation; ++j) {
-                sphere.indices.push_back(curr + j);
-                sphere.indices.push_back(prev + j);
-                sphere.indices.push_back(prev + j + 1);
-                sphere.indices.push_back(prev + j + 1);
-                sphere.indices.push_back(curr + j + 1);
-                sphere.indices.push_back(curr + j);
-            }
+        for (unsigned int i = 1; i <= stacks; ++i) {
+            mesh_builder::add_quads(builder, (1u + tessellation) * (i - 1), (1u + tessellation) * i, tessellation);
         }
-
-        return sphere;
+        arena::rewind(arena::scratch(), mark);
+        return mesh_builder::finish(builder);
     }
 
     mesh::mesh_template_t make_wgmi_face(float radius, unsigned int tessellation) {
-        mesh::mesh_template_t sphere;
-
-        float ang_inc = 2.0f * (float) M_PI / (float) tessellation;
-        unsigned int stacks = tessellation / 2;
-        unsigned int start_angle_i = 3 * tessellation / 4;
-        for (unsigned int i = start_angle_i; i <= start_angle_i + stacks; ++i) {
-            float alpha = ang_inc * (float) i;
-            float y = radius * std::sin(alpha);
-            float slice_radius = radius * std::cos(alpha);
-            for (unsigned int j = 0; j <= tessellation; ++j) {
-                float beta = ang_inc * (float) j;
-                float z = slice_radius * std::cos(beta);
-                float x = slice_radius * std::sin(beta);
-                sphere.positions.emplace_back(x, y, z);
-                sphere.tex_coords.emplace_back(1 - ((float) j * 1.0f / (float) tessellation),
-                                               (float) (i - start_angle_i) * 2.0f / (float) tessellation);
-                sphere.normals.emplace_back(glm::normalize(sphere.positions.back()));
-                sphere.colors.push_back(glm::normalize(sphere.positions.back() + radius));
-            }
-        }
-        float slice = tessellation/8;
-        float start_slice = slice * 3;
-        float end_slice = slice * 5;
-        float start_stack = stacks/2 + 1;
-        float end_stack = stacks - slice + 1;
-//        float tex_y_inc = 1.0f / (end_stack - start_stack);
-//        float tex_x_inc = 1.0f / (end_slice - start_slice);
+        auto mark = arena::mark(arena::scratch());
+        auto table = make_trig_table(tessellation);
+        // only the front window of the sphere is indexed, where the face texture goes
+        int stacks = tessellation / 2;
+        int slice = tessellation / 8;
+        int start_slice = slice * 3;
+        int end_slice = slice * 5;
+        int start_stack = stacks / 2 + 1;
+        int end_stack = stacks - slice + 1;
+        auto rows = (size_t) std::max(end_stack - start_stack, 0);
+        auto columns = (size_t) std::max(end_slice - start_slice, 0);
+        auto builder = mesh_builder::make_builder({(stacks + 1u) * (tessellation + 1u), rows * columns * 6},
+                                    vertex_layout::COLORS | vertex_layout::TEX_COORDS | vertex_layout::NORMALS);
+        write_sphere_surface(builder, table, tessellation, radius, true);
         // create the indices
-        for (unsigned int i = start_stack; i < end_stack; ++i) {
-            unsigned int prev = (1u + tessellation) * (i - 1);
-            unsigned int curr = (1u + tessellation) * i;
-            for (unsigned int j = start_slice; j < end_slice; ++j) {
-                sphere.indices.push_back(prev + j);
-                sphere.indices.push_back(curr + j);
-                sphere.indices.push_back(curr + j + 1);
-                sphere.indices.push_back(curr + j + 1);
-                sphere.indices.push_back(prev + j + 1);
-                sphere.indices.push_back(prev + j);
-            }
+        for (auto i = size_t{0}; i < rows; ++i) {
+            auto prev = (1u + tessellation) * (start_stack + i - 1) + start_slice;
+            auto curr = (1u + tessellation) * (start_stack + i) + start_slice;
+            mesh_builder::add_quads(builder, curr, prev, columns);
         }
+        arena::rewind(arena::scratch(), mark);
+        return mesh_builder::finish(builder);
+    }
 
-        return sphere;
-    }
-
-    mesh::mesh_template_t make_torus(float radius, float thickness, int tessellation) {
-        mesh::mesh_template_t torus;
-        int stacks = std::ceil(radius / thickness) * tessellation;
-        std::vector<glm::vec3> circle;
-        float angle_inc = 2.0 * M_PI / tessellation;
-        for (int i = 0; i <= tessellation; ++i) {
-            float alpha = angle_inc * (float) i;
-            glm::vec3 v;
-            v.x = radius + (thickness * std::cos(alpha));
-            v.y = thickness * std::sin(alpha);
-            v.z = 0.0;
-            circle.push_back(v);
-        }
-        auto center = glm::vec3(radius, 0, 0);
-        angle_inc = 2.0 * M_PI / stacks;
-        for (auto i = 0u; i <= stacks; ++i) {
-            float alpha = angle_inc * (float) i;
-            glm::mat4 rot = glm::rotate(glm::mat4(1.0), -alpha, glm::vec3(0, 1, 0));
-            auto stack_center = glm::vec3(rot * glm::vec4(center,1));
-            for (auto j = 0u; j < circle.size(); ++j) {
-                torus.positions.push_back(glm::vec3(rot * glm::vec4(circle[j], 1)));
-                torus.tex_coords.emplace_back((float) 4 * i / (float) tessellation - 0.5f,
-                                              (float) 12 * j / (float) stacks - 0.5f);
-                torus.normals.push_back(torus.positions.back() - stack_center);
-                torus.colors.push_back(glm::normalize(torus.positions.back()));
-            }
+    mesh::mesh_template_t make_torus(float radius, float thickness, int tessellation, index_mode_t index_mode) {
+        return make_torus(radius, thickness, tessellation, (int) std::ceil(radius / thickness) * tessellation, index_mode);
+    }
+
+    mesh::mesh_template_t make_torus(float radius, float thickness, int tessellation, int stacks, index_mode_t index_mode) {
+        // the texture lies the same way whatever the number of stacks
+        auto wraps = 4 * std::ceil(radius / thickness);
+        auto default_stacks = std::ceil(radius / thickness) * (float) tessellation;
+        auto mark = arena::mark(arena::scratch());
+        auto circle = make_trig_table(tessellation);
+        auto around = make_trig_table(stacks);
+        auto row = (size_t) tessellation + 1;
+        auto primitive = primitive_of(index_mode);
+        auto builder = mesh_builder::make_builder(grid_counts(stacks + 1, tessellation, primitive),
+                                    vertex_layout::COLORS | vertex_layout::TEX_COORDS | vertex_layout::NORMALS, primitive);
+        auto &torus = builder.mesh;
+        for (auto i = 0u; i <= (unsigned) stacks; ++i) {
+            // the circle turned by -alpha about y, so cos(-alpha) and sin(-alpha)
+            auto rotation = rotation_t{around.cos[i], -around.sin[i]};
+            auto stack_center = rotate(rotation, glm::vec3(radius, 0, 0));
+            auto u = splat(wraps * (float) i / (float) stacks - 0.5f);
+            auto *positions = torus.positions.data() + builder.vertex;
+            auto *tex_coords = torus.tex_coords.data() + builder.vertex;
+            auto *normals = torus.normals.data() + builder.vertex;
+            auto *colors = torus.colors.data() + builder.vertex;
+            for_each_lane(circle, row, [&](size_t j, size_t lanes, float4_t cos_j, float4_t sin_j) {
+                auto x = splat(radius) + splat(thickness) * cos_j, y = splat(thickness) * sin_j, z = splat(0.0f);
+                rotate(rotation, x, z);
+                store(positions + j, lanes, x, y, z);
+                store(tex_coords + j, lanes, u, splat(12.0f) * lane_indices(j) / splat(default_stacks) - splat(0.5f));
+                store(normals + j, lanes, x - splat(stack_center.x), y, z - splat(stack_center.z));
+                normalize4(x, y, z);
+                store(colors + j, lanes, x, y, z);
+            });
+            builder.vertex += row;
         }
         for (int i = 1; i <= stacks; ++i) {
-            int prev = circle.size() * (i - 1);
-            int curr = circle.size() * i;
-            for (int j = 0; j < circle.size() - 1; ++j) {
-                torus.indices.push_back(curr + j);
-                torus.indices.push_back(prev + j);
-                torus.indices.push_back(prev + j + 1);
-                torus.indices.push_back(prev + j + 1);
-                torus.indices.push_back(curr + j + 1);
-                torus.indices.push_back(curr + j);
-            }
+            mesh_builder::add_quads(builder, row * (i - 1), row * i, tessellation);
         }
-        return torus;
+        arena::rewind(arena::scratch(), mark);
+        return mesh_builder::finish(builder);
     }
 
     mesh::mesh_template_t make_cube(float width) {
@@ -448,85 +624,63 @@ namespace shapes {
         return cube;
     }
 
-    mesh::mesh_template_t make_plane(int width, int height) {
-        mesh::mesh_template_t mesh_template;
+    mesh::mesh_template_t make_plane(int width, int height, index_mode_t index_mode) {
+        auto primitive = primitive_of(index_mode);
+        auto builder = mesh_builder::make_builder({(width + 1u) * (height + 1u), width * mesh_builder::quad_indices(height, primitive)},
+                                                  vertex_layout::TEX_COORDS, primitive);
+        auto &mesh_template = builder.mesh;
         float hw = (float) width / 2.0f;
         float hh = (float) height / 2.0f;
         for (auto i = size_t{0}; i <= width; ++i) {
-            for (auto j = size_t{0}; j <= height; ++j) {
-                mesh_template.positions.emplace_back(-hw + (float) i, -hh + (float) j, 0);
-                mesh_template.tex_coords.emplace_back((float) i / width, (float) j / height);
+            for (auto j = size_t{0}; j <= height; ++j, ++builder.vertex) {
+                mesh_template.positions[builder.vertex] = {-hw + (float) i, -hh + (float) j, 0};
+                mesh_template.tex_coords[builder.vertex] = {(float) i / width, (float) j / height};
             }
         }
         for (auto i = size_t{0}; i < width; ++i) {
             auto curr = i * (height + 1);
             auto next = (i + 1) * (height + 1);
-            for (auto j = size_t{0}; j < height; ++j) {
-                mesh_template.indices.push_back(curr + j);
-                mesh_template.indices.push_back(next + j);
-                mesh_template.indices.push_back(next + j + 1);
-                mesh_template.indices.push_back(next + j + 1);
-                mesh_template.indices.push_back(curr + j + 1);
-                mesh_template.indices.push_back(curr + j);
-            }
+            mesh_builder::add_quads(builder, next, curr, height);
         }
-        return mesh_template;
+        return mesh_builder::finish(builder);
     }
 
     mesh::mesh_template_t make_circle(float radius, int tessellation) {
-        mesh::mesh_template_t circle;
-        float angle_inc = 2.0 * M_PI / tessellation;
-        for (int i = 0; i <= tessellation; ++i) {
-            float angle = i * angle_inc;
-            float x = radius * std::cos(angle);
-            float y = radius * std::sin(angle);
-            circle.positions.emplace_back(x, y, 0);
-            float tx = (std::cos(angle) / 2.0f) + 0.5f;
-            float ty = (std::sin(angle) / 2.0f) + 0.5f;
-            circle.tex_coords.emplace_back(tx, ty);
-        }
-        circle.positions.emplace_back(0, 0, 0);
-        circle.tex_coords.emplace_back(0.5f, 0.5f);
-        for (auto i = size_t{0}; i < tessellation; ++i) {
-            circle.indices.push_back(circle.positions.size() - 1);
-            circle.indices.push_back(i);
-            circle.indices.push_back(i + 1);
+        auto mark = arena::mark(arena::scratch());
+        auto table = make_trig_table(tessellation);
+        auto builder = mesh_builder::make_builder({tessellation + 2u, tessellation * 3u}, vertex_layout::TEX_COORDS);
+        auto &circle = builder.mesh;
+        for (int i = 0; i <= tessellation; ++i, ++builder.vertex) {
+            circle.positions[builder.vertex] = {radius * table.cos[i], radius * table.sin[i], 0};
+            circle.tex_coords[builder.vertex] = {(table.cos[i] / 2.0f) + 0.5f, (table.sin[i] / 2.0f) + 0.5f};
         }
-        return circle;
-    }
-
-    mesh::mesh_template_t make_cylinder(float radius, float length, int tessellation) {
-        mesh::mesh_template_t cylinder;
-        float angle_inc = 2.0 * M_PI / tessellation;
-        for (int i = 0; i <= tessellation; ++i) {
-            float angle = i * angle_inc;
-            float x = radius * std::cos(angle);
-            float y = radius * std::sin(angle);
-            cylinder.positions.emplace_back(x, y, -length / 2.0f);
-            float tx = (std::cos(angle) / 2.0f) + 0.5f;
-            float ty = (std::sin(angle) / 2.0f) + 0.5f;
-            cylinder.tex_coords.emplace_back(tx, ty);
+        auto center = builder.vertex++;
+        circle.positions[center] = {0, 0, 0};
+        circle.tex_coords[center] = {0.5f, 0.5f};
+        for (auto i = size_t{0}; i < tessellation; ++i, builder.index += 3) {
+            circle.indices[builder.index] = center;
+            circle.indices[builder.index + 1] = i;
+            circle.indices[builder.index + 2] = i + 1;
         }
-        for (int i = 0; i <= tessellation; ++i) {
-            float angle = i * angle_inc;
-            float x = radius * std::cos(angle);
-            float y = radius * std::sin(angle);
-            cylinder.positions.emplace_back(x, y, length / 2.0f);
-            float tx = (std::cos(angle) / 2.0f) + 0.5f;
-            float ty = (std::sin(angle) / 2.0f) + 0.5f;
-            cylinder.tex_coords.emplace_back(tx, ty);
-        }
-        int curr = tessellation + 1;
-        int prev = 0;
-        for (auto i = size_t{0}; i < tessellation; ++i) {
-            cylinder.indices.push_back(curr + i);
-            cylinder.indices.push_back(prev + i);
-            cylinder.indices.push_back(prev + i + 1);
-            cylinder.indices.push_back(prev + i + 1);
-            cylinder.indices.push_back(curr + i + 1);
-            cylinder.indices.push_back(curr + i);
+        arena::rewind(arena::scratch(), mark);
+        return mesh_builder::finish(builder);
+    }
+
+    mesh::mesh_template_t make_cylinder(float radius, float length, int tessellation, index_mode_t index_mode) {
+        auto mark = arena::mark(arena::scratch());
+        auto table = make_trig_table(tessellation);
+        auto primitive = primitive_of(index_mode);
+        auto builder = mesh_builder::make_builder(ring_counts(tessellation, primitive), vertex_layout::TEX_COORDS, primitive);
+        auto &cylinder = builder.mesh;
+        for (auto z: {-length / 2.0f, length / 2.0f}) {
+            for (int i = 0; i <= tessellation; ++i, ++builder.vertex) {
+                cylinder.positions[builder.vertex] = {radius * table.cos[i], radius * table.sin[i], z};
+                cylinder.tex_coords[builder.vertex] = {(table.cos[i] / 2.0f) + 0.5f, (table.sin[i] / 2.0f) + 0.5f};
+            }
         }
-        return cylinder;
+        mesh_builder::add_quads(builder, 0, tessellation + 1, tessellation);
+        arena::rewind(arena::scratch(), mark);
+        return mesh_builder::finish(builder);
     }
 
     mesh::mesh_template_t make_ndc_cube() {
@@ -0,0 +1,612 @@
+#include "simplifier.hpp"
+#include "arena.hpp"
+#include "mesh_adjacency.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+    // border and seam edges add a plane through them, square to their triangle, this much heavier than
+    // the triangle's own, so their ends don't wander off the line
+    const float BORDER_WEIGHT = 10.0f;
+
+    // collapses are applied in passes, each taking the cheapest this fraction of the candidates
+    const size_t PASS_FRACTION = 3;
+
+    // colours, tex coords and normals, as many floats as a vertex can have
+    const size_t MAX_CHANNELS = 8;
+
+    const std::uint32_t NONE = ~0u;
+
+    enum kind_t : std::uint8_t {
+        MANIFOLD, // inside a surface, one set of attributes, can collapse into any neighbour
+        SEAM, // on one border or attribute seam, can only collapse along it
+        LOCKED, // on several, or on a non-manifold edge, never moves
+    };
+
+    // sum of squared distances to weighted planes, Q(p) = p'Ap + 2b'p + c, w being the total weight
+    struct quadric_t {
+        float a00 = 0.0f, a11 = 0.0f, a22 = 0.0f, a10 = 0.0f, a20 = 0.0f, a21 = 0.0f;
+        float b0 = 0.0f, b1 = 0.0f, b2 = 0.0f;
+        float c = 0.0f;
+        float w = 0.0f;
+    };
+
+    // the part of an attribute quadric that depends on the attribute's value s: -2s(g.p + d) + s^2 w
+    struct gradient_t {
+        glm::vec3 g = glm::vec3(0.0f);
+        float d = 0.0f;
+    };
+
+    void add_plane(quadric_t &q, const glm::vec3 &n, float d, float w) {
+        q.a00 += w * n.x * n.x;
+        q.a11 += w * n.y * n.y;
+        q.a22 += w * n.z * n.z;
+        q.a10 += w * n.y * n.x;
+        q.a20 += w * n.z * n.x;
+        q.a21 += w * n.z * n.y;
+        q.b0 += w * n.x * d;
+        q.b1 += w * n.y * d;
+        q.b2 += w * n.z * d;
+        q.c += w * d * d;
+    }
+
+    void add(quadric_t &q, const quadric_t &r) {
+        q.a00 += r.a00;
+        q.a11 += r.a11;
+        q.a22 += r.a22;
+        q.a10 += r.a10;
+        q.a20 += r.a20;
+        q.a21 += r.a21;
+        q.b0 += r.b0;
+        q.b1 += r.b1;
+        q.b2 += r.b2;
+        q.c += r.c;
+        q.w += r.w;
+    }
+
+    float evaluate(const quadric_t &q, const glm::vec3 &p) {
+        auto r = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z;
+        r += 2.0f * (q.a10 * p.x * p.y + q.a20 * p.x * p.z + q.a21 * p.y * p.z);
+        r += 2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z);
+        return r + q.c;
+    }
+
+    std::uint64_t edge_key(std::uint32_t a, std::uint32_t b) { return (std::uint64_t) a << 32 | b; }
+
+    bool has_edge(const arena::vector<std::uint64_t> &sorted, std::uint32_t a, std::uint32_t b) {
+        return std::binary_search(sorted.begin(), sorted.end(), edge_key(a, b));
+    }
+
+    using mesh_adjacency::adjacency_t;
+
+    // everything the collapses work on. Positions are moved and scaled to fit a unit box and attributes
+    // scaled by their weight, so errors come out as fractions of the mesh's size. Vertices sharing a
+    // position (either side of a seam) are siblings, the first of them stands for the position: kinds,
+    // open neighbours and position quadrics are kept by it
+    struct state_t {
+        explicit state_t(arena::arena_t &scratch)
+                : positions(arena::make_vector<glm::vec3>(scratch)), attributes(arena::make_vector<float>(scratch)),
+                  position_of(arena::make_vector<std::uint32_t>(scratch)),
+                  next_sibling(arena::make_vector<std::uint32_t>(scratch)),
+                  kind(arena::make_vector<std::uint8_t>(scratch)), open(arena::make_vector<std::uint32_t>(scratch)),
+                  open_edges(arena::make_vector<std::uint8_t>(scratch)),
+                  position_quadrics(arena::make_vector<quadric_t>(scratch)),
+                  attribute_quadrics(arena::make_vector<quadric_t>(scratch)),
+                  gradients(arena::make_vector<gradient_t>(scratch)), indices(arena::make_vector<GLuint>(scratch)) {}
+
+        arena::vector<glm::vec3> positions;
+        arena::vector<float> attributes; // channels a vertex
+        size_t channels = 0;
+
+        arena::vector<std::uint32_t> position_of; // the vertex standing for each vertex's position
+        arena::vector<std::uint32_t> next_sibling; // round every vertex at a position
+        arena::vector<std::uint8_t> kind;
+        arena::vector<std::uint32_t> open; // the two positions along a SEAM vertex's border or seam
+        arena::vector<std::uint8_t> open_edges; // per triangle, bit k for the edge from corner k, until collapsing
+
+        arena::vector<quadric_t> position_quadrics;
+        arena::vector<quadric_t> attribute_quadrics;
+        arena::vector<gradient_t> gradients; // channels a vertex
+
+        arena::vector<GLuint> indices;
+    };
+
+    void weld(arena::arena_t &scratch, state_t &state) {
+        auto n = state.positions.size();
+        auto order = arena::make_vector<std::uint32_t>(scratch, n);
+        std::iota(order.begin(), order.end(), 0u);
+        const auto &p = state.positions;
+        std::sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+            if (p[a].x != p[b].x) return p[a].x < p[b].x;
+            if (p[a].y != p[b].y) return p[a].y < p[b].y;
+            if (p[a].z != p[b].z) return p[a].z < p[b].z;
+            return a < b;
+        });
+
+        state.position_of.assign(n, 0);
+        state.next_sibling.assign(n, 0);
+        for (auto begin = size_t{0}; begin < n;) {
+            auto end = begin + 1;
+            while (end < n && p[order[end]] == p[order[begin]]) ++end;
+            for (auto i = begin; i < end; ++i) {
+                state.position_of[order[i]] = order[begin];
+                state.next_sibling[order[i]] = order[i + 1 < end ? i + 1 : begin];
+            }
+            begin = end;
+        }
+    }
+
+    void add_open(state_t &state, std::uint32_t at, std::uint32_t neighbour, arena::vector<std::uint8_t> &open_count) {
+        auto *open = &state.open[2 * at];
+        if (open_count[at] > 0 && open[0] == neighbour) return;
+        if (open_count[at] > 1 && open[1] == neighbour) return;
+        if (open_count[at] < 2) open[open_count[at]] = neighbour;
+        open_count[at] = (std::uint8_t) std::min(open_count[at] + 1, 3);
+    }
+
+    // an edge is open if no triangle runs the other way along it with the same vertices, so on a border
+    // or, if one does at the same positions, on a seam
+    void classify(arena::arena_t &scratch, state_t &state) {
+        auto n = state.positions.size();
+        const auto &indices = state.indices;
+        auto vertex_edges = arena::make_vector<std::uint64_t>(scratch);
+        auto position_edges = arena::make_vector<std::uint64_t>(scratch);
+        vertex_edges.reserve(indices.size());
+        position_edges.reserve(indices.size());
+        for (auto i = size_t{0}; i < indices.size(); i += 3) {
+            for (int k = 0; k < 3; ++k) {
+                auto a = indices[i + k], b = indices[i + (k + 1) % 3];
+                vertex_edges.push_back(edge_key(a, b));
+                position_edges.push_back(edge_key(state.position_of[a], state.position_of[b]));
+            }
+        }
+        std::sort(vertex_edges.begin(), vertex_edges.end());
+        std::sort(position_edges.begin(), position_edges.end());
+
+        state.kind.assign(n, MANIFOLD);
+        state.open.assign(2 * n, NONE);
+        state.open_edges.assign(indices.size() / 3, 0);
+        auto open_count = arena::make_vector<std::uint8_t>(scratch, n, 0);
+        // a position edge with more than one triangle along it each way isn't manifold
+        for (auto i = size_t{1}; i < position_edges.size(); ++i) {
+            if (position_edges[i] != position_edges[i - 1]) continue;
+            state.kind[position_edges[i] >> 32] = LOCKED;
+            state.kind[position_edges[i] & 0xffffffffu] = LOCKED;
+        }
+        for (auto i = size_t{0}; i < indices.size(); i += 3) {
+            for (int k = 0; k < 3; ++k) {
+                auto a = indices[i + k], b = indices[i + (k + 1) % 3];
+                if (has_edge(vertex_edges, b, a)) continue;
+                state.open_edges[i / 3] |= (std::uint8_t) (1u << k);
+                auto pa = state.position_of[a], pb = state.position_of[b];
+                add_open(state, pa, pb, open_count);
+                add_open(state, pb, pa, open_count);
+            }
+        }
+        for (auto v = std::uint32_t{0}; v < n; ++v) {
+            if (state.position_of[v] != v || state.kind[v] == LOCKED) continue;
+            auto siblings = state.next_sibling[v] != v;
+            if (open_count[v] == 2) {
+                state.kind[v] = SEAM;
+            } else if (open_count[v] != 0 || siblings) {
+                state.kind[v] = LOCKED;
+            }
+        }
+    }
+
+    void build_quadrics(state_t &state) {
+        auto n = state.positions.size();
+        auto channels = state.channels;
+        state.position_quadrics.assign(n, quadric_t{});
+        state.attribute_quadrics.assign(n, quadric_t{});
+        state.gradients.assign(n * channels, gradient_t{});
+
+        const auto &indices = state.indices;
+        const auto &p = state.positions;
+        for (auto i = size_t{0}; i < indices.size(); i += 3) {
+            GLuint v[3] = {indices[i], indices[i + 1], indices[i + 2]};
+            auto e1 = p[v[1]] - p[v[0]], e2 = p[v[2]] - p[v[0]];
+            auto normal = glm::cross(e1, e2);
+            auto length = glm::length(normal);
+            if (length == 0.0f) continue;
+            normal /= length;
+            auto area = 0.5f * length;
+
+            auto plane = quadric_t{};
+            add_plane(plane, normal, -glm::dot(normal, p[v[0]]), area);
+            plane.w = area;
+            for (auto k: v) {
+                add(state.position_quadrics[state.position_of[k]], plane);
+            }
+
+            // planes square to the triangle along its border and seam edges
+            for (int k = 0; k < 3; ++k) {
+                if (!(state.open_edges[i / 3] & (1u << k))) continue;
+                auto a = v[k], b = v[(k + 1) % 3];
+                auto pa = state.position_of[a], pb = state.position_of[b];
+                auto edge = p[b] - p[a];
+                auto side = glm::cross(edge, normal);
+                auto side_length = glm::length(side);
+                if (side_length == 0.0f) continue;
+                side /= side_length;
+                auto border = quadric_t{};
+                add_plane(border, side, -glm::dot(side, p[a]), BORDER_WEIGHT * glm::dot(edge, edge));
+                add(state.position_quadrics[pa], border);
+                add(state.position_quadrics[pb], border);
+            }
+
+            if (channels == 0) continue;
+            // each attribute as a linear function g.p + d over the triangle, solved in its plane
+            auto a = glm::dot(e1, e1), b = glm::dot(e1, e2), c = glm::dot(e2, e2);
+            auto inverse_det = 1.0f / (a * c - b * b);
+            auto attribute = quadric_t{};
+            attribute.w = area;
+            gradient_t gradients[MAX_CHANNELS];
+            for (auto j = size_t{0}; j < channels; ++j) {
+                auto s0 = state.attributes[v[0] * channels + j];
+                auto ds1 = state.attributes[v[1] * channels + j] - s0;
+                auto ds2 = state.attributes[v[2] * channels + j] - s0;
+                auto alpha = (c * ds1 - b * ds2) * inverse_det;
+                auto beta = (a * ds2 - b * ds1) * inverse_det;
+                auto g = alpha * e1 + beta * e2;
+                auto d = s0 - glm::dot(g, p[v[0]]);
+                add_plane(attribute, g, d, area);
+                gradients[j] = {area * g, area * d};
+            }
+            for (auto k: v) {
+                add(state.attribute_quadrics[k], attribute);
+                for (auto j = size_t{0}; j < channels; ++j) {
+                    state.gradients[k * channels + j].g += gradients[j].g;
+                    state.gradients[k * channels + j].d += gradients[j].d;
+                }
+            }
+        }
+    }
+
+    // the vertex at position `to` that a vertex at another position ends up as, the one sharing a
+    // triangle with it, or NONE
+    std::uint32_t target_of(const state_t &state, const adjacency_t &adjacency, std::uint32_t v, std::uint32_t to) {
+        for (auto a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; ++a) {
+            auto t = adjacency.triangles[a];
+            for (int k = 0; k < 3; ++k) {
+                auto corner = state.indices[3 * t + k];
+                if (state.position_of[corner] == to) return corner;
+            }
+        }
+        return NONE;
+    }
+
+    bool can_collapse(const state_t &state, std::uint32_t from, std::uint32_t to) {
+        switch (state.kind[from]) {
+            case MANIFOLD:
+                return true;
+            case SEAM:
+                return state.open[2 * from] == to || state.open[2 * from + 1] == to;
+            default:
+                return false;
+        }
+    }
+
+    // squared error of moving position `from` to `to`, or a negative number if a vertex there has nowhere to go
+    float collapse_cost(const state_t &state, const adjacency_t &adjacency, std::uint32_t from, std::uint32_t to) {
+        const auto &p = state.positions[to];
+        const auto &q = state.position_quadrics[from];
+        auto cost = q.w > 0.0f ? std::max(evaluate(q, p) / q.w, 0.0f) : 0.0f;
+        auto v = from;
+        do {
+            auto target = target_of(state, adjacency, v, to);
+            if (target == NONE) return -1.0f;
+            const auto &a = state.attribute_quadrics[v];
+            if (state.channels > 0 && a.w > 0.0f) {
+                auto r = evaluate(a, p);
+                for (auto j = size_t{0}; j < state.channels; ++j) {
+                    auto s = state.attributes[target * state.channels + j];
+                    const auto &gradient = state.gradients[v * state.channels + j];
+                    r += s * (s * a.w - 2.0f * (glm::dot(gradient.g, p) + gradient.d));
+                }
+                cost += std::max(r / a.w, 0.0f);
+            }
+            v = state.next_sibling[v];
+        } while (v != from);
+        return cost;
+    }
+
+    // the positions around position `from`, in no order and possibly repeated
+    void ring_of(const state_t &state, const adjacency_t &adjacency, std::uint32_t from,
+                 arena::vector<std::uint32_t> &ring) {
+        ring.clear();
+        auto v = from;
+        do {
+            for (auto a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; ++a) {
+                auto t = adjacency.triangles[a];
+                for (int k = 0; k < 3; ++k) {
+                    auto corner = state.position_of[state.indices[3 * t + k]];
+                    if (corner != from) ring.push_back(corner);
+                }
+            }
+            v = state.next_sibling[v];
+        } while (v != from);
+    }
+
+    // collapsing an edge keeps the surface manifold if the only positions both its ends neighbour are
+    // the third corners of the triangles along it (the link condition), and it mustn't turn any of the
+    // triangles that stay over. Returns how many triangles the collapse removes, or 0 if it can't be made
+    size_t check_collapse(const state_t &state, const adjacency_t &adjacency, std::uint32_t from, std::uint32_t to,
+                          arena::vector<std::uint32_t> &from_ring, arena::vector<std::uint32_t> &to_ring) {
+        ring_of(state, adjacency, from, from_ring);
+        ring_of(state, adjacency, to, to_ring);
+        std::sort(from_ring.begin(), from_ring.end());
+        from_ring.erase(std::unique(from_ring.begin(), from_ring.end()), from_ring.end());
+        std::sort(to_ring.begin(), to_ring.end());
+        to_ring.erase(std::unique(to_ring.begin(), to_ring.end()), to_ring.end());
+        auto shared = size_t{0};
+        for (auto a = from_ring.begin(), b = to_ring.begin(); a != from_ring.end() && b != to_ring.end();) {
+            if (*a < *b) {
+                ++a;
+            } else if (*b < *a) {
+                ++b;
+            } else {
+                ++shared;
+                ++a;
+                ++b;
+            }
+        }
+
+        auto removed = size_t{0};
+        const auto &p = state.positions;
+        auto v = from;
+        do {
+            for (auto a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; ++a) {
+                auto t = adjacency.triangles[a];
+                GLuint corners[3] = {state.indices[3 * t], state.indices[3 * t + 1], state.indices[3 * t + 2]};
+                glm::vec3 moved[3];
+                bool along_edge = false;
+                for (int k = 0; k < 3; ++k) {
+                    auto position = state.position_of[corners[k]];
+                    along_edge |= position == to;
+                    moved[k] = position == from ? p[to] : p[corners[k]];
+                }
+                if (along_edge) {
+                    ++removed;
+                    continue;
+                }
+                auto before = glm::cross(p[corners[1]] - p[corners[0]], p[corners[2]] - p[corners[0]]);
+                auto after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                if (glm::dot(before, after) <= 0.0f) return 0;
+            }
+            v = state.next_sibling[v];
+        } while (v != from);
+        return shared == removed ? removed : 0;
+    }
+
+    struct candidate_t {
+        std::uint32_t from;
+        std::uint32_t to;
+        float cost;
+    };
+
+    // one pass of collapses, none of them touching the triangles of another so their checks all hold.
+    // Returns how many triangles went, max_cost is raised to the costliest collapse made
+    size_t collapse_pass(arena::arena_t &scratch, state_t &state, size_t removable, float cost_limit,
+                         float &max_cost) {
+        auto n = state.positions.size();
+        auto adjacency = mesh_adjacency::build(scratch, state.indices.data(), state.indices.size(), n);
+
+        // every edge once, from its lower numbered end
+        auto candidates = arena::make_vector<candidate_t>(scratch);
+        candidates.reserve(state.indices.size() / 2);
+        auto from_ring = arena::make_vector<std::uint32_t>(scratch);
+        auto to_ring = arena::make_vector<std::uint32_t>(scratch);
+        for (auto a = std::uint32_t{0}; a < n; ++a) {
+            if (state.position_of[a] != a) continue;
+            ring_of(state, adjacency, a, from_ring);
+            std::sort(from_ring.begin(), from_ring.end());
+            for (auto i = size_t{0}; i < from_ring.size(); ++i) {
+                auto b = from_ring[i];
+                if (b < a || (i > 0 && from_ring[i - 1] == b)) continue;
+                auto ab = can_collapse(state, a, b) ? collapse_cost(state, adjacency, a, b) : -1.0f;
+                auto ba = can_collapse(state, b, a) ? collapse_cost(state, adjacency, b, a) : -1.0f;
+                if (ab >= 0.0f && (ba < 0.0f || ab <= ba)) {
+                    candidates.push_back({a, b, ab});
+                } else if (ba >= 0.0f) {
+                    candidates.push_back({b, a, ba});
+                }
+            }
+        }
+        if (candidates.empty()) return 0;
+
+        // only the pass's share needs sorting, the rest only if none of that share could be collapsed
+        auto cheaper = [](const candidate_t &a, const candidate_t &b) { return a.cost < b.cost; };
+        auto share = candidates.begin() + (std::ptrdiff_t) ((candidates.size() - 1) / PASS_FRACTION);
+        std::nth_element(candidates.begin(), share, candidates.end(), cheaper);
+        std::sort(candidates.begin(), share + 1, cheaper);
+
+        auto remap = arena::make_vector<std::uint32_t>(scratch, n);
+        std::iota(remap.begin(), remap.end(), 0u);
+        auto touched = arena::make_vector<bool>(scratch, n, false);
+        auto removed = size_t{0};
+        for (auto it = candidates.begin(); it != candidates.end(); ++it) {
+            if (it == share + 1) {
+                if (removed > 0) break;
+                std::sort(it, candidates.end(), cheaper);
+            }
+            const auto &candidate = *it;
+            if (removed >= removable || candidate.cost > cost_limit) break;
+            auto from = candidate.from, to = candidate.to;
+            if (touched[from] || touched[to]) continue;
+            auto collapsed = check_collapse(state, adjacency, from, to, from_ring, to_ring);
+            if (collapsed == 0) continue;
+
+            auto v = from;
+            do {
+                auto target = target_of(state, adjacency, v, to);
+                remap[v] = target;
+                add(state.attribute_quadrics[target], state.attribute_quadrics[v]);
+                for (auto j = size_t{0}; j < state.channels; ++j) {
+                    state.gradients[target * state.channels + j].g += state.gradients[v * state.channels + j].g;
+                    state.gradients[target * state.channels + j].d += state.gradients[v * state.channels + j].d;
+                }
+                v = state.next_sibling[v];
+            } while (v != from);
+            add(state.position_quadrics[to], state.position_quadrics[from]);
+
+            // the line from passes on to `to`
+            if (state.kind[from] == SEAM) {
+                auto beyond = state.open[2 * from] == to ? state.open[2 * from + 1] : state.open[2 * from];
+                std::replace(&state.open[2 * to], &state.open[2 * to] + 2, from, beyond);
+                std::replace(&state.open[2 * beyond], &state.open[2 * beyond] + 2, from, to);
+            }
+
+            touched[from] = touched[to] = true;
+            for (auto neighbour: from_ring) {
+                touched[neighbour] = true;
+            }
+            removed += collapsed;
+            max_cost = std::max(max_cost, candidate.cost);
+        }
+
+        // drop the triangles that lost a corner
+        auto kept = size_t{0};
+        for (auto i = size_t{0}; i < state.indices.size(); i += 3) {
+            GLuint corners[3] = {remap[state.indices[i]], remap[state.indices[i + 1]], remap[state.indices[i + 2]]};
+            auto a = state.position_of[corners[0]], b = state.position_of[corners[1]];
+            auto c = state.position_of[corners[2]];
+            if (a == b || b == c || c == a) continue;
+            std::copy(corners, corners + 3, &state.indices[kept]);
+            kept += 3;
+        }
+        auto dropped = (state.indices.size() - kept) / 3;
+        state.indices.resize(kept);
+        return dropped;
+    }
+
+    // the longest side of the positions' box, whose lowest corner goes in low
+    float size_of(const std::vector<glm::vec3> &positions, glm::vec3 &low) {
+        low = glm::vec3(std::numeric_limits<float>::max());
+        auto high = -low;
+        for (const auto &p: positions) {
+            low = glm::min(low, p);
+            high = glm::max(high, p);
+        }
+        return std::max({high.x - low.x, high.y - low.y, high.z - low.z});
+    }
+
+    void append_channels(arena::vector<float> &attributes, size_t channels, size_t offset, const float *values,
+                         size_t width, float weight) {
+        auto n = attributes.size() / channels;
+        for (auto v = size_t{0}; v < n; ++v) {
+            for (auto j = size_t{0}; j < width; ++j) {
+                attributes[v * channels + offset + j] = weight * values[v * width + j];
+            }
+        }
+    }
+} // namespace
+
+namespace simplifier {
+    float simplify(mesh::mesh_template_t &mesh_template, const options_t &options) {
+        const auto &indices = mesh_template.indices;
+        auto triangles = indices.size() / 3;
+        if (indices.empty() || indices.size() % 3 != 0 || mesh_template.primitive != GL_TRIANGLES ||
+            triangles <= options.target_triangles) {
+            return 0.0f;
+        }
+
+        auto &scratch = arena::scratch();
+        auto mark = arena::mark(scratch);
+        auto n = mesh_template.positions.size();
+
+        // fit a unit box, so errors are fractions of the mesh's size
+        auto low = glm::vec3(0.0f);
+        auto extent = size_of(mesh_template.positions, low);
+        if (!(extent > 0.0f)) return 0.0f;
+
+        auto state = state_t(scratch);
+        state.positions.resize(n);
+        for (auto v = size_t{0}; v < n; ++v) {
+            state.positions[v] = (mesh_template.positions[v] - low) / extent;
+        }
+        bool has_colors = mesh_template.colors.size() == n;
+        bool has_tex_coords = mesh_template.tex_coords.size() == n;
+        bool has_normals = mesh_template.normals.size() == n;
+        state.channels = (has_colors ? 3 : 0) + (has_tex_coords ? 2 : 0) + (has_normals ? 3 : 0);
+        state.attributes.assign(n * state.channels, 0.0f);
+        auto offset = size_t{0};
+        if (has_colors) {
+            append_channels(state.attributes, state.channels, offset, &mesh_template.colors[0].x, 3,
+                            options.attribute_weight);
+            offset += 3;
+        }
+        if (has_tex_coords) {
+            append_channels(state.attributes, state.channels, offset, &mesh_template.tex_coords[0].x, 2,
+                            options.attribute_weight);
+            offset += 2;
+        }
+        if (has_normals) {
+            append_channels(state.attributes, state.channels, offset, &mesh_template.normals[0].x, 3,
+                            options.attribute_weight);
+        }
+        state.indices.assign(indices.begin(), indices.end());
+
+        weld(scratch, state);
+        classify(scratch, state);
+        build_quadrics(state);
+
+        // compared squared and in unit box units, as costs are
+        auto cost_limit = options.max_error / extent;
+        cost_limit = cost_limit < std::sqrt(std::numeric_limits<float>::max()) ? cost_limit * cost_limit
+                                                                                : std::numeric_limits<float>::max();
+        auto max_cost = 0.0f;
+        while (triangles > options.target_triangles) {
+            auto pass = arena::mark(scratch);
+            auto removed = collapse_pass(scratch, state, triangles - options.target_triangles, cost_limit, max_cost);
+            arena::rewind(scratch, pass);
+            if (removed == 0) break;
+            triangles -= removed;
+        }
+
+        // keep the vertices still used, in the order they're first used
+        auto new_index = arena::make_vector<std::uint32_t>(scratch, n, NONE);
+        auto simplified = mesh::mesh_template_t{};
+        simplified.indices.reserve(state.indices.size());
+        for (auto index: state.indices) {
+            if (new_index[index] == NONE) {
+                new_index[index] = (std::uint32_t) simplified.positions.size();
+                simplified.positions.push_back(mesh_template.positions[index]);
+                if (has_colors) simplified.colors.push_back(mesh_template.colors[index]);
+                if (has_tex_coords) simplified.tex_coords.push_back(mesh_template.tex_coords[index]);
+                if (has_normals) simplified.normals.push_back(mesh_template.normals[index]);
+            }
+            simplified.indices.push_back(new_index[index]);
+        }
+        arena::rewind(scratch, mark);
+        mesh_template = std::move(simplified);
+        return std::sqrt(max_cost) * extent;
+    }
+
+    std::vector<level_t> make_levels(const mesh::mesh_template_t &mesh_template, const options_t &options) {
+        auto levels = std::vector<level_t>{};
+        levels.reserve(MAX_LEVELS);
+        auto low = glm::vec3(0.0f);
+        auto max_error = MAX_LEVEL_ERROR * size_of(mesh_template.positions, low);
+        const auto *finer = &mesh_template;
+        auto error = 0.0f;
+        while (levels.size() < MAX_LEVELS) {
+            auto triangles = finer->indices.size() / 3;
+            auto target = (size_t) ((float) triangles * LEVEL_REDUCTION);
+            if (target < MIN_LEVEL_TRIANGLES) break;
+
+            auto level = level_t{*finer};
+            auto level_options = options;
+            level_options.target_triangles = target;
+            error += simplifier::simplify(level.mesh_template, level_options);
+            // one that's stuck well short of the target isn't worth drawing instead
+            if (level.mesh_template.indices.size() / 3 > (triangles + target) / 2 || error > max_error) break;
+            level.error = error;
+            levels.push_back(std::move(level));
+            finer = &levels.back().mesh_template;
+        }
+        return levels;
+    }
+} // namespace simplifier
@@ -0,0 +1,197 @@
+#include "stream_buffer.hpp"
+#include "gl_state.hpp"
+#include "vertex_layout.hpp"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <vector>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace {
+    const GLsizeiptr MIN_REGION_SIZE = 1 << 20;
+    const GLuint64 WAIT_TIMEOUT_NS = 1000000000;
+
+    using buffer_storage_t = void (APIENTRYP)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+    // a buffer outgrown mid-frame, kept until the draws already made from it are done
+    struct retired_t {
+        GLuint buffer;
+        GLuint vaos[vertex_layout::ATTRIBUTE_SETS];
+        unsigned long frame;
+    };
+
+    struct stream_t {
+        bool initialised = false;
+        buffer_storage_t buffer_storage = nullptr; // null before GL 4.4
+        GLuint buffer = 0;
+        GLuint vaos[vertex_layout::ATTRIBUTE_SETS] = {}; // made as formats turn up
+        unsigned char *mapped = nullptr; // the whole buffer, when it's persistently mapped
+        GLsizeiptr region_size = 0;
+        int region = 0;
+        GLsizeiptr used = 0; // bytes written to the current region
+        GLsync fences[stream_buffer::REGIONS] = {};
+        unsigned long frame = 0;
+        std::vector<retired_t> retired;
+    };
+
+    stream_t stream;
+
+    GLsizeiptr align_up(GLsizeiptr offset, GLsizeiptr alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    void point_vao(std::uint32_t format) {
+        gl_state::bind_vertex_array(stream.vaos[format]);
+        glBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, stream.buffer);
+        vertex_layout::describe(format).set_attributes(0);
+    }
+
+    void make_buffer(GLsizeiptr region_size) {
+        if (!stream.initialised) {
+            GLint major = 0;
+            GLint minor = 0;
+            glGetIntegerv(GL_MAJOR_VERSION, &major);
+            glGetIntegerv(GL_MINOR_VERSION, &minor);
+            if (major > 4 || (major == 4 && minor >= 4)) {
+                stream.buffer_storage = reinterpret_cast<buffer_storage_t>(glfwGetProcAddress("glBufferStorage"));
+            }
+            stream.initialised = true;
+        }
+
+        // meshes written this frame still point at the old buffer through the old VAOs, so both are
+        // kept until the frame's draws are done
+        if (stream.buffer) {
+            auto retired = retired_t{stream.buffer, {}, stream.frame};
+            std::copy(std::begin(stream.vaos), std::end(stream.vaos), std::begin(retired.vaos));
+            stream.retired.push_back(retired);
+            std::fill(std::begin(stream.vaos), std::end(stream.vaos), 0);
+        }
+        // the old fences guarded the old buffer
+        for (auto &fence: stream.fences) {
+            if (fence) glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        stream.region_size = region_size;
+        stream.region = 0;
+        stream.used = 0;
+        auto size = stream_buffer::REGIONS * region_size;
+        glGenBuffers(1, &stream.buffer);
+        // the copy target leaves array and element bindings (and so any bound VAO) alone
+        glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+        if (stream.buffer_storage) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            stream.buffer_storage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+            stream.mapped = static_cast<unsigned char *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+        } else {
+            glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            stream.mapped = nullptr;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void release_retired() {
+        auto done = [](const retired_t &retired) { return retired.frame + stream_buffer::REGIONS <= stream.frame; };
+        for (const auto &retired: stream.retired) {
+            if (!done(retired)) continue;
+            // deleting a persistently mapped buffer unmaps it
+            glDeleteBuffers(1, &retired.buffer);
+            glDeleteVertexArrays(vertex_layout::ATTRIBUTE_SETS, retired.vaos);
+            gl_state::invalidate();
+        }
+        stream.retired.erase(std::remove_if(stream.retired.begin(), stream.retired.end(), done), stream.retired.end());
+    }
+} // namespace
+
+namespace stream_buffer {
+    geometry_pool::allocation_t write(const mesh::mesh_template_t &mesh_template) {
+        auto allocation = geometry_pool::allocation_t{};
+        allocation.format = vertex_layout::attributes_of(mesh_template);
+        const auto &layout = vertex_layout::describe(allocation.format);
+        allocation.vertex_count = (GLsizei) mesh_template.positions.size();
+        allocation.index_count = mesh_template.indices.empty()
+                                 ? allocation.vertex_count
+                                 : (GLsizei) mesh_template.indices.size();
+        allocation.index_type = geometry_pool::index_type_for(allocation.vertex_count, mesh_template.primitive);
+        auto index_size = mesh::index_size(allocation.index_type);
+        auto vertices_size = allocation.vertex_count * (GLsizeiptr) layout.stride;
+        auto indices_size = allocation.index_count * index_size;
+
+        // with room to spare for aligning both
+        auto needed = vertices_size + layout.stride + indices_size + index_size;
+        if (!stream.buffer || stream.used + needed > stream.region_size) {
+            make_buffer(std::max({MIN_REGION_SIZE, 2 * stream.region_size, needed}));
+        }
+        if (!stream.vaos[allocation.format]) {
+            glGenVertexArrays(1, &stream.vaos[allocation.format]);
+            point_vao(allocation.format);
+        }
+
+        // vertices start on a multiple of the stride so a base vertex reaches them, indices on one of their size
+        auto region_start = stream.region * stream.region_size;
+        auto vertex_offset = align_up(region_start + stream.used, layout.stride);
+        auto index_offset = align_up(vertex_offset + vertices_size, index_size);
+        auto end = index_offset + indices_size;
+        stream.used = end - region_start;
+        allocation.vao = stream.vaos[allocation.format];
+        allocation.base_vertex = (GLint) (vertex_offset / layout.stride);
+        allocation.first_index = (GLuint) (index_offset / index_size);
+
+        unsigned char *out = nullptr;
+        if (stream.mapped) {
+            out = stream.mapped + vertex_offset;
+        } else {
+            // the fences keep the GPU out of this range, so there's nothing to synchronise with
+            glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+            out = static_cast<unsigned char *>(glMapBufferRange(
+                    GL_COPY_WRITE_BUFFER, vertex_offset, end - vertex_offset,
+                    GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+        }
+
+        layout.write(mesh_template, {}, out);
+        auto *index_out = out + (index_offset - vertex_offset);
+        const auto &indices = mesh_template.indices;
+        if (allocation.index_type == GL_UNSIGNED_SHORT) {
+            auto *short_out = reinterpret_cast<GLushort *>(index_out);
+            for (auto i = GLsizei{0}; i < allocation.index_count; ++i) {
+                short_out[i] = (GLushort) (indices.empty() ? i : indices[i]);
+            }
+        } else {
+            auto *int_out = reinterpret_cast<GLuint *>(index_out);
+            for (auto i = GLsizei{0}; i < allocation.index_count; ++i) {
+                int_out[i] = indices.empty() ? (GLuint) i : indices[i];
+            }
+        }
+
+        if (!stream.mapped) {
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        return allocation;
+    }
+
+    void next_frame() {
+        if (!stream.buffer) return;
+
+        stream.fences[stream.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stream.region = (stream.region + 1) % REGIONS;
+        stream.used = 0;
+        ++stream.frame;
+
+        // only blocks if the GPU is still on the frame that last wrote here, REGIONS frames ago
+        auto &fence = stream.fences[stream.region];
+        if (fence) {
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS) == GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        release_retired();
+    }
+} // namespace stream_buffer
@@ -1,9 +1,16 @@
 #include <glad/glad.h>
 #include <iostream>
+#include <unordered_set>
 #include <stb/stb_image.h>
 #include <chicken3421/chicken3421.hpp>
 
 #include "texture_2d.hpp"
+#include "gl_state.hpp"
+
+namespace {
+    // textures whose images had alpha below 1, by handle
+    std::unordered_set<GLuint> translucent;
+}
 
 namespace texture_2d {
     GLuint init(std::string file_name, params_t const &params) {
@@ -19,7 +26,18 @@ namespace texture_2d {
 
         chicken3421::expect(data, "Could not read " + file_name);
 
-        glBindTexture(GL_TEXTURE_2D, tex);
+        // alpha is the last channel of grey + alpha and RGBA images
+        if (n_channels == 2 || n_channels == 4) {
+            auto *pixels = static_cast<const unsigned char *>(data);
+            for (auto i = size_t{0}; i < (size_t) width * height; ++i) {
+                if (pixels[i * n_channels + n_channels - 1] < 255) {
+                    translucent.insert(tex);
+                    break;
+                }
+            }
+        }
+
+        gl_state::bind_texture(GL_TEXTURE_2D, tex);
 
         GLenum format = n_channels == 3 ? GL_RGB : GL_RGBA;
         glTexImage2D(GL_TEXTURE_2D, 0, (GLint)format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
@@ -43,17 +61,24 @@ namespace texture_2d {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, params.filter_min);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, params.filter_max);
 
-        glBindTexture(GL_TEXTURE_2D, 0);
+        gl_state::bind_texture(GL_TEXTURE_2D, 0);
 
         return tex;
     }
 
     void bind(GLuint tex) {
-        glBindTexture(GL_TEXTURE_2D, tex);
+        gl_state::bind_texture(GL_TEXTURE_2D, tex);
+    }
+
+    bool is_translucent(GLuint tex) {
+        return translucent.count(tex) > 0;
     }
 
     void destroy(GLuint tex) {
+        translucent.erase(tex);
         glDeleteTextures(1, &tex);
+        // deleting a bound texture silently rebinds 0
+        gl_state::invalidate();
     }
 }
 
@@ -0,0 +1,74 @@
+#include "vertex_layout.hpp"
+
+#include <algorithm>
+
+namespace {
+    template<std::uint32_t Attributes>
+    constexpr vertex_layout::descriptor_t make_descriptor() {
+        using layout = vertex_layout::layout_t<Attributes>;
+        return {Attributes, layout::STRIDE, &layout::write, &layout::set_attributes};
+    }
+
+    template<std::size_t... Sets>
+    constexpr std::array<vertex_layout::descriptor_t, sizeof...(Sets)> make_descriptors(std::index_sequence<Sets...>) {
+        return {make_descriptor<Sets>()...};
+    }
+
+    const auto DESCRIPTORS = make_descriptors(std::make_index_sequence<vertex_layout::ATTRIBUTE_SETS>{});
+} // namespace
+
+namespace vertex_layout {
+    quantization_t quantization_of(const bounds::aabb_t &box) {
+        auto quantization = quantization_t{};
+        auto size = box.max - box.min;
+        auto scale = std::max({size.x, size.y, size.z});
+        if (!(scale > 0.0f)) return quantization;
+        quantization.origin = box.min;
+        quantization.scale = scale;
+        return quantization;
+    }
+
+    std::uint32_t attributes_of(const mesh::mesh_template_t &mesh_template, bool quantize) {
+        auto attributes = std::uint32_t{0};
+        if (!mesh_template.colors.empty()) attributes |= COLORS;
+        if (!mesh_template.tex_coords.empty()) attributes |= TEX_COORDS;
+        if (!mesh_template.normals.empty()) attributes |= NORMALS;
+        if (!quantize) return attributes;
+
+        attributes |= QUANTIZED;
+        // tex coords that wrap keep their half floats
+        auto in_unit_square = [](const glm::vec2 &t) { return t.x >= 0.0f && t.x <= 1.0f && t.y >= 0.0f && t.y <= 1.0f; };
+        if ((attributes & TEX_COORDS) &&
+            std::all_of(mesh_template.tex_coords.begin(), mesh_template.tex_coords.end(), in_unit_square)) {
+            attributes |= UNORM_TEX_COORDS;
+        }
+        return attributes;
+    }
+
+    const descriptor_t &describe(std::uint32_t attributes) {
+        return DESCRIPTORS[attributes];
+    }
+
+    quantization_error_t quantization_error(const mesh::mesh_template_t &mesh_template) {
+        auto error = quantization_error_t{};
+        auto attributes = attributes_of(mesh_template, true);
+        auto quantization = quantization_of(bounds::from_points(mesh_template.positions));
+        for (const auto &position: mesh_template.positions) {
+            auto decoded = dequantize_position(quantize_position(position, quantization), quantization);
+            error.position = std::max(error.position, glm::length(decoded - position));
+        }
+        auto min_cosine = 1.0f;
+        for (const auto &normal: mesh_template.normals) {
+            auto length = glm::length(normal);
+            if (length == 0.0f) continue;
+            min_cosine = std::min(min_cosine, glm::dot(decode_octahedral(encode_octahedral(normal)), normal / length));
+        }
+        error.normal_degrees = glm::degrees(std::acos(glm::clamp(min_cosine, -1.0f, 1.0f)));
+        for (const auto &tex_coord: mesh_template.tex_coords) {
+            auto decoded = (attributes & UNORM_TEX_COORDS) ? glm::unpackUnorm2x16(glm::packUnorm2x16(tex_coord))
+                                                           : glm::unpackHalf2x16(glm::packHalf2x16(tex_coord));
+            error.tex_coord = std::max(error.tex_coord, glm::length(decoded - tex_coord));
+        }
+        return error;
+    }
+} // namespace vertex_layout